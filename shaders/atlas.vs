@@ -0,0 +1,26 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in vec2 aTexCoord;
+// per-instance attributes, advanced once per quad instead of once per vertex
+layout (location = 3) in mat4 aTransform;
+layout (location = 7) in vec4 aTint;
+layout (location = 9) in uint aImage;
+
+// TextureAtlas::MAX_REGIONS entries, the layers packed four to an ivec4
+layout (std140) uniform AtlasRegions
+{
+    vec4 uvRects[512];
+    ivec4 layers[128];
+};
+
+out vec4 tint;
+out vec3 TexCoord;
+
+void main()
+{
+    gl_Position = aTransform * vec4(aPos, 1.0);
+    tint = aTint;
+    vec4 uvRect = uvRects[aImage];
+    TexCoord = vec3(uvRect.xy + aTexCoord * uvRect.zw, float(layers[aImage >> 2u][aImage & 3u]));
+}
\ No newline at end of file
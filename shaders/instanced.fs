@@ -0,0 +1,14 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec4 tint;
+in vec2 TexCoord;
+in float mixValue;
+
+uniform sampler2D texture1;
+uniform sampler2D texture2;
+
+void main()
+{
+    FragColor = mix(texture(texture1, TexCoord), texture(texture2, TexCoord), mixValue) * tint;
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in vec2 aTexCoord;
+// per-instance attributes, advanced once per quad instead of once per vertex
+layout (location = 3) in mat4 aTransform;
+layout (location = 7) in vec4 aTint;
+layout (location = 8) in float aMixValue;
+
+out vec4 tint;
+out vec2 TexCoord;
+out float mixValue;
+
+void main()
+{
+    gl_Position = aTransform * vec4(aPos, 1.0);
+    tint = aTint;
+    TexCoord = aTexCoord;
+    mixValue = aMixValue;
+}
\ No newline at end of file
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// summary statistics over a series of frame times, in milliseconds
+struct FrameTimeSummary
+{
+    std::size_t samples = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+
+    static FrameTimeSummary from(std::vector<double> times)
+    {
+        FrameTimeSummary summary;
+        summary.samples = times.size();
+        if (times.empty())
+            return summary;
+        std::sort(times.begin(), times.end());
+        double total = 0.0;
+        for (const double time : times)
+            total += time;
+        summary.mean = total / static_cast<double>(times.size());
+        summary.p50 = percentile(times, 0.50);
+        summary.p95 = percentile(times, 0.95);
+        summary.p99 = percentile(times, 0.99);
+        summary.max = times.back();
+        return summary;
+    }
+
+    // calls body once unmeasured, which warms up the caches and the allocator, then rounds
+    // more times, and summarizes how long those took
+    template <typename Body>
+    static FrameTimeSummary measure(const unsigned long rounds, Body&& body)
+    {
+        std::vector<double> times;
+        times.reserve(rounds);
+        for (unsigned long round = 0; round <= rounds; ++round)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            body();
+            if (round != 0)
+                times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+        return from(std::move(times));
+    }
+
+private:
+    // nearest-rank percentile of an already sorted series
+    static double percentile(const std::vector<double>& sorted, const double fraction)
+    {
+        const auto rank = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size()) + 0.999999);
+        return sorted[std::min(sorted.size(), std::max<std::size_t>(rank, 1)) - 1];
+    }
+};
+
+// the results of a kernel benchmark as a JSON array with one object per line, written to path
+// unless that is empty. The array is closed when the writer goes away, however the benchmark
+// ends
+class BenchmarkJson
+{
+public:
+    explicit BenchmarkJson(const std::string& path)
+    {
+        if (path.empty())
+            return;
+        file.open(path);
+        if (file)
+            file << "[\n";
+        else
+            std::cout << "Failed to open " << path << " for writing" << '\n';
+    }
+    BenchmarkJson(const BenchmarkJson&) = delete;
+    BenchmarkJson& operator=(const BenchmarkJson&) = delete;
+    ~BenchmarkJson()
+    {
+        if (file.is_open())
+            file << (first ? "" : "\n") << "]\n";
+    }
+
+    bool enabled() const { return file.is_open(); }
+
+    // starts the next object and returns the stream its members go to; the caller closes it
+    // with " }"
+    std::ostream& add()
+    {
+        file << (first ? "" : ",\n") << "  { ";
+        first = false;
+        return file;
+    }
+
+private:
+    std::ofstream file;
+    bool first = true;
+};
+
+// records CPU and GPU time for a fixed number of frames. GPU time comes from GL_TIME_ELAPSED
+// queries, read back a few frames late so measuring never stalls the pipeline.
+class FrameBenchmark
+{
+public:
+    // simulated seconds per frame, so every run animates identically regardless of speed
+    static constexpr double FIXED_TIME_STEP = 1.0 / 60.0;
+    // unmeasured frames rendered first, so one-time costs (first texture use, driver shader
+    // recompiles, lazy timer setup) do not land in the percentiles
+    static constexpr unsigned long WARMUP_FRAMES = 3;
+
+    explicit FrameBenchmark(const unsigned long frameCount) : frameCount(frameCount)
+    {
+        cpuTimes.reserve(frameCount);
+        gpuTimes.reserve(frameCount);
+        // timer queries are core since 3.3; skip GPU timing on anything older
+        gpuTiming = GLAD_GL_VERSION_3_3 != 0;
+        if (gpuTiming)
+            glGenQueries(QUERY_COUNT, queries);
+    }
+    FrameBenchmark(const FrameBenchmark&) = delete;
+    FrameBenchmark& operator=(const FrameBenchmark&) = delete;
+    ~FrameBenchmark()
+    {
+        if (gpuTiming)
+            glDeleteQueries(QUERY_COUNT, queries);
+    }
+
+    unsigned long frames() const { return frameCount; }
+    bool done() const { return cpuTimes.size() >= frameCount; }
+
+    void beginFrame()
+    {
+        measuring = renderedFrames >= WARMUP_FRAMES;
+        frameStart = Clock::now();
+        if (measuring && gpuTiming)
+        {
+            // the query slot we are about to reuse was issued QUERY_COUNT frames ago
+            const std::size_t slot = issuedQueries % QUERY_COUNT;
+            if (issuedQueries >= QUERY_COUNT)
+                collectQuery(slot);
+            glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+        }
+    }
+
+    // call after the buffer swap so the CPU time covers the whole frame
+    void endFrame()
+    {
+        ++renderedFrames;
+        if (!measuring)
+            return;
+        if (gpuTiming)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            ++issuedQueries;
+        }
+        cpuTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+    }
+
+    // waits for the outstanding GPU queries and prints the report
+    void finish(const std::string& jsonPath)
+    {
+        if (gpuTiming)
+        {
+            const std::size_t pending = issuedQueries < QUERY_COUNT ? issuedQueries : QUERY_COUNT;
+            for (std::size_t i = issuedQueries - pending; i < issuedQueries; ++i)
+                collectQuery(i % QUERY_COUNT);
+        }
+        const FrameTimeSummary cpu = FrameTimeSummary::from(cpuTimes);
+        const FrameTimeSummary gpu = FrameTimeSummary::from(gpuTimes);
+
+        std::cout << "benchmark: " << cpuTimes.size() << " frames" << '\n';
+        printSummary(std::cout, "cpu", cpu);
+        if (gpuTiming)
+            printSummary(std::cout, "gpu", gpu);
+        else
+            std::cout << "gpu: timer queries unavailable" << '\n';
+
+        if (jsonPath.empty())
+            return;
+        std::ofstream file(jsonPath);
+        if (!file)
+        {
+            std::cout << "Failed to open " << jsonPath << " for writing" << '\n';
+            return;
+        }
+        file << "{\n  \"frames\": " << cpuTimes.size() << ",\n";
+        file << "  \"cpu_ms\": ";
+        writeJsonSummary(file, cpu);
+        file << ",\n  \"gpu_ms\": ";
+        if (gpuTiming)
+            writeJsonSummary(file, gpu);
+        else
+            file << "null";
+        file << "\n}\n";
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr std::size_t QUERY_COUNT = 4;
+
+    unsigned long frameCount;
+    std::vector<double> cpuTimes;
+    std::vector<double> gpuTimes;
+    Clock::time_point frameStart;
+    unsigned long renderedFrames = 0;
+    bool measuring = false;
+
+    bool gpuTiming = false;
+    unsigned int queries[QUERY_COUNT] = {};
+    std::size_t issuedQueries = 0;
+
+    void collectQuery(const std::size_t slot)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+        gpuTimes.push_back(static_cast<double>(elapsed) / 1.0e6);
+    }
+
+    // both leave the stream's format flags and precision as they found them
+    static void printSummary(std::ostream& out, const char* label, const FrameTimeSummary& summary)
+    {
+        const std::ios::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        out << std::fixed << std::setprecision(3)
+            << label << ": mean " << summary.mean << " ms, p50 " << summary.p50 << " ms, p95 " << summary.p95
+            << " ms, p99 " << summary.p99 << " ms, max " << summary.max << " ms" << '\n';
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    static void writeJsonSummary(std::ostream& out, const FrameTimeSummary& summary)
+    {
+        const std::ios::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        out << std::fixed << std::setprecision(6)
+            << "{ \"mean\": " << summary.mean << ", \"p50\": " << summary.p50 << ", \"p95\": " << summary.p95
+            << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " }";
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
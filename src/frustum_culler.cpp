@@ -0,0 +1,334 @@
+#include "frustum_culler.h"
+
+#include "transform_batch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if !defined(FRUSTUM_CULLER_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define FRUSTUM_CULLER_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// as in transform_batch.cpp, the wider kernels are compiled for their instruction set alone and
+// only called once the CPU is known to have it
+#if defined(FRUSTUM_CULLER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FRUSTUM_CULLER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FRUSTUM_CULLER_TARGET(isa)
+#endif
+
+namespace
+{
+    // both kinds of volume as one set of streams; a sphere's radius goes in extentX
+    struct Bounds
+    {
+        const float* x;
+        const float* y;
+        const float* z;
+        const float* extentX;
+        const float* extentY;
+        const float* extentZ;
+    };
+
+    // culls volumes begin ... end - 1 and writes the visible indices to visible, returning how
+    // many. The kernels write an index for each volume of a block with anything visible and only
+    // move past it when the volume is visible, so compacting needs no branch per volume, and a
+    // block with nothing visible, the common case, costs one; the writes stay within end - begin
+    using CullKernel = std::size_t (*)(const float (*planes)[4], const Bounds& bounds, std::size_t begin, std::size_t end, std::uint32_t* visible);
+
+    // a volume is visible unless it lies wholly behind one of the planes: its center further
+    // behind than its reach towards the plane, which for a box is its extent along the normal
+    template <bool BOXES>
+    std::size_t cull_scalar(const float (*planes)[4], const Bounds& bounds, std::size_t begin, const std::size_t end, std::uint32_t* visible)
+    {
+        std::size_t found = 0;
+        for (; begin < end; ++begin)
+        {
+            const float x = bounds.x[begin], y = bounds.y[begin], z = bounds.z[begin];
+            bool inside = true;
+            for (int p = 0; p < 6; ++p)
+            {
+                const float* plane = planes[p];
+                const float distance = ((plane[0] * x + plane[1] * y) + plane[2] * z) + plane[3];
+                const float reach = BOXES
+                    ? (std::fabs(plane[0]) * bounds.extentX[begin] + std::fabs(plane[1]) * bounds.extentY[begin]) + std::fabs(plane[2]) * bounds.extentZ[begin]
+                    : bounds.extentX[begin];
+                inside = inside && distance >= -reach;
+            }
+            visible[found] = static_cast<std::uint32_t>(begin);
+            found += inside ? 1 : 0;
+        }
+        return found;
+    }
+
+#ifdef FRUSTUM_CULLER_X86
+    // four volumes per iteration, summed in the scalar kernel's order; the rest go through it
+    template <bool BOXES>
+    FRUSTUM_CULLER_TARGET("sse2")
+    std::size_t cull_sse2(const float (*planes)[4], const Bounds& bounds, const std::size_t begin, const std::size_t end, std::uint32_t* visible)
+    {
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const float* const inX = bounds.x;
+        const float* const inY = bounds.y;
+        const float* const inZ = bounds.z;
+        const float* const inExtentX = bounds.extentX;
+        const float* const inExtentY = bounds.extentY;
+        const float* const inExtentZ = bounds.extentZ;
+        std::size_t found = 0;
+        std::size_t i = begin;
+        for (; i + 4 <= end; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(inX + i), y = _mm_loadu_ps(inY + i), z = _mm_loadu_ps(inZ + i);
+            const __m128 extentX = _mm_loadu_ps(inExtentX + i);
+            const __m128 extentY = BOXES ? _mm_loadu_ps(inExtentY + i) : extentX;
+            const __m128 extentZ = BOXES ? _mm_loadu_ps(inExtentZ + i) : extentX;
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                const float* plane = planes[p];
+                const __m128 a = _mm_set1_ps(plane[0]), b = _mm_set1_ps(plane[1]), c = _mm_set1_ps(plane[2]);
+                const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)), _mm_mul_ps(c, z)), _mm_set1_ps(plane[3]));
+                __m128 reach = extentX;
+                if (BOXES)
+                {
+                    reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign, a), extentX), _mm_mul_ps(_mm_andnot_ps(sign, b), extentY)),
+                        _mm_mul_ps(_mm_andnot_ps(sign, c), extentZ));
+                }
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_xor_ps(reach, sign)));
+            }
+            const unsigned int bits = static_cast<unsigned int>(_mm_movemask_ps(inside));
+            if (bits == 0)
+                continue;
+            for (unsigned int k = 0; k < 4; ++k)
+            {
+                visible[found] = static_cast<std::uint32_t>(i + k);
+                found += (bits >> k) & 1u;
+            }
+        }
+        return found + cull_scalar<BOXES>(planes, bounds, i, end, visible + found);
+    }
+
+    // eight volumes per iteration, the last partial block through masked loads
+    template <bool BOXES>
+    FRUSTUM_CULLER_TARGET("avx2,fma")
+    std::size_t cull_avx2(const float (*planes)[4], const Bounds& bounds, const std::size_t begin, const std::size_t end, std::uint32_t* visible)
+    {
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const float* const inX = bounds.x;
+        const float* const inY = bounds.y;
+        const float* const inZ = bounds.z;
+        const float* const inExtentX = bounds.extentX;
+        const float* const inExtentY = bounds.extentY;
+        const float* const inExtentZ = bounds.extentZ;
+        std::size_t found = 0;
+        for (std::size_t i = begin; i < end; i += 8)
+        {
+            const std::size_t used = std::min<std::size_t>(end - i, 8);
+            const bool partial = used < 8;
+            const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(used)), lanes);
+            const __m256 x = partial ? _mm256_maskload_ps(inX + i, mask) : _mm256_loadu_ps(inX + i);
+            const __m256 y = partial ? _mm256_maskload_ps(inY + i, mask) : _mm256_loadu_ps(inY + i);
+            const __m256 z = partial ? _mm256_maskload_ps(inZ + i, mask) : _mm256_loadu_ps(inZ + i);
+            const __m256 extentX = partial ? _mm256_maskload_ps(inExtentX + i, mask) : _mm256_loadu_ps(inExtentX + i);
+            __m256 extentY = extentX, extentZ = extentX;
+            if (BOXES)
+            {
+                extentY = partial ? _mm256_maskload_ps(inExtentY + i, mask) : _mm256_loadu_ps(inExtentY + i);
+                extentZ = partial ? _mm256_maskload_ps(inExtentZ + i, mask) : _mm256_loadu_ps(inExtentZ + i);
+            }
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; ++p)
+            {
+                const float* plane = planes[p];
+                const __m256 a = _mm256_set1_ps(plane[0]), b = _mm256_set1_ps(plane[1]), c = _mm256_set1_ps(plane[2]);
+                const __m256 distance = _mm256_fmadd_ps(c, z, _mm256_fmadd_ps(b, y, _mm256_fmadd_ps(a, x, _mm256_set1_ps(plane[3]))));
+                __m256 reach = extentX;
+                if (BOXES)
+                {
+                    reach = _mm256_fmadd_ps(_mm256_andnot_ps(sign, c), extentZ,
+                        _mm256_fmadd_ps(_mm256_andnot_ps(sign, b), extentY, _mm256_mul_ps(_mm256_andnot_ps(sign, a), extentX)));
+                }
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_xor_ps(reach, sign), _CMP_GE_OQ));
+            }
+            const unsigned int bits = static_cast<unsigned int>(_mm256_movemask_ps(inside));
+            if (bits == 0)
+                continue;
+            for (std::size_t k = 0; k < used; ++k)
+            {
+                visible[found] = static_cast<std::uint32_t>(i + k);
+                found += (bits >> k) & 1u;
+            }
+        }
+        return found;
+    }
+
+    unsigned int count_bits(const unsigned int bits)
+    {
+#if defined(_MSC_VER)
+        return __popcnt(bits);
+#else
+        return static_cast<unsigned int>(__builtin_popcount(bits));
+#endif
+    }
+
+    // GCC's own AVX-512 headers trip -Wmaybe-uninitialized (_mm512_undefined_ps)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+    // sixteen volumes per iteration; the visible indices are packed to the front of a register
+    // and stored in one go
+    template <bool BOXES>
+    FRUSTUM_CULLER_TARGET("avx512f")
+    std::size_t cull_avx512(const float (*planes)[4], const Bounds& bounds, const std::size_t begin, const std::size_t end, std::uint32_t* visible)
+    {
+        const __m512 sign = _mm512_set1_ps(-0.0f);
+        const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        const float* const inX = bounds.x;
+        const float* const inY = bounds.y;
+        const float* const inZ = bounds.z;
+        const float* const inExtentX = bounds.extentX;
+        const float* const inExtentY = bounds.extentY;
+        const float* const inExtentZ = bounds.extentZ;
+        std::size_t found = 0;
+        for (std::size_t i = begin; i < end; i += 16)
+        {
+            const std::size_t remaining = end - i;
+            const __mmask16 mask = remaining >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << remaining) - 1);
+            const __m512 x = _mm512_maskz_loadu_ps(mask, inX + i);
+            const __m512 y = _mm512_maskz_loadu_ps(mask, inY + i);
+            const __m512 z = _mm512_maskz_loadu_ps(mask, inZ + i);
+            const __m512 extentX = _mm512_maskz_loadu_ps(mask, inExtentX + i);
+            const __m512 extentY = BOXES ? _mm512_maskz_loadu_ps(mask, inExtentY + i) : extentX;
+            const __m512 extentZ = BOXES ? _mm512_maskz_loadu_ps(mask, inExtentZ + i) : extentX;
+            __mmask16 inside = mask;
+            for (int p = 0; p < 6; ++p)
+            {
+                const float* plane = planes[p];
+                const __m512 a = _mm512_set1_ps(plane[0]), b = _mm512_set1_ps(plane[1]), c = _mm512_set1_ps(plane[2]);
+                const __m512 distance = _mm512_fmadd_ps(c, z, _mm512_fmadd_ps(b, y, _mm512_fmadd_ps(a, x, _mm512_set1_ps(plane[3]))));
+                __m512 reach = extentX;
+                if (BOXES)
+                {
+                    reach = _mm512_fmadd_ps(_mm512_abs_ps(c), extentZ, _mm512_fmadd_ps(_mm512_abs_ps(b), extentY, _mm512_mul_ps(_mm512_abs_ps(a), extentX)));
+                }
+                inside = _mm512_mask_cmp_ps_mask(inside, distance, _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(reach), _mm512_castps_si512(sign))), _CMP_GE_OQ);
+            }
+            const unsigned int visibleCount = count_bits(inside);
+            const __m512i indices = _mm512_maskz_compress_epi32(inside, _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i)), lanes));
+            _mm512_mask_storeu_epi32(visible + found, static_cast<__mmask16>((1u << visibleCount) - 1), indices);
+            found += visibleCount;
+        }
+        return found;
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+    template <bool BOXES>
+    CullKernel select_kernel()
+    {
+        switch (TransformBatch::activeLevel())
+        {
+#ifdef FRUSTUM_CULLER_X86
+        case SimdLevel::AVX512:
+            return cull_avx512<BOXES>;
+        case SimdLevel::AVX2:
+            return cull_avx2<BOXES>;
+        case SimdLevel::SSE2:
+            return cull_sse2<BOXES>;
+#endif
+        default:
+            return cull_scalar<BOXES>;
+        }
+    }
+
+    // every thread culls a contiguous chunk into the part of visible its chunk would fill at
+    // most, and the chunks' lists are then moved together
+    std::size_t cull_parallel(const CullKernel kernel, const float (*planes)[4], const Bounds& bounds, const std::size_t count,
+        std::uint32_t* visible, unsigned int threadCount)
+    {
+        threadCount = FrustumCuller::threadsUsed(count, threadCount);
+        if (threadCount == 1)
+            return kernel(planes, bounds, 0, count, visible);
+
+        // whole blocks of sixteen, so only the last chunk ends in a partial one
+        const std::size_t chunk = ((count + threadCount - 1) / threadCount + 15) / 16 * 16;
+        std::vector<std::size_t> found(threadCount, 0);
+        const auto work = [&](const unsigned int thread)
+        {
+            const std::size_t begin = std::min(count, thread * chunk);
+            const std::size_t end = std::min(count, begin + chunk);
+            found[thread] = kernel(planes, bounds, begin, end, visible + begin);
+        };
+        std::vector<std::thread> threads;
+        for (unsigned int thread = 1; thread < threadCount; ++thread)
+            threads.emplace_back(work, thread);
+        work(0);
+        for (std::thread& thread : threads)
+            thread.join();
+
+        std::size_t total = found[0];
+        for (unsigned int thread = 1; thread < threadCount; ++thread)
+        {
+            std::memmove(visible + total, visible + std::min(count, thread * chunk), found[thread] * sizeof(std::uint32_t));
+            total += found[thread];
+        }
+        return total;
+    }
+}
+
+FrustumCuller::FrustumCuller(const glm::mat4& viewProjection)
+{
+    // clip space x, y and z must each lie within -w ... w (z within 0 ... w with a zero-to-one
+    // depth range), and each bound is a plane in the space the matrix maps from
+    const glm::vec4 x(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+    const glm::vec4 y(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+    const glm::vec4 z(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+    const glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+#if GLM_CONFIG_CLIP_CONTROL & GLM_CLIP_CONTROL_ZO_BIT
+    const glm::vec4 nearPlane = z;
+#else
+    const glm::vec4 nearPlane = w + z;
+#endif
+    const glm::vec4 extracted[6] = { w + x, w - x, w + y, w - y, nearPlane, w - z };
+    for (int p = 0; p < 6; ++p)
+    {
+        const glm::vec4 plane = extracted[p] / glm::length(glm::vec3(extracted[p]));
+        for (int c = 0; c < 4; ++c)
+            planes[p][c] = plane[c];
+    }
+}
+
+glm::vec4 FrustumCuller::plane(const int index) const
+{
+    return glm::vec4(planes[index][0], planes[index][1], planes[index][2], planes[index][3]);
+}
+
+unsigned int FrustumCuller::threadsUsed(const std::size_t count, unsigned int threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    return static_cast<unsigned int>(std::min<std::size_t>(threadCount, std::max<std::size_t>(1, count / MIN_PER_THREAD)));
+}
+
+std::size_t FrustumCuller::cull(const SphereStream& spheres, const std::size_t count, std::uint32_t* visible, const unsigned int threadCount) const
+{
+    const Bounds bounds = { spheres.x, spheres.y, spheres.z, spheres.radius, nullptr, nullptr };
+    return cull_parallel(select_kernel<false>(), planes, bounds, count, visible, threadCount);
+}
+
+std::size_t FrustumCuller::cull(const BoxStream& boxes, const std::size_t count, std::uint32_t* visible, const unsigned int threadCount) const
+{
+    const Bounds bounds = { boxes.centerX, boxes.centerY, boxes.centerZ, boxes.extentX, boxes.extentY, boxes.extentZ };
+    return cull_parallel(select_kernel<true>(), planes, bounds, count, visible, threadCount);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+
+// bounding spheres stored structure-of-arrays, one array per field
+struct SphereStream
+{
+    const float* x = nullptr;
+    const float* y = nullptr;
+    const float* z = nullptr;
+    const float* radius = nullptr;
+};
+
+// axis-aligned boxes stored structure-of-arrays as centers and half-sizes
+struct BoxStream
+{
+    const float* centerX = nullptr;
+    const float* centerY = nullptr;
+    const float* centerZ = nullptr;
+    const float* extentX = nullptr;
+    const float* extentY = nullptr;
+    const float* extentZ = nullptr;
+};
+
+// tests bounding volumes against the six planes of a view-projection matrix's frustum and
+// lists the ones that may be visible. Volumes go through 4, 8 or 16 at a time with the
+// TransformBatch level in use (SSE2, AVX2 or AVX-512), and the visible indices are compacted
+// as they are found. The test is conservative: a volume outside the frustum but not wholly
+// behind any one plane, near its corners, is kept. The AVX2 and AVX-512 kernels fuse the
+// plane distance, which may flip a volume that exactly touches a plane.
+class FrustumCuller
+{
+public:
+    // volumes per thread below which another thread costs more than it saves
+    static constexpr std::size_t MIN_PER_THREAD = 65536;
+
+    // the planes are taken from the matrix's rows (Gribb and Hartmann) and normalized, so
+    // they work in whatever space the matrix maps from: world space for a view-projection
+    explicit FrustumCuller(const glm::mat4& viewProjection);
+
+    // left, right, bottom, top, near, far: xyz the unit normal pointing into the frustum, w
+    // the distance term
+    glm::vec4 plane(int index) const;
+
+    // writes the indices of the volumes at least partly inside the frustum to visible, in
+    // increasing order, and returns how many there are; visible needs room for count. The
+    // volumes are split over up to threadCount threads (0 picks one per hardware thread),
+    // each taking at least MIN_PER_THREAD
+    std::size_t cull(const SphereStream& spheres, std::size_t count, std::uint32_t* visible, unsigned int threadCount = 1) const;
+    std::size_t cull(const BoxStream& boxes, std::size_t count, std::uint32_t* visible, unsigned int threadCount = 1) const;
+    // how many threads cull splits count volumes over when asked for threadCount
+    static unsigned int threadsUsed(std::size_t count, unsigned int threadCount);
+
+private:
+    // a, b, c, d of each plane
+    float planes[6][4];
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+
+// shadows the GL binding and fixed-function state the renderer touches and drops calls that
+// would not change anything. Code that calls GL directly behind the cache's back (loaders,
+// third-party code) must be followed by invalidate().
+class GLStateCache
+{
+public:
+    static constexpr unsigned int MAX_TEXTURE_UNITS = 32;
+
+    struct Counters
+    {
+        std::size_t issued = 0;
+        std::size_t avoided = 0;
+    };
+
+    GLStateCache() { invalidate(); }
+
+    // forget everything, so the next call for each piece of state always reaches GL
+    void invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        arrayBuffer = UNKNOWN;
+        elementBuffer = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < MAX_TEXTURE_UNITS; ++unit)
+        {
+            textureTargets[unit] = UNKNOWN;
+            textures[unit] = UNKNOWN;
+        }
+        blend = depthTest = UNKNOWN_TOGGLE;
+        blendSource = blendDestination = UNKNOWN;
+        depthFunction = UNKNOWN;
+    }
+
+    void useProgram(const unsigned int id)
+    {
+        if (skip(program == id))
+            return;
+        program = id;
+        glUseProgram(id);
+    }
+
+    void bindVertexArray(const unsigned int id)
+    {
+        if (skip(vertexArray == id))
+            return;
+        vertexArray = id;
+        // the element buffer binding is part of the vertex array object
+        elementBuffer = UNKNOWN;
+        glBindVertexArray(id);
+    }
+
+    void bindBuffer(const GLenum target, const unsigned int id)
+    {
+        unsigned int* shadow = target == GL_ARRAY_BUFFER ? &arrayBuffer : target == GL_ELEMENT_ARRAY_BUFFER ? &elementBuffer : nullptr;
+        if (shadow == nullptr)
+        {
+            // other targets are not shadowed
+            ++frame.issued;
+            glBindBuffer(target, id);
+            return;
+        }
+        if (skip(*shadow == id))
+            return;
+        *shadow = id;
+        glBindBuffer(target, id);
+    }
+
+    // binds a texture to a unit, switching the active unit only when the binding changes
+    void bindTexture(const unsigned int unit, const GLenum target, const unsigned int id)
+    {
+        if (unit >= MAX_TEXTURE_UNITS)
+        {
+            ++frame.issued;
+            activeTexture(unit);
+            glBindTexture(target, id);
+            return;
+        }
+        if (textures[unit] == id && textureTargets[unit] == target)
+        {
+            // the bind, and the glActiveTexture it would have needed when another unit is active
+            frame.avoided += activeUnit != unit ? 2 : 1;
+            return;
+        }
+        activeTexture(unit);
+        ++frame.issued;
+        textureTargets[unit] = target;
+        textures[unit] = id;
+        glBindTexture(target, id);
+    }
+
+    void setBlend(const bool enabled)
+    {
+        const int value = enabled ? 1 : 0;
+        if (skip(blend == value))
+            return;
+        blend = value;
+        enabled ? glEnable(GL_BLEND) : glDisable(GL_BLEND);
+    }
+
+    void blendFunc(const GLenum source, const GLenum destination)
+    {
+        if (skip(blendSource == source && blendDestination == destination))
+            return;
+        blendSource = source;
+        blendDestination = destination;
+        glBlendFunc(source, destination);
+    }
+
+    void setDepthTest(const bool enabled)
+    {
+        const int value = enabled ? 1 : 0;
+        if (skip(depthTest == value))
+            return;
+        depthTest = value;
+        enabled ? glEnable(GL_DEPTH_TEST) : glDisable(GL_DEPTH_TEST);
+    }
+
+    void depthFunc(const GLenum function)
+    {
+        if (skip(depthFunction == function))
+            return;
+        depthFunction = function;
+        glDepthFunc(function);
+    }
+
+    // starts a new per-frame count and returns the one that just finished
+    Counters endFrame()
+    {
+        const Counters finished = frame;
+        total.issued += frame.issued;
+        total.avoided += frame.avoided;
+        ++frames;
+        frame = Counters();
+        return finished;
+    }
+    const Counters& frameCounters() const { return frame; }
+    const Counters& totalCounters() const { return total; }
+    std::size_t frameCount() const { return frames; }
+
+private:
+    static constexpr unsigned int UNKNOWN = 0xFFFFFFFFu;
+    static constexpr int UNKNOWN_TOGGLE = -1;
+
+    unsigned int program;
+    unsigned int vertexArray;
+    unsigned int arrayBuffer;
+    unsigned int elementBuffer;
+    unsigned int activeUnit;
+    unsigned int textureTargets[MAX_TEXTURE_UNITS];
+    unsigned int textures[MAX_TEXTURE_UNITS];
+    int blend;
+    int depthTest;
+    unsigned int blendSource;
+    unsigned int blendDestination;
+    unsigned int depthFunction;
+
+    Counters frame;
+    Counters total;
+    std::size_t frames = 0;
+
+    // counts the call either way; true when the state already matches
+    bool skip(const bool redundant)
+    {
+        if (redundant)
+            ++frame.avoided;
+        else
+            ++frame.issued;
+        return redundant;
+    }
+
+    void activeTexture(const unsigned int unit)
+    {
+        if (skip(activeUnit == unit))
+            return;
+        activeUnit = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+};
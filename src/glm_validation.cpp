@@ -0,0 +1,397 @@
+#include "glm_validation.h"
+
+#include "frame_benchmark.h"
+#include "static_transform.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // glm's scalar code paths, whatever the build does with the default types
+    using PackedVec3 = glm::vec<3, float, glm::packed_highp>;
+    using PackedVec4 = glm::vec<4, float, glm::packed_highp>;
+    using PackedMat4 = glm::mat<4, 4, float, glm::packed_highp>;
+
+    // operations per benchmark round, few enough for the inputs to stay in the L1 and L2 caches
+    constexpr std::size_t BENCHMARK_COUNT = 4096;
+
+    // the error of a against b in units in the last place of scale, for results that can cancel
+    // down far below the size of the values they are made of
+    double scaled_ulp_error(const float a, const float b, float scale)
+    {
+        scale = std::max(std::fabs(scale), std::fabs(b));
+        if (scale == 0.0f)
+            return a == b ? 0.0 : INFINITY;
+        const double ulp = std::nextafter(scale, INFINITY) - scale;
+        return std::fabs(static_cast<double>(a) - b) / ulp;
+    }
+
+    // prints one line per checked operation and remembers whether any went over its bound
+    class Report
+    {
+    public:
+        void vectors(const char* name, const double bound, const std::vector<float>& simd, const std::vector<float>& scalar)
+        {
+            print(name, bound, GlmValidation::ulpError(simd.data(), scalar.data(), simd.size() / 4));
+        }
+
+        void scalars(const char* name, const double bound, const std::vector<float>& simd, const std::vector<float>& scalar,
+            const std::vector<float>& scales)
+        {
+            double error = 0.0;
+            for (std::size_t i = 0; i < simd.size(); ++i)
+                error = std::max(error, scaled_ulp_error(simd[i], scalar[i], scales[i]));
+            print(name, bound, error);
+        }
+
+        bool passed() const { return failures == 0; }
+
+    private:
+        int failures = 0;
+
+        void print(const char* name, const double bound, const double error)
+        {
+            const bool within = error <= bound;
+            std::cout << name << ": at most " << error << " ulp, bound " << bound << (within ? "" : " FAILED") << '\n';
+            if (!within)
+                ++failures;
+        }
+    };
+
+    void append(std::vector<float>& out, const float* values, const std::size_t count)
+    {
+        out.insert(out.end(), values, values + count);
+    }
+
+    // the same random inputs every run
+    struct Inputs
+    {
+        std::vector<glm::vec4> a, b;
+        // affine model matrices, and general ones kept well away from singular
+        std::vector<glm::mat4> models, matrices;
+        std::vector<glm::vec3> eyes, centers, axes;
+        std::vector<float> angles;
+
+        explicit Inputs(const std::size_t count)
+        {
+            std::mt19937 random(20240611u);
+            std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+            const auto vector = [&](const float scale) { return glm::vec4(unit(random), unit(random), unit(random), unit(random)) * scale; };
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                a.push_back(vector(100.0f));
+                // divisors between 0.5 and 100 in size, either sign
+                glm::vec4 divisor = vector(99.5f);
+                for (int c = 0; c < 4; ++c)
+                    divisor[c] += divisor[c] < 0.0f ? -0.5f : 0.5f;
+                b.push_back(divisor);
+
+                const glm::vec3 axis = glm::normalize(glm::vec3(vector(1.0f)) + glm::vec3(0.0f, 0.0f, 0.01f));
+                const float angle = unit(random) * 3.14159265f;
+                axes.push_back(axis);
+                angles.push_back(angle);
+                models.push_back(glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(vector(50.0f))), angle, axis),
+                    glm::vec3(1.5f) + glm::vec3(vector(1.0f))));
+                glm::mat4 matrix(4.0f);
+                for (int c = 0; c < 4; ++c)
+                    matrix[c] += vector(1.0f);
+                matrices.push_back(matrix);
+
+                eyes.push_back(glm::vec3(vector(100.0f)));
+                centers.push_back(eyes.back() + glm::vec3(vector(10.0f)) + glm::vec3(1.0f, 0.0f, 0.0f));
+            }
+        }
+    };
+}
+
+bool GlmValidation::simdEnabled()
+{
+    return GLM_CONFIG_SIMD == GLM_ENABLE && GLM_CONFIG_ALIGNED_GENTYPES == GLM_ENABLE && glm::detail::is_aligned<glm::defaultp>::value;
+}
+
+double GlmValidation::ulpError(const float* a, const float* b, const std::size_t vectors)
+{
+    double error = 0.0;
+    for (std::size_t i = 0; i < vectors * 4; i += 4)
+    {
+        float magnitude = 0.0f;
+        for (int c = 0; c < 4; ++c)
+            magnitude = std::max(magnitude, std::fabs(b[i + c]));
+        const double ulp = std::nextafter(magnitude, INFINITY) - magnitude;
+        for (int c = 0; c < 4; ++c)
+            error = std::max(error, std::fabs(static_cast<double>(a[i + c]) - b[i + c]) / ulp);
+    }
+    return error;
+}
+
+bool GlmValidation::check(const std::size_t count)
+{
+    if (simdEnabled())
+        std::cout << "glm SIMD enabled, checking aligned against packed types on " << count << " inputs" << '\n';
+    else
+        std::cout << "glm SIMD disabled in this build, the default types are the scalar ones" << '\n';
+    const Inputs in(count);
+    Report report;
+    std::vector<float> simd, scalar, scales;
+    const auto reset = [&]
+    {
+        simd.clear();
+        scalar.clear();
+        scales.clear();
+    };
+
+    // the arithmetic is IEEE in both, lane for lane
+    const std::function<glm::vec4(const glm::vec4&, const glm::vec4&)> operations[] = {
+        [](const glm::vec4& x, const glm::vec4& y) { return x + y; },
+        [](const glm::vec4& x, const glm::vec4& y) { return x * y; },
+        [](const glm::vec4& x, const glm::vec4& y) { return x / y; },
+    };
+    const std::function<PackedVec4(const PackedVec4&, const PackedVec4&)> packedOperations[] = {
+        [](const PackedVec4& x, const PackedVec4& y) { return x + y; },
+        [](const PackedVec4& x, const PackedVec4& y) { return x * y; },
+        [](const PackedVec4& x, const PackedVec4& y) { return x / y; },
+    };
+    const char* operationNames[] = { "vec4 +", "vec4 *", "vec4 /" };
+    for (int operation = 0; operation < 3; ++operation)
+    {
+        reset();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const glm::vec4 result = operations[operation](in.a[i], in.b[i]);
+            const PackedVec4 packed = packedOperations[operation](PackedVec4(in.a[i]), PackedVec4(in.b[i]));
+            append(simd, &result[0], 4);
+            append(scalar, &packed[0], 4);
+        }
+        report.vectors(operationNames[operation], 0.0, simd, scalar);
+    }
+
+    // dot products add in a different order, so they are measured against the sum of the
+    // products' sizes rather than a result that may have cancelled to nothing
+    reset();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        simd.push_back(glm::dot(in.a[i], in.b[i]));
+        scalar.push_back(glm::dot(PackedVec4(in.a[i]), PackedVec4(in.b[i])));
+        scales.push_back(glm::dot(glm::abs(in.a[i]), glm::abs(in.b[i])));
+    }
+    report.scalars("dot", 4.0, simd, scalar, scales);
+    reset();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        simd.push_back(glm::length(in.a[i]));
+        scalar.push_back(glm::length(PackedVec4(in.a[i])));
+        scales.push_back(scalar.back());
+    }
+    report.scalars("length", 2.0, simd, scalar, scales);
+    // the SSE normalize multiplies by _mm_rsqrt_ps, whose relative error Intel bounds by
+    // 1.5 * 2^-12: 6144 ulp of a largest component between 0.5 and 1
+    reset();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::vec4 result = glm::normalize(in.a[i]);
+        const PackedVec4 packed = glm::normalize(PackedVec4(in.a[i]));
+        append(simd, &result[0], 4);
+        append(scalar, &packed[0], 4);
+    }
+    report.vectors("normalize", 6144.0, simd, scalar);
+
+    reset();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::vec4 result = in.models[i] * in.a[i];
+        const PackedVec4 packed = PackedMat4(in.models[i]) * PackedVec4(in.a[i]);
+        append(simd, &result[0], 4);
+        append(scalar, &packed[0], 4);
+    }
+    report.vectors("mat4 * vec4", 2.0, simd, scalar);
+    reset();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::mat4 result = in.matrices[i] * in.models[i];
+        const PackedMat4 packed = PackedMat4(in.matrices[i]) * PackedMat4(in.models[i]);
+        append(simd, &result[0][0], 16);
+        append(scalar, &packed[0][0], 16);
+    }
+    report.vectors("mat4 * mat4", 2.0, simd, scalar);
+    reset();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::mat4 result = glm::transpose(in.matrices[i]);
+        const PackedMat4 packed = glm::transpose(PackedMat4(in.matrices[i]));
+        append(simd, &result[0][0], 16);
+        append(scalar, &packed[0][0], 16);
+    }
+    report.vectors("transpose", 0.0, simd, scalar);
+    // a determinant is at most the product of its column lengths (Hadamard), which is the
+    // size of what it may cancel from
+    reset();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::mat4& m = in.matrices[i];
+        simd.push_back(glm::determinant(m));
+        scalar.push_back(glm::determinant(PackedMat4(m)));
+        scales.push_back(glm::length(m[0]) * glm::length(m[1]) * glm::length(m[2]) * glm::length(m[3]));
+    }
+    report.scalars("determinant", 16.0, simd, scalar, scales);
+    for (int set = 0; set < 2; ++set)
+    {
+        const std::vector<glm::mat4>& matrices = set == 0 ? in.models : in.matrices;
+        reset();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const glm::mat4 result = glm::inverse(matrices[i]);
+            const PackedMat4 packed = glm::inverse(PackedMat4(matrices[i]));
+            append(simd, &result[0][0], 16);
+            append(scalar, &packed[0][0], 16);
+        }
+        report.vectors(set == 0 ? "inverse, affine" : "inverse, general", 64.0, simd, scalar);
+    }
+
+    reset();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::mat4 result = glm::rotate(in.models[i], in.angles[i], in.axes[i]);
+        const PackedMat4 packed = glm::rotate(PackedMat4(in.models[i]), in.angles[i], PackedVec3(in.axes[i]));
+        append(simd, &result[0][0], 16);
+        append(scalar, &packed[0][0], 16);
+    }
+    report.vectors("rotate", 2.0, simd, scalar);
+    reset();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const glm::mat4 result = glm::lookAt(in.eyes[i], in.centers[i], glm::vec3(0.0f, 1.0f, 0.0f));
+        const PackedMat4 packed = glm::lookAt(PackedVec3(in.eyes[i]), PackedVec3(in.centers[i]), PackedVec3(0.0f, 1.0f, 0.0f));
+        append(simd, &result[0][0], 16);
+        append(scalar, &packed[0][0], 16);
+    }
+    report.vectors("lookAt", 2.0, simd, scalar);
+    reset();
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const float fovy = glm::radians(30.0f + 60.0f * (in.angles[i] / 3.14159265f + 1.0f));
+        const float aspect = 1.0f + std::fabs(in.a[i].x) / 50.0f;
+        const float zNear = 0.01f + std::fabs(in.a[i].y) / 100.0f;
+        const float zFar = zNear + 1.0f + std::fabs(in.a[i].z) * 10.0f;
+        const glm::mat4 result = glm::perspective(fovy, aspect, zNear, zFar);
+        const glm::mat4 reference(glm::perspective<double>(fovy, aspect, zNear, zFar));
+        append(simd, &result[0][0], 16);
+        append(scalar, &reference[0][0], 16);
+    }
+    report.vectors("perspective, against double", 4.0, simd, scalar);
+
+    // the constexpr builders follow glm's formulas, but take their sines and cosines from
+    // double-precision series, so rotate and perspective are held against double precision
+    const auto bakedMatrix = [](const StaticMat4& m) { return m.toMat4(); };
+    const std::function<glm::mat4(std::size_t)> builders[] = {
+        [&](const std::size_t i) { return bakedMatrix(StaticTransform::translate(StaticTransform::identity(), in.a[i].x, in.a[i].y, in.a[i].z)); },
+        [&](const std::size_t i) { return bakedMatrix(StaticTransform::scale(StaticTransform::identity(), in.b[i].x, in.b[i].y, in.b[i].z)); },
+        [&](const std::size_t i) { return bakedMatrix(StaticTransform::rotate(StaticTransform::identity(), in.angles[i], in.axes[i].x, in.axes[i].y, in.axes[i].z)); },
+        [&](const std::size_t i) { return bakedMatrix(StaticTransform::ortho(-in.b[i].x, in.b[i].x + 200.0f, -in.b[i].y, in.b[i].y + 200.0f, 0.1f, 100.0f + in.b[i].z)); },
+        [&](const std::size_t i) { return bakedMatrix(StaticTransform::perspective(0.5f + std::fabs(in.angles[i]), 1.0f + std::fabs(in.a[i].x) / 50.0f, 0.1f, 1000.0f)); },
+    };
+    const std::function<glm::mat4(std::size_t)> references[] = {
+        [&](const std::size_t i) { return glm::translate(glm::mat4(1.0f), glm::vec3(in.a[i])); },
+        [&](const std::size_t i) { return glm::scale(glm::mat4(1.0f), glm::vec3(in.b[i])); },
+        [&](const std::size_t i) { return glm::mat4(glm::rotate(glm::dmat4(1.0), static_cast<double>(in.angles[i]), glm::dvec3(in.axes[i]))); },
+        [&](const std::size_t i) { return glm::ortho(-in.b[i].x, in.b[i].x + 200.0f, -in.b[i].y, in.b[i].y + 200.0f, 0.1f, 100.0f + in.b[i].z); },
+        [&](const std::size_t i) { return glm::mat4(glm::perspective<double>(0.5f + std::fabs(in.angles[i]), 1.0f + std::fabs(in.a[i].x) / 50.0f, 0.1f, 1000.0f)); },
+    };
+    const char* builderNames[] = { "constexpr translate", "constexpr scale", "constexpr rotate, against double", "constexpr ortho",
+        "constexpr perspective, against double" };
+    const double builderBounds[] = { 0.0, 0.0, 8.0, 0.0, 4.0 };
+    for (int builder = 0; builder < 5; ++builder)
+    {
+        reset();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const glm::mat4 result = builders[builder](i);
+            const glm::mat4 reference = references[builder](i);
+            append(simd, &result[0][0], 16);
+            append(scalar, &reference[0][0], 16);
+        }
+        report.vectors(builderNames[builder], builderBounds[builder], simd, scalar);
+    }
+
+    std::cout << (report.passed() ? "glm check passed" : "glm check FAILED") << '\n';
+    return report.passed();
+}
+
+void GlmValidation::benchmark(const unsigned long rounds, const std::string& jsonPath)
+{
+    std::cout << "glm SIMD " << (simdEnabled() ? "enabled" : "disabled") << ", " << BENCHMARK_COUNT << " operations per round" << '\n';
+    const Inputs in(BENCHMARK_COUNT);
+    std::vector<PackedMat4> packedModels(in.models.begin(), in.models.end());
+    std::vector<PackedMat4> packedMatrices(in.matrices.begin(), in.matrices.end());
+    std::vector<PackedVec3> packedEyes(in.eyes.begin(), in.eyes.end());
+    std::vector<PackedVec3> packedCenters(in.centers.begin(), in.centers.end());
+    std::vector<PackedVec3> packedAxes(in.axes.begin(), in.axes.end());
+    std::vector<glm::mat4> results(BENCHMARK_COUNT);
+    std::vector<PackedMat4> packedResults(BENCHMARK_COUNT);
+
+    BenchmarkJson json(jsonPath);
+    // times each operation on the default types, then on the packed ones unless packed is empty
+    const auto measure = [&](const std::string& name, const std::function<void()>& aligned, const std::function<void()>& packed)
+    {
+        std::cout << name << ":";
+        for (int variant = 0; variant < (packed ? 2 : 1); ++variant)
+        {
+            const double nanoseconds = FrameTimeSummary::measure(rounds, variant == 0 ? aligned : packed).p50 * 1.0e6
+                / static_cast<double>(BENCHMARK_COUNT);
+            const char* types = variant == 0 ? (simdEnabled() ? "aligned" : "default") : "packed";
+            std::cout << (variant == 0 ? " " : ", ") << nanoseconds << " ns " << types;
+            if (json.enabled())
+                json.add() << "\"operation\": \"" << name << "\", \"types\": \"" << types << "\", \"ns_per_op\": " << nanoseconds << " }";
+        }
+        std::cout << (packed ? "" : " (no packed variant)") << '\n';
+    };
+
+    measure("mat4 inverse", [&]
+    {
+        for (std::size_t i = 0; i < BENCHMARK_COUNT; ++i)
+            results[i] = glm::inverse(in.matrices[i]);
+    }, [&]
+    {
+        for (std::size_t i = 0; i < BENCHMARK_COUNT; ++i)
+            packedResults[i] = glm::inverse(packedMatrices[i]);
+    });
+    measure("mat4 * mat4", [&]
+    {
+        for (std::size_t i = 0; i < BENCHMARK_COUNT; ++i)
+            results[i] = in.matrices[i] * in.models[i];
+    }, [&]
+    {
+        for (std::size_t i = 0; i < BENCHMARK_COUNT; ++i)
+            packedResults[i] = packedMatrices[i] * packedModels[i];
+    });
+    measure("rotate", [&]
+    {
+        for (std::size_t i = 0; i < BENCHMARK_COUNT; ++i)
+            results[i] = glm::rotate(in.models[i], in.angles[i], in.axes[i]);
+    }, [&]
+    {
+        for (std::size_t i = 0; i < BENCHMARK_COUNT; ++i)
+            packedResults[i] = glm::rotate(packedModels[i], in.angles[i], packedAxes[i]);
+    });
+    measure("lookAt", [&]
+    {
+        for (std::size_t i = 0; i < BENCHMARK_COUNT; ++i)
+            results[i] = glm::lookAt(in.eyes[i], in.centers[i], glm::vec3(0.0f, 1.0f, 0.0f));
+    }, [&]
+    {
+        for (std::size_t i = 0; i < BENCHMARK_COUNT; ++i)
+            packedResults[i] = glm::lookAt(packedEyes[i], packedCenters[i], PackedVec3(0.0f, 1.0f, 0.0f));
+    });
+    // glm::perspective only returns the default type, so there is no packed run to compare with
+    measure("perspective", [&]
+    {
+        for (std::size_t i = 0; i < BENCHMARK_COUNT; ++i)
+            results[i] = glm::perspective(1.0f + in.angles[i] * 0.1f, 4.0f / 3.0f, 0.1f, 100.0f);
+    }, nullptr);
+}
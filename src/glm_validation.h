@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+// checks and times the glm build configuration. The x64 builds define GLM_FORCE_INTRINSICS and
+// GLM_FORCE_DEFAULT_ALIGNED_GENTYPES, which makes glm::vec4 and glm::mat4 16-byte aligned and
+// sends their arithmetic, inverse and determinant through glm's SSE code; the Win32 builds stay
+// scalar, as their heap only guarantees 8-byte alignment before C++17 and a std::vector of aligned
+// types would fault. glm keeps the packed qualifiers scalar in either case, so every SIMD result
+// can be held against the scalar one computed from the same inputs.
+class GlmValidation
+{
+public:
+    // whether glm was built with intrinsics and aligned default types
+    static bool simdEnabled();
+
+    // the largest error of the vec4s at a against those at b, in units in the last place of each b
+    // vector's largest component, so components that cancel down to almost nothing are not judged
+    // by their own tiny ulp
+    static double ulpError(const float* a, const float* b, std::size_t vectors);
+
+    // runs every operation on count random inputs through the default (aligned) and the packed
+    // types, prints the largest difference per operation against its bound and returns whether
+    // all of them stayed within it. perspective has no packed form and is checked against a
+    // double-precision reference instead
+    static bool check(std::size_t count);
+
+    // times mat4 inverse, multiply, rotate, lookAt and perspective on the default and the packed
+    // types and prints the time per operation, and writes it to jsonPath unless that is empty
+    static void benchmark(unsigned long rounds, const std::string& jsonPath);
+};
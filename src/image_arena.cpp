@@ -0,0 +1,202 @@
+#include "image_arena.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    // each allocation is preceded by its size, which keeps payloads 16-byte aligned like
+    // malloc's and lets reallocate and keep work without being told the old size
+    constexpr std::size_t HEADER_SIZE = 16;
+    constexpr std::size_t MIN_BLOCK_SIZE = std::size_t(1) << 20;
+    // a region that grew past this goes back to the heap when its scope ends
+    constexpr std::size_t MAX_RETAINED_SIZE = std::size_t(64) << 20;
+    // pixel buffers and the zlib output of real textures are this big or bigger. They stay on
+    // the heap, where the final image has to end up anyway and where the allocator already
+    // recycles big blocks; copying them in and out of the arena would cost more than it saves
+    constexpr std::size_t LARGE_ALLOCATION = std::size_t(256) << 10;
+
+    std::size_t round_up(const std::size_t size)
+    {
+        return (size + HEADER_SIZE - 1) & ~(HEADER_SIZE - 1);
+    }
+
+    std::size_t size_of(const void* pointer)
+    {
+        std::size_t size;
+        std::memcpy(&size, static_cast<const unsigned char*>(pointer) - HEADER_SIZE, sizeof(size));
+        return size;
+    }
+
+    class ThreadArena
+    {
+    public:
+        int depth = 0;
+
+        ThreadArena() = default;
+        ThreadArena(const ThreadArena&) = delete;
+        ThreadArena& operator=(const ThreadArena&) = delete;
+        ~ThreadArena()
+        {
+            for (const Block& block : blocks)
+                std::free(block.data);
+        }
+
+        bool owns(const void* pointer) const
+        {
+            const auto* bytes = static_cast<const unsigned char*>(pointer);
+            for (const Block& block : blocks)
+            {
+                if (bytes >= block.data && bytes < block.data + block.capacity)
+                    return true;
+            }
+            return false;
+        }
+
+        void* allocate(const std::size_t size)
+        {
+            if (size >= LARGE_ALLOCATION)
+                return std::malloc(size);
+            const std::size_t needed = HEADER_SIZE + round_up(size);
+            if (blocks.empty() || top + needed > blocks.back().capacity)
+            {
+                // earlier blocks stay where they are, their allocations may still be in use
+                const std::size_t capacity = std::max(blocks.empty() ? MIN_BLOCK_SIZE : blocks.back().capacity * 2, needed);
+                auto* data = static_cast<unsigned char*>(std::malloc(capacity));
+                if (data == nullptr)
+                    return nullptr;
+                blocks.push_back({ data, capacity });
+                top = 0;
+            }
+            unsigned char* header = blocks.back().data + top;
+            std::memcpy(header, &size, sizeof(size));
+            top += needed;
+            last = header + HEADER_SIZE;
+            return last;
+        }
+
+        void* reallocate(void* pointer, const std::size_t size)
+        {
+            // the most recent allocation grows or shrinks in place while the block has room,
+            // which is how the zlib output buffer usually grows
+            if (pointer == last && size < LARGE_ALLOCATION)
+            {
+                const std::size_t start = static_cast<unsigned char*>(pointer) - blocks.back().data;
+                if (start + round_up(size) <= blocks.back().capacity)
+                {
+                    std::memcpy(static_cast<unsigned char*>(pointer) - HEADER_SIZE, &size, sizeof(size));
+                    top = start + round_up(size);
+                    return pointer;
+                }
+            }
+            // anything else moves, possibly out to the heap
+            const std::size_t oldSize = size_of(pointer);
+            void* moved = allocate(size);
+            if (moved != nullptr)
+                std::memcpy(moved, pointer, std::min(oldSize, size));
+            return moved;
+        }
+
+        void release(void* pointer)
+        {
+            // only the most recent allocation can be handed back before the reset
+            if (pointer == last)
+            {
+                top = static_cast<unsigned char*>(pointer) - HEADER_SIZE - blocks.back().data;
+                last = nullptr;
+            }
+        }
+
+        // everything allocated since the outermost scope began is dead
+        void reset()
+        {
+            if (blocks.size() > 1)
+            {
+                // merge into one block, so the next image of this size fits without growing
+                std::size_t total = 0;
+                for (const Block& block : blocks)
+                {
+                    total += block.capacity;
+                    std::free(block.data);
+                }
+                blocks.clear();
+                if (total <= MAX_RETAINED_SIZE)
+                {
+                    auto* data = static_cast<unsigned char*>(std::malloc(total));
+                    if (data != nullptr)
+                        blocks.push_back({ data, total });
+                }
+            }
+            else if (!blocks.empty() && blocks.back().capacity > MAX_RETAINED_SIZE)
+            {
+                std::free(blocks.back().data);
+                blocks.clear();
+            }
+            top = 0;
+            last = nullptr;
+        }
+
+    private:
+        struct Block
+        {
+            unsigned char* data;
+            std::size_t capacity;
+        };
+
+        std::vector<Block> blocks;  // allocations are bumped out of the last one
+        std::size_t top = 0;
+        void* last = nullptr;
+    };
+
+    thread_local ThreadArena thread_arena;
+}
+
+ImageArena::Scope::Scope(const bool enabled)
+    : enabled(enabled)
+{
+    if (enabled)
+        ++thread_arena.depth;
+}
+
+ImageArena::Scope::~Scope()
+{
+    if (enabled && --thread_arena.depth == 0)
+        thread_arena.reset();
+}
+
+void* ImageArena::Scope::keep(void* pixels) const
+{
+    if (pixels == nullptr || !thread_arena.owns(pixels))
+        return pixels;
+    const std::size_t size = size_of(pixels);
+    void* kept = std::malloc(size);
+    if (kept != nullptr)
+        std::memcpy(kept, pixels, size);
+    return kept;
+}
+
+void* ImageArena::allocate(const std::size_t size)
+{
+    return thread_arena.depth > 0 ? thread_arena.allocate(size) : std::malloc(size);
+}
+
+void* ImageArena::reallocate(void* pointer, const std::size_t size)
+{
+    if (pointer == nullptr)
+        return allocate(size);
+    if (thread_arena.owns(pointer))
+        return thread_arena.reallocate(pointer, size);
+    return std::realloc(pointer, size);
+}
+
+void ImageArena::release(void* pointer)
+{
+    if (pointer == nullptr)
+        return;
+    if (thread_arena.owns(pointer))
+        thread_arena.release(pointer);
+    else
+        std::free(pointer);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+
+
+// per-thread bump allocator behind stb_image's STBI_MALLOC/STBI_REALLOC/STBI_FREE (see
+// stb_image/stb_image.cpp). While a Scope is alive on a thread, the decoder's small and
+// medium allocations (huffman and component state, line buffers, the first zlib buffer) are
+// carved out of one retained region and their frees are no-ops; the region is rewound when the
+// scope ends. Allocations of 256 KB and up, which includes the pixels of any real texture, stay
+// on the heap. Outside a scope the hooks fall through to malloc/realloc/free.
+class ImageArena
+{
+public:
+    class Scope
+    {
+    public:
+        // a disabled scope leaves allocations on the heap
+        explicit Scope(bool enabled = true);
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope();
+
+        // moves a decoded image out of the arena into its own heap block, so that it outlives
+        // the scope and can still be released with stbi_image_free; heap pointers and null
+        // are returned unchanged
+        void* keep(void* pixels) const;
+
+    private:
+        bool enabled;
+    };
+
+    // the stb_image hooks
+    static void* allocate(std::size_t size);
+    static void* reallocate(void* pointer, std::size_t size);
+    static void release(void* pointer);
+};
@@ -0,0 +1,1312 @@
+#include "image_validation.h"
+
+#include "frame_benchmark.h"
+#include "mipmap_generator.h"
+#include "stb_image/stb_image.h"
+#include "texture_compressor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // random blocks encoded for the IDCT check
+    constexpr std::size_t IDCT_BLOCK_COUNT = 250000;
+    // widest row the chroma upsampler is checked at, and how many random rows per width
+    constexpr int HV2_MAX_WIDTH = 512;
+    constexpr int HV2_ROWS_PER_WIDTH = 16;
+    // bytes written around every output to catch a kernel that writes outside it
+    constexpr std::size_t GUARD = 64;
+    constexpr unsigned char GUARD_BYTE = 0xcd;
+    // how far a JPEG preview may be from the block means of the full decode, on average per
+    // channel; the DC coefficient is the block mean before color conversion and chroma upsampling
+    constexpr double JPEG_PREVIEW_ERROR = 4.0;
+    // stb_image's STBI__JPEG_PARALLEL_MIN_PIXELS: smaller JPEGs are decoded on one thread
+    // whatever stbi_set_jpeg_thread_count says
+    constexpr int JPEG_PARALLEL_MIN_PIXELS = 256 * 256;
+    // how far BC1 and BC3 blocks may be from the pixels they were encoded from, as the worst
+    // RMSE of one channel over a whole mip chain, for smooth gradients and for random noise
+    constexpr double BLOCK_GRADIENT_ERROR = 2.5;
+    constexpr double BLOCK_NOISE_ERROR = 60.0;
+
+    const char* level_name(const int level)
+    {
+        return level == STBI_simd_scalar ? "scalar" : level == STBI_simd_sse2 ? "SSE2" : "AVX2";
+    }
+
+    // the kernels of every level this CPU supports, scalar first
+    std::vector<stbi_jpeg_kernels> jpeg_kernels()
+    {
+        std::vector<stbi_jpeg_kernels> levels;
+        for (int level = STBI_simd_scalar; level <= STBI_simd_avx2; ++level)
+        {
+            stbi_set_simd_level(level);
+            if (stbi_simd_level() != level)
+                break;
+            stbi_jpeg_kernels kernels;
+            stbi_get_jpeg_kernels(&kernels);
+            levels.push_back(kernels);
+        }
+        stbi_set_simd_level(STBI_simd_avx2);
+        return levels;
+    }
+
+    // dequantized coefficients of an 8x8 block of random pixels, the way a JPEG encoder would
+    // produce them: a forward DCT rounded to a random quantizer step
+    void encode_block(std::mt19937& random, short coefficients[64])
+    {
+        static const std::vector<float> basis = []
+        {
+            std::vector<float> table(64);
+            for (int u = 0; u < 8; ++u)
+            {
+                for (int x = 0; x < 8; ++x)
+                    table[u * 8 + x] = static_cast<float>((u == 0 ? std::sqrt(0.125) : 0.5) * std::cos((2 * x + 1) * u * 3.14159265358979 / 16.0));
+            }
+            return table;
+        }();
+        // noise on a gradient, from flat to full-range noise
+        const float base = static_cast<float>(random() % 256);
+        const float slopeX = static_cast<float>(static_cast<int>(random() % 65) - 32);
+        const float slopeY = static_cast<float>(static_cast<int>(random() % 65) - 32);
+        const int noise = 1 + static_cast<int>(random() % 256);
+        float pixels[64], rows[64];
+        for (int y = 0; y < 8; ++y)
+        {
+            for (int x = 0; x < 8; ++x)
+            {
+                const float value = base + slopeX * (x - 3.5f) + slopeY * (y - 3.5f) + static_cast<float>(static_cast<int>(random() % noise) - noise / 2);
+                pixels[y * 8 + x] = std::min(255.0f, std::max(0.0f, value)) - 128.0f;
+            }
+        }
+        for (int y = 0; y < 8; ++y)
+        {
+            for (int u = 0; u < 8; ++u)
+            {
+                float sum = 0.0f;
+                for (int x = 0; x < 8; ++x)
+                    sum += basis[u * 8 + x] * pixels[y * 8 + x];
+                rows[y * 8 + u] = sum;
+            }
+        }
+        const int step = 1 + static_cast<int>(random() % (random() % 4 == 0 ? 64 : 8));
+        for (int v = 0; v < 8; ++v)
+        {
+            for (int u = 0; u < 8; ++u)
+            {
+                float sum = 0.0f;
+                for (int y = 0; y < 8; ++y)
+                    sum += basis[v * 8 + y] * rows[y * 8 + u];
+                coefficients[v * 8 + u] = static_cast<short>(std::lround(sum / static_cast<float>(step)) * step);
+            }
+        }
+    }
+
+    // runs a kernel twice on the same input, once as the reference and once as the kernel under
+    // test, into buffers with guard bytes around them, and compares the first size bytes and
+    // the guards
+    class OutputPair
+    {
+    public:
+        explicit OutputPair(const std::size_t size) : size(size), reference(size + 2 * GUARD), tested(size + 2 * GUARD) {}
+
+        unsigned char* referenceData() { return reference.data() + GUARD; }
+        unsigned char* testedData() { return tested.data() + GUARD; }
+
+        void reset()
+        {
+            std::fill(reference.begin(), reference.end(), GUARD_BYTE);
+            std::fill(tested.begin(), tested.end(), GUARD_BYTE);
+        }
+
+        // the kernels may write scratch bytes just past their output, as the scalar colour
+        // converter does with 3 bytes per pixel; slack of them are not compared
+        bool same(const std::size_t compared, const std::size_t slack = 0) const
+        {
+            return std::equal(reference.begin() + GUARD, reference.begin() + GUARD + compared, tested.begin() + GUARD)
+                && std::all_of(tested.begin(), tested.begin() + GUARD, [](const unsigned char c) { return c == GUARD_BYTE; })
+                && std::all_of(tested.begin() + GUARD + compared + slack, tested.end(), [](const unsigned char c) { return c == GUARD_BYTE; });
+        }
+
+    private:
+        std::size_t size;
+        std::vector<unsigned char> reference;
+        std::vector<unsigned char> tested;
+    };
+
+    std::vector<unsigned char> read_file(const std::string& path)
+    {
+        std::ifstream stream(path, std::ios::binary);
+        return std::vector<unsigned char>((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    }
+
+    std::uint32_t big_endian(const unsigned char* bytes)
+    {
+        return static_cast<std::uint32_t>(bytes[0]) << 24 | static_cast<std::uint32_t>(bytes[1]) << 16 | static_cast<std::uint32_t>(bytes[2]) << 8 | bytes[3];
+    }
+
+    // the MCUs between restart markers a JPEG's DRI segment asks for, 0 without one
+    int jpeg_restart_interval(const std::vector<unsigned char>& jpeg)
+    {
+        std::size_t at = 2;
+        while (at + 4 <= jpeg.size() && jpeg[at] == 0xff && jpeg[at + 1] != 0xda)
+        {
+            const std::size_t length = static_cast<std::size_t>(jpeg[at + 2]) << 8 | jpeg[at + 3];
+            if (jpeg[at + 1] == 0xdd && at + 6 <= jpeg.size())
+                return jpeg[at + 4] << 8 | jpeg[at + 5];
+            at += 2 + length;
+        }
+        return 0;
+    }
+
+    // the zlib stream of a PNG, its IDAT chunks joined, and how long it inflates to
+    struct ZlibStream
+    {
+        std::vector<unsigned char> data;
+        // Apple's CgBI PNGs leave out the zlib header
+        bool header = true;
+        int inflatedLength = 0;
+    };
+
+    // inflates stream into out, which must hold inflatedLength bytes, with the fast inflate loop
+    // on or off; returns the length or -1
+    int inflate(const ZlibStream& stream, unsigned char* out, const bool fast)
+    {
+        stbi_set_fast_inflate(fast ? 1 : 0);
+        const char* in = reinterpret_cast<const char*>(stream.data.data());
+        const int length = static_cast<int>(stream.data.size());
+        const int result = stream.header ? stbi_zlib_decode_buffer(reinterpret_cast<char*>(out), stream.inflatedLength, in, length)
+            : stbi_zlib_decode_noheader_buffer(reinterpret_cast<char*>(out), stream.inflatedLength, in, length);
+        stbi_set_fast_inflate(1);
+        return result;
+    }
+
+    // false for anything that isn't a PNG or doesn't inflate with the original loop
+    bool png_zlib_stream(const std::vector<unsigned char>& file, ZlibStream& stream)
+    {
+        static const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        if (file.size() < 8 || std::memcmp(file.data(), signature, 8) != 0)
+            return false;
+        for (std::size_t at = 8; at + 12 <= file.size();)
+        {
+            const std::size_t length = big_endian(&file[at]);
+            if (length > file.size() - at - 12)
+                return false;
+            const unsigned char* type = &file[at + 4];
+            if (std::memcmp(type, "CgBI", 4) == 0)
+                stream.header = false;
+            else if (std::memcmp(type, "IDAT", 4) == 0)
+                stream.data.insert(stream.data.end(), type + 4, type + 4 + length);
+            else if (std::memcmp(type, "IEND", 4) == 0)
+                break;
+            at += 12 + length;
+        }
+        if (stream.data.empty())
+            return false;
+        stbi_set_fast_inflate(0);
+        const char* in = reinterpret_cast<const char*>(stream.data.data());
+        char* inflated = stbi_zlib_decode_malloc_guesssize_headerflag(in, static_cast<int>(stream.data.size()), 16384, &stream.inflatedLength, stream.header ? 1 : 0);
+        stbi_set_fast_inflate(1);
+        stbi_image_free(inflated);
+        return inflated != nullptr;
+    }
+
+    enum PngFilter { FILTER_NONE, FILTER_SUB, FILTER_UP, FILTER_AVERAGE, FILTER_PAETH };
+    const char* const FILTER_NAMES[] = { "none", "sub", "up", "average", "Paeth" };
+
+    void put_big_endian(std::vector<unsigned char>& out, const std::uint32_t value)
+    {
+        const unsigned char bytes[4] = { static_cast<unsigned char>(value >> 24), static_cast<unsigned char>(value >> 16),
+            static_cast<unsigned char>(value >> 8), static_cast<unsigned char>(value) };
+        out.insert(out.end(), bytes, bytes + 4);
+    }
+
+    std::uint32_t crc32(const unsigned char* data, const std::size_t length)
+    {
+        static const std::vector<std::uint32_t> table = []
+        {
+            std::vector<std::uint32_t> entries(256);
+            for (std::uint32_t n = 0; n < 256; ++n)
+            {
+                std::uint32_t c = n;
+                for (int bit = 0; bit < 8; ++bit)
+                    c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                entries[n] = c;
+            }
+            return entries;
+        }();
+        std::uint32_t c = 0xffffffffu;
+        for (std::size_t i = 0; i < length; ++i)
+            c = table[(c ^ data[i]) & 0xff] ^ (c >> 8);
+        return c ^ 0xffffffffu;
+    }
+
+    // appends the rows of a width x height image of channels bytes per pixel to out, each behind
+    // its filter type byte; the nth row appended is filtered with filters[n % filters.size()]
+    void filter_rows(const unsigned char* pixels, const int width, const int height, const int channels, const std::vector<int>& filters,
+        std::size_t& rowsFiltered, std::vector<unsigned char>& out)
+    {
+        const std::size_t stride = static_cast<std::size_t>(width) * channels;
+        for (int y = 0; y < height; ++y, ++rowsFiltered)
+        {
+            const unsigned char* row = &pixels[y * stride];
+            const unsigned char* prior = y == 0 ? nullptr : row - stride;
+            const int filter = filters[rowsFiltered % filters.size()];
+            out.push_back(static_cast<unsigned char>(filter));
+            for (std::size_t k = 0; k < stride; ++k)
+            {
+                const int a = k < static_cast<std::size_t>(channels) ? 0 : row[k - channels];
+                const int b = prior ? prior[k] : 0;
+                const int c = prior && k >= static_cast<std::size_t>(channels) ? prior[k - channels] : 0;
+                int predicted = 0;
+                switch (filter)
+                {
+                case FILTER_SUB: predicted = a; break;
+                case FILTER_UP: predicted = b; break;
+                case FILTER_AVERAGE: predicted = (a + b) >> 1; break;
+                case FILTER_PAETH:
+                {
+                    const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                    predicted = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+                    break;
+                }
+                default: break;
+                }
+                out.push_back(static_cast<unsigned char>(row[k] - predicted));
+            }
+        }
+    }
+
+    // stored blocks of at most 65535 bytes
+    void deflate_stored(const std::vector<unsigned char>& data, std::vector<unsigned char>& out)
+    {
+        out.reserve(out.size() + data.size() + data.size() / 65535 * 5 + 16);
+        for (std::size_t at = 0; at == 0 || at < data.size();)
+        {
+            const std::size_t length = std::min<std::size_t>(65535, data.size() - at);
+            out.push_back(at + length == data.size() ? 1 : 0);
+            const unsigned char lengths[4] = { static_cast<unsigned char>(length), static_cast<unsigned char>(length >> 8),
+                static_cast<unsigned char>(~length), static_cast<unsigned char>(~length >> 8) };
+            out.insert(out.end(), lengths, lengths + 4);
+            out.insert(out.end(), data.begin() + at, data.begin() + at + length);
+            at += length;
+            if (length == 0)
+                break;
+        }
+    }
+
+    // one block with the fixed Huffman codes: literals, and runs of the previous byte as
+    // matches at distance 1, so the decoder's length codes and match copies get used too
+    void deflate_fixed(const std::vector<unsigned char>& data, std::vector<unsigned char>& out)
+    {
+        static const int LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const int LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        std::uint32_t bits = 0;
+        int count = 0;
+        // values go in least significant bit first, Huffman codes most significant bit first
+        const auto put = [&](const std::uint32_t value, const int length)
+        {
+            bits |= value << count;
+            count += length;
+            for (; count >= 8; count -= 8, bits >>= 8)
+                out.push_back(static_cast<unsigned char>(bits));
+        };
+        const auto put_code = [&](const std::uint32_t code, const int length)
+        {
+            std::uint32_t reversed = 0;
+            for (int bit = 0; bit < length; ++bit)
+                reversed |= (code >> bit & 1) << (length - 1 - bit);
+            put(reversed, length);
+        };
+        const auto put_symbol = [&](const int symbol)
+        {
+            if (symbol < 144)
+                put_code(0x30 + symbol, 8);
+            else if (symbol < 256)
+                put_code(0x190 + symbol - 144, 9);
+            else if (symbol < 280)
+                put_code(symbol - 256, 7);
+            else
+                put_code(0xc0 + symbol - 280, 8);
+        };
+        // final block, fixed codes
+        put(1, 1);
+        put(1, 2);
+        for (std::size_t at = 0; at < data.size();)
+        {
+            std::size_t run = 0;
+            while (at > 0 && run < 258 && at + run < data.size() && data[at + run] == data[at - 1])
+                ++run;
+            if (run < 3)
+            {
+                put_symbol(data[at++]);
+                continue;
+            }
+            int code = 28;
+            while (LENGTH_BASE[code] > static_cast<int>(run))
+                --code;
+            put_symbol(257 + code);
+            put(static_cast<std::uint32_t>(run - LENGTH_BASE[code]), LENGTH_EXTRA[code]);
+            // distance 1 is distance code 0, no extra bits
+            put_code(0, 5);
+            at += run;
+        }
+        put_symbol(256);
+        if (count > 0)
+            out.push_back(static_cast<unsigned char>(bits));
+    }
+
+    enum class Deflate { Stored, Fixed };
+
+    // an 8-bit PNG of pixels, 1 to 4 channels, rows of width * channels bytes, with the nth row written
+    // filtered by filters[n % filters.size()]. Interlaced images are written in Adam7 order. The
+    // image data goes in stored deflate blocks unless told otherwise, so building it is quick and
+    // decoding it is mostly unfiltering
+    std::vector<unsigned char> encode_png(const std::vector<unsigned char>& pixels, const int width, const int height, const int channels,
+        const std::vector<int>& filters, const bool interlaced = false, const Deflate deflate = Deflate::Stored)
+    {
+        const std::size_t stride = static_cast<std::size_t>(width) * channels;
+        std::vector<unsigned char> filtered;
+        filtered.reserve((stride + 1) * height + (interlaced ? 7 * height : 0));
+        std::size_t rowsFiltered = 0;
+        if (!interlaced)
+        {
+            filter_rows(pixels.data(), width, height, channels, filters, rowsFiltered, filtered);
+        }
+        else
+        {
+            static const int PASSES[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+            for (const auto& pass : PASSES)
+            {
+                const int passWidth = width > pass[0] ? (width - pass[0] + pass[2] - 1) / pass[2] : 0;
+                const int passHeight = height > pass[1] ? (height - pass[1] + pass[3] - 1) / pass[3] : 0;
+                if (passWidth == 0 || passHeight == 0)
+                    continue;
+                std::vector<unsigned char> passPixels;
+                passPixels.reserve(static_cast<std::size_t>(passWidth) * passHeight * channels);
+                for (int y = pass[1]; y < height; y += pass[3])
+                {
+                    for (int x = pass[0]; x < width; x += pass[2])
+                        passPixels.insert(passPixels.end(), &pixels[y * stride + x * channels], &pixels[y * stride + (x + 1) * channels]);
+                }
+                filter_rows(passPixels.data(), passWidth, passHeight, channels, filters, rowsFiltered, filtered);
+            }
+        }
+
+        // zlib header, the deflate blocks, adler32
+        std::vector<unsigned char> zlib = { 0x78, 0x01 };
+        if (deflate == Deflate::Stored)
+            deflate_stored(filtered, zlib);
+        else
+            deflate_fixed(filtered, zlib);
+        std::uint32_t s1 = 1, s2 = 0;
+        for (const unsigned char byte : filtered)
+        {
+            s1 = (s1 + byte) % 65521;
+            s2 = (s2 + s1) % 65521;
+        }
+        put_big_endian(zlib, s2 << 16 | s1);
+
+    std::vector<unsigned char> png = { 137, 80, 78, 71, 13, 10, 26, 10 };
+        const auto chunk = [&png](const char* type, const std::vector<unsigned char>& data)
+        {
+            put_big_endian(png, static_cast<std::uint32_t>(data.size()));
+            const std::size_t start = png.size();
+            png.insert(png.end(), type, type + 4);
+            png.insert(png.end(), data.begin(), data.end());
+            put_big_endian(png, crc32(&png[start], png.size() - start));
+        };
+        // grey, grey and alpha, RGB, RGBA
+        static const unsigned char COLOR_TYPES[5] = { 0, 0, 4, 2, 6 };
+        std::vector<unsigned char> header;
+        put_big_endian(header, static_cast<std::uint32_t>(width));
+        put_big_endian(header, static_cast<std::uint32_t>(height));
+        header.insert(header.end(), { 8, COLOR_TYPES[channels], 0, 0, static_cast<unsigned char>(interlaced ? 1 : 0) });
+        chunk("IHDR", header);
+        chunk("IDAT", zlib);
+        chunk("IEND", {});
+        return png;
+    }
+
+    // png decoded with the kernels of level, empty when it fails
+    std::vector<unsigned char> decode_png(const std::vector<unsigned char>& png, const int level)
+    {
+        stbi_set_simd_level(level);
+        int width, height, channels;
+        unsigned char* pixels = stbi_load_from_memory(png.data(), static_cast<int>(png.size()), &width, &height, &channels, 0);
+        stbi_set_simd_level(STBI_simd_avx2);
+        if (pixels == nullptr)
+            return {};
+        std::vector<unsigned char> result(pixels, pixels + static_cast<std::size_t>(width) * height * channels);
+        stbi_image_free(pixels);
+        return result;
+    }
+
+    // bytes that differ between two decodes, all of them when one failed
+    std::size_t count_differing(const std::vector<unsigned char>& reference, const std::vector<unsigned char>& tested, const std::size_t size)
+    {
+        if (reference.size() != size || tested.size() != size)
+            return size;
+        std::size_t differing = 0;
+        for (std::size_t i = 0; i < size; ++i)
+            differing += reference[i] != tested[i] ? 1 : 0;
+        return differing;
+    }
+
+    // how far a preview of flip and channels is from the full decode of the same image, full,
+    // unflipped: the largest difference from the pixel at (8x, 8y), or with blockMean, as a
+    // JPEG preview holds the DC of each block, the mean absolute difference from the mean of
+    // the block. Infinity when the sizes don't match
+    double preview_error(const unsigned char* full, const int width, const int height, const unsigned char* preview, const int previewWidth,
+        const int previewHeight, const int channels, const bool flip, const bool blockMean)
+    {
+        if (previewWidth != (width + 7) / 8 || previewHeight != (height + 7) / 8)
+            return HUGE_VAL;
+        double largest = 0.0, total = 0.0;
+        for (int y = 0; y < previewHeight; ++y)
+        {
+            const unsigned char* row = preview + static_cast<std::size_t>(flip ? previewHeight - 1 - y : y) * previewWidth * channels;
+            for (int x = 0; x < previewWidth; ++x)
+            {
+                for (int c = 0; c < channels; ++c)
+                {
+                    double expected = full[(static_cast<std::size_t>(8 * y) * width + 8 * x) * channels + c];
+                    if (blockMean)
+                    {
+                        double sum = 0.0;
+                        int count = 0;
+                        for (int by = 8 * y; by < std::min(height, 8 * y + 8); ++by)
+                        {
+                            for (int bx = 8 * x; bx < std::min(width, 8 * x + 8); ++bx, ++count)
+                                sum += full[(static_cast<std::size_t>(by) * width + bx) * channels + c];
+                        }
+                        expected = sum / count;
+                    }
+                    const double difference = std::abs(row[x * channels + c] - expected);
+                    largest = std::max(largest, difference);
+                    total += difference;
+                }
+            }
+        }
+        return blockMean ? total / (static_cast<double>(previewWidth) * previewHeight * channels) : largest;
+    }
+
+    // the preview error of every flip and req_comp; the worst of them, infinity when a preview
+    // or the full decode fails, and -1 when the image has no preview
+    double worst_preview_error(const std::vector<unsigned char>& encoded, const bool blockMean)
+    {
+        double worst = 0.0;
+        for (int channels = 0; channels <= 4; ++channels)
+        {
+            stbi_set_flip_vertically_on_load_thread(0);
+            int width, height, fileChannels;
+            unsigned char* full = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), &width, &height, &fileChannels, channels);
+            if (full == nullptr)
+                return HUGE_VAL;
+            for (int flip = 0; flip < 2; ++flip)
+            {
+                stbi_set_flip_vertically_on_load_thread(flip);
+                int previewWidth, previewHeight, previewChannels;
+                unsigned char* preview = stbi_load_preview_from_memory(encoded.data(), static_cast<int>(encoded.size()), &previewWidth, &previewHeight,
+                    &previewChannels, channels);
+                if (preview == nullptr)
+                {
+                    stbi_image_free(full);
+                    stbi_set_flip_vertically_on_load_thread(0);
+                    return std::strcmp(stbi_failure_reason(), "no preview") == 0 ? -1.0 : HUGE_VAL;
+                }
+                worst = previewChannels != fileChannels ? HUGE_VAL : std::max(worst, preview_error(full, width, height, preview, previewWidth,
+                    previewHeight, channels != 0 ? channels : fileChannels, flip != 0, blockMean));
+                stbi_image_free(preview);
+            }
+            stbi_image_free(full);
+        }
+        stbi_set_flip_vertically_on_load_thread(0);
+        return worst;
+    }
+
+    // where stbi_load_into_from_memory writes, and what it asked for
+    struct Destination
+    {
+        // bytes between rows
+        int padding = 0;
+        int calls = 0;
+        // from the first pixel to the end of the last row
+        std::size_t size = 0;
+        std::vector<unsigned char> buffer;
+    };
+
+    // the stbi_load_into_* callback: rows padding bytes apart, guard bytes in the padding and
+    // right after the last row
+    stbi_uc* destination_rows(void* user, const int x, const int y, const int channels, int* stride)
+    {
+        Destination& destination = *static_cast<Destination*>(user);
+        ++destination.calls;
+        *stride = x * channels + destination.padding;
+        destination.size = static_cast<std::size_t>(*stride) * (y - 1) + static_cast<std::size_t>(x) * channels;
+        destination.buffer.assign(destination.size + GUARD, GUARD_BYTE);
+        return destination.buffer.data();
+    }
+
+    // whether destination holds the rows of reference and nothing but guard bytes around them
+    bool same_rows(const Destination& destination, const unsigned char* reference, const int width, const int height, const int channels)
+    {
+        const std::size_t row = static_cast<std::size_t>(width) * channels;
+        const std::size_t stride = row + destination.padding;
+        const auto guard = [](const unsigned char c) { return c == GUARD_BYTE; };
+        for (int y = 0; y < height; ++y)
+        {
+            const unsigned char* written = &destination.buffer[y * stride];
+            if (!std::equal(written, written + row, reference + y * row))
+                return false;
+            if (y + 1 < height && !std::all_of(written + row, written + stride, guard))
+                return false;
+        }
+        return std::all_of(destination.buffer.begin() + destination.size, destination.buffer.end(), guard);
+    }
+
+    // the 8-bit channels of a 5:6:5 color, with the high bits repeated in the low ones
+    void expand_565(const unsigned int color, int rgb[3])
+    {
+        const int r = static_cast<int>(color >> 11), g = static_cast<int>(color >> 5 & 63), b = static_cast<int>(color & 31);
+        rgb[0] = r << 3 | r >> 2;
+        rgb[1] = g << 2 | g >> 4;
+        rgb[2] = b << 3 | b >> 2;
+    }
+
+    // decodes the colors of one block into 16 RGBA pixels. BC1 blocks with color0 <= color1
+    // are in three-color mode, where index 2 is the mean of the endpoints and index 3
+    // transparent black; BC3's color blocks are always in four-color mode
+    void decode_color_block(const unsigned char* block, const bool threeColor, unsigned char* pixels)
+    {
+        const unsigned int color0 = block[0] | block[1] << 8, color1 = block[2] | block[3] << 8;
+        int palette[4][4];
+        expand_565(color0, palette[0]);
+        expand_565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c)
+        {
+            if (threeColor && color0 <= color1)
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c] + 1) / 2;
+                palette[3][c] = 0;
+            }
+            else
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+            }
+        }
+        palette[0][3] = palette[1][3] = palette[2][3] = 255;
+        palette[3][3] = threeColor && color0 <= color1 ? 0 : 255;
+        const std::uint32_t bits = block[4] | block[5] << 8 | block[6] << 16 | static_cast<std::uint32_t>(block[7]) << 24;
+        for (int i = 0; i < 16; ++i)
+        {
+            for (int c = 0; c < 4; ++c)
+                pixels[4 * i + c] = static_cast<unsigned char>(palette[bits >> (2 * i) & 3][c]);
+        }
+    }
+
+    // decodes the alpha of one BC3 block into the fourth byte of 16 RGBA pixels. alpha0 > alpha1
+    // splits the range in eight steps, otherwise it is six steps and codes 6 and 7 are 0 and 255
+    void decode_alpha_block(const unsigned char* block, unsigned char* pixels)
+    {
+        const int alpha0 = block[0], alpha1 = block[1];
+        int palette[8] = { alpha0, alpha1 };
+        for (int code = 2; code < 8; ++code)
+        {
+            if (alpha0 > alpha1)
+                palette[code] = ((8 - code) * alpha0 + (code - 1) * alpha1 + 3) / 7;
+            else
+                palette[code] = code == 6 ? 0 : code == 7 ? 255 : ((6 - code) * alpha0 + (code - 1) * alpha1 + 2) / 5;
+        }
+        std::uint64_t bits = 0;
+        for (int i = 0; i < 6; ++i)
+            bits |= static_cast<std::uint64_t>(block[2 + i]) << (8 * i);
+        for (int i = 0; i < 16; ++i)
+            pixels[4 * i + 3] = static_cast<unsigned char>(palette[bits >> (3 * i) & 7]);
+    }
+
+    // decodes one level of a DDS file written by TextureCompressor to RGBA
+    std::vector<unsigned char> decode_blocks(const std::vector<unsigned char>& file, const CompressedTextureInfo& info, const int level)
+    {
+        const bool alpha = info.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        const int width = info.levelWidth(level), height = info.levelHeight(level);
+        std::size_t offset = CompressedTextureInfo::HEADER_SIZE;
+        for (int i = 0; i < level; ++i)
+            offset += info.levelSize(i);
+        std::vector<unsigned char> rgba(static_cast<std::size_t>(width) * height * 4);
+        unsigned char pixels[64];
+        for (int blockY = 0; blockY < (height + 3) / 4; ++blockY)
+        {
+            for (int blockX = 0; blockX < (width + 3) / 4; ++blockX)
+            {
+                const unsigned char* block = &file[offset];
+                offset += alpha ? 16 : 8;
+                decode_color_block(alpha ? block + 8 : block, !alpha, pixels);
+                if (alpha)
+                    decode_alpha_block(block, pixels);
+                for (int i = 0; i < 16; ++i)
+                {
+                    const int x = 4 * blockX + i % 4, y = 4 * blockY + i / 4;
+                    if (x < width && y < height)
+                        std::memcpy(&rgba[(static_cast<std::size_t>(y) * width + x) * 4], &pixels[4 * i], 4);
+                }
+            }
+        }
+        return rgba;
+    }
+
+    // prints one line per kernel and level and remembers whether any differed
+    class Report
+    {
+    public:
+        void print(const std::string& what, const std::size_t differing, const std::size_t total, const char* unit, const char* reference = "scalar")
+        {
+            std::cout << what << ": " << differing << " of " << total << " " << unit
+                << " differ from " << reference << (differing == 0 ? "" : " FAILED") << '\n';
+            if (differing != 0)
+                ++failures;
+        }
+
+        void fail(const std::string& what)
+        {
+            std::cout << what << " FAILED" << '\n';
+            ++failures;
+        }
+
+        bool passed() const { return failures == 0; }
+
+    private:
+        int failures = 0;
+    };
+}
+
+bool ImageValidation::check(const std::vector<std::string>& files)
+{
+    const std::vector<stbi_jpeg_kernels> levels = jpeg_kernels();
+    std::cout << "stb_image SIMD up to " << level_name(static_cast<int>(levels.size()) - 1) << " on this CPU" << '\n';
+    if (levels.size() < 2)
+        std::cout << "no SIMD kernels to check" << '\n';
+    Report report;
+    std::mt19937 random(20240611u);
+
+    // baseline 8-bit JPEG coefficients are 11-bit (ITU T.81); outside that the 16-bit lanes
+    // of the SIMD IDCTs can overflow where the scalar one does not
+    std::vector<short> single;
+    for (int position = 0; position < 64; ++position)
+    {
+        for (int value = -2048; value < 2048; ++value)
+        {
+            short block[64] = {};
+            block[position] = static_cast<short>(value);
+            single.insert(single.end(), block, block + 64);
+        }
+    }
+    std::vector<short> encoded(IDCT_BLOCK_COUNT * 64);
+    for (std::size_t block = 0; block < IDCT_BLOCK_COUNT; ++block)
+        encode_block(random, &encoded[block * 64]);
+    for (int set = 0; set < 2; ++set)
+    {
+        const std::vector<short>& blocks = set == 0 ? single : encoded;
+        const std::size_t count = blocks.size() / 64;
+        for (std::size_t level = 1; level < levels.size(); ++level)
+        {
+            std::size_t differing = 0;
+            OutputPair out(64);
+            for (std::size_t block = 0; block < count; ++block)
+            {
+                // the kernels may work in place on their coefficients
+                alignas(16) short reference[64];
+                alignas(16) short tested[64];
+                std::memcpy(reference, &blocks[block * 64], sizeof(reference));
+                std::memcpy(tested, &blocks[block * 64], sizeof(tested));
+                out.reset();
+                levels[0].idct_block(out.referenceData(), 8, reference);
+                levels[level].idct_block(out.testedData(), 8, tested);
+                differing += out.same(64) ? 0 : 1;
+            }
+            report.print(std::string(set == 0 ? "IDCT, single coefficient, " : "IDCT, encoded blocks, ") + level_name(static_cast<int>(level)), differing, count, "blocks");
+        }
+    }
+
+    // every (y, cb, cr) triple, a row of 4096 at a time, at 3 and 4 bytes per pixel, then
+    // short rows at every offset so the kernels' tails are covered too
+    {
+        constexpr int WIDTH = 4096;
+        std::vector<unsigned char> y(WIDTH), cb(WIDTH), cr(WIDTH);
+        for (std::size_t level = 1; level < levels.size(); ++level)
+        {
+            for (int step = 3; step <= 4; ++step)
+            {
+                std::size_t differing = 0;
+                OutputPair out(WIDTH * 4 + 1);
+                for (int row = 0; row < (1 << 24) / WIDTH; ++row)
+                {
+                    for (int i = 0; i < WIDTH; ++i)
+                    {
+                        const int triple = row * WIDTH + i;
+                        y[i] = static_cast<unsigned char>(triple);
+                        cb[i] = static_cast<unsigned char>(triple >> 8);
+                        cr[i] = static_cast<unsigned char>(triple >> 16);
+                    }
+                    out.reset();
+                    levels[0].YCbCr_to_RGB(out.referenceData(), y.data(), cb.data(), cr.data(), WIDTH, step);
+                    levels[level].YCbCr_to_RGB(out.testedData(), y.data(), cb.data(), cr.data(), WIDTH, step);
+                    for (int i = 0; i < WIDTH; ++i)
+                        differing += std::memcmp(out.referenceData() + i * step, out.testedData() + i * step, step) != 0 ? 1 : 0;
+                    differing += out.same(WIDTH * step, 1) ? 0 : 1;
+                }
+                for (int count = 0; count < 100; ++count)
+                {
+                    for (int offset = 0; offset < 3; ++offset)
+                    {
+                        for (int i = 0; i < count + offset; ++i)
+                        {
+                            y[i] = static_cast<unsigned char>(random());
+                            cb[i] = static_cast<unsigned char>(random());
+                            cr[i] = static_cast<unsigned char>(random());
+                        }
+                        out.reset();
+                        levels[0].YCbCr_to_RGB(out.referenceData() + offset, y.data() + offset, cb.data(), cr.data(), count, step);
+                        levels[level].YCbCr_to_RGB(out.testedData() + offset, y.data() + offset, cb.data(), cr.data(), count, step);
+                        differing += out.same(offset + count * step, 1) ? 0 : 1;
+                    }
+                }
+                report.print(std::string("YCbCr to RGB, ") + (step == 3 ? "3" : "4") + " bytes per pixel, " + level_name(static_cast<int>(level)),
+                    differing, (1 << 24) + 300, "pixels and rows");
+            }
+        }
+    }
+
+    // rows of every width, then every (near, far) pair in one long row
+    {
+        constexpr int PAIRS = 65536;
+        std::vector<unsigned char> nearRow(PAIRS + GUARD), farRow(PAIRS + GUARD);
+        for (std::size_t level = 1; level < levels.size(); ++level)
+        {
+            std::size_t differing = 0, rows = 0;
+            OutputPair out(2 * PAIRS);
+            for (int width = 1; width <= HV2_MAX_WIDTH; ++width)
+            {
+                for (int row = 0; row < HV2_ROWS_PER_WIDTH; ++row, ++rows)
+                {
+                    for (int i = 0; i < width + static_cast<int>(GUARD); ++i)
+                    {
+                        nearRow[i] = static_cast<unsigned char>(random());
+                        farRow[i] = static_cast<unsigned char>(random());
+                    }
+                    out.reset();
+                    levels[0].resample_row_hv_2(out.referenceData(), nearRow.data(), farRow.data(), width, 2);
+                    levels[level].resample_row_hv_2(out.testedData(), nearRow.data(), farRow.data(), width, 2);
+                    differing += out.same(2 * width) ? 0 : 1;
+                }
+            }
+            std::vector<int> pairs(PAIRS);
+            for (int i = 0; i < PAIRS; ++i)
+                pairs[i] = i;
+            std::shuffle(pairs.begin(), pairs.end(), random);
+            for (int i = 0; i < PAIRS; ++i)
+            {
+                nearRow[i] = static_cast<unsigned char>(pairs[i]);
+                farRow[i] = static_cast<unsigned char>(pairs[i] >> 8);
+            }
+            out.reset();
+            levels[0].resample_row_hv_2(out.referenceData(), nearRow.data(), farRow.data(), PAIRS, 2);
+            levels[level].resample_row_hv_2(out.testedData(), nearRow.data(), farRow.data(), PAIRS, 2);
+            differing += out.same(2 * PAIRS) ? 0 : 1;
+            report.print(std::string("hv_2 upsample, ") + level_name(static_cast<int>(level)), differing, rows + 1, "rows");
+        }
+    }
+
+    // the PNG unfilter at 3 and 4 bytes per pixel. Rows alternate between an order-2 de Bruijn
+    // sequence, whose neighbouring pixels take every (above-left, above) pair once, and rows
+    // whose pixel to the left takes a different value in each, so across 256 of them every
+    // filter sees every (left, above, above-left) triple in every channel; then small images
+    // with random pixels and a random filter per row, to cover the short rows and the tails
+    {
+        std::vector<unsigned char> sequence;
+        for (int i = 0; i < 256; ++i)
+        {
+            sequence.push_back(static_cast<unsigned char>(i));
+            for (int j = i + 1; j < 256; ++j)
+            {
+                sequence.push_back(static_cast<unsigned char>(i));
+                sequence.push_back(static_cast<unsigned char>(j));
+            }
+        }
+        // the sequence is cyclic; repeating its first value gives the last pair too
+        sequence.push_back(sequence.front());
+        const int width = static_cast<int>(sequence.size());
+        // rows of values to the left per image, to keep each image small
+        constexpr int LEFT_VALUES_PER_IMAGE = 16;
+        for (int channels = 3; channels <= 4; ++channels)
+        {
+            for (int filter = FILTER_SUB; filter <= FILTER_PAETH; ++filter)
+            {
+                std::vector<std::size_t> differing(levels.size());
+                std::size_t total = 0;
+                for (int first = 0; first < 256; first += LEFT_VALUES_PER_IMAGE)
+                {
+                    const std::size_t stride = static_cast<std::size_t>(width) * channels;
+                    std::vector<unsigned char> pixels(stride * 2 * LEFT_VALUES_PER_IMAGE);
+                    for (int pair = 0; pair < LEFT_VALUES_PER_IMAGE; ++pair)
+                    {
+                        unsigned char* above = &pixels[stride * 2 * pair];
+                        unsigned char* row = above + stride;
+                        for (int x = 0; x < width; ++x)
+                        {
+                            for (int c = 0; c < channels; ++c)
+                            {
+                                above[x * channels + c] = sequence[x];
+                                row[x * channels + c] = static_cast<unsigned char>(first + pair + 7 * x + 85 * c);
+                            }
+                        }
+                    }
+                    const int height = 2 * LEFT_VALUES_PER_IMAGE;
+                    const std::vector<unsigned char> png = encode_png(pixels, width, height, channels, std::vector<int>(height, filter));
+                    const std::vector<unsigned char> scalar = decode_png(png, STBI_simd_scalar);
+                    if (scalar != pixels)
+                        report.fail("PNG unfilter, scalar decode of a generated image");
+                    for (std::size_t level = 1; level < levels.size(); ++level)
+                        differing[level] += count_differing(scalar, decode_png(png, static_cast<int>(level)), pixels.size());
+                    total += pixels.size();
+                }
+                for (std::size_t level = 1; level < levels.size(); ++level)
+                {
+                    report.print(std::string("PNG unfilter, ") + FILTER_NAMES[filter] + ", " + std::to_string(channels) + " bytes per pixel, "
+                        + level_name(static_cast<int>(level)), differing[level], total, "bytes");
+                }
+            }
+
+            std::vector<std::size_t> differing(levels.size());
+            std::size_t total = 0;
+            for (int image = 0; image < 2000; ++image)
+            {
+                const int imageWidth = 1 + static_cast<int>(random() % 64);
+                const int height = 1 + static_cast<int>(random() % 8);
+                std::vector<unsigned char> pixels(static_cast<std::size_t>(imageWidth) * height * channels);
+                for (unsigned char& pixel : pixels)
+                    pixel = static_cast<unsigned char>(random());
+                std::vector<int> filters(height);
+                for (int& filter : filters)
+                    filter = static_cast<int>(random() % 5);
+                const std::vector<unsigned char> png = encode_png(pixels, imageWidth, height, channels, filters);
+                const std::vector<unsigned char> scalar = decode_png(png, STBI_simd_scalar);
+                if (scalar != pixels)
+                    report.fail("PNG unfilter, scalar decode of a generated image");
+                for (std::size_t level = 1; level < levels.size(); ++level)
+                    differing[level] += count_differing(scalar, decode_png(png, static_cast<int>(level)), pixels.size());
+                total += pixels.size();
+            }
+            for (std::size_t level = 1; level < levels.size(); ++level)
+            {
+                report.print("PNG unfilter, small random images, " + std::to_string(channels) + " bytes per pixel, "
+                    + level_name(static_cast<int>(level)), differing[level], total, "bytes");
+            }
+        }
+    }
+
+    // every PNG's image data through the fast inflate loop and the original one
+    for (const std::string& file : files)
+    {
+        const std::vector<unsigned char> contents = read_file(file);
+        if (contents.empty())
+        {
+            report.fail("reading " + file);
+            continue;
+        }
+        ZlibStream stream;
+        if (!png_zlib_stream(contents, stream))
+            continue;
+        OutputPair out(stream.inflatedLength);
+        out.reset();
+        const int original = inflate(stream, out.referenceData(), false);
+        const int fast = inflate(stream, out.testedData(), true);
+        std::size_t differing = fast == original ? 0 : 1;
+        for (int i = 0; i < stream.inflatedLength; ++i)
+            differing += out.referenceData()[i] != out.testedData()[i] ? 1 : 0;
+        // a write past the output shows up in the guard bytes
+        if (differing == 0 && !out.same(stream.inflatedLength))
+            differing = 1;
+        report.print("inflate, " + file, differing, stream.inflatedLength, "bytes", "the original loop");
+    }
+
+    // stbi_load_into_from_memory against stbi_load_from_memory on every file, for every
+    // req_comp, flipped and not, into tight and padded rows, on one JPEG thread and on four
+    for (const std::string& file : files)
+    {
+        const std::vector<unsigned char> contents = read_file(file);
+        if (contents.empty())
+            continue;
+        std::size_t differing = 0, decodes = 0;
+        for (int threads = 1; threads <= 4; threads += 3)
+        {
+            stbi_set_jpeg_thread_count(threads);
+            for (int flip = 0; flip < 2; ++flip)
+            {
+                stbi_set_flip_vertically_on_load_thread(flip);
+                for (int padding = 0; padding <= 5; padding += 5)
+                {
+                    for (int channels = 0; channels <= 4; ++channels, ++decodes)
+                    {
+                        int width, height, fileChannels;
+                        unsigned char* reference = stbi_load_from_memory(contents.data(), static_cast<int>(contents.size()), &width, &height, &fileChannels, channels);
+                        Destination destination;
+                        destination.padding = padding;
+                        int intoWidth, intoHeight, intoChannels;
+                        const int loaded = stbi_load_into_from_memory(contents.data(), static_cast<int>(contents.size()), &intoWidth, &intoHeight, &intoChannels,
+                            channels, destination_rows, &destination);
+                        if (reference == nullptr)
+                        {
+                            differing += loaded ? 1 : 0;
+                            continue;
+                        }
+                        const bool same = loaded && destination.calls == 1 && intoWidth == width && intoHeight == height && intoChannels == fileChannels
+                            && same_rows(destination, reference, width, height, channels != 0 ? channels : fileChannels);
+                        differing += same ? 0 : 1;
+                        stbi_image_free(reference);
+                    }
+                }
+            }
+        }
+        stbi_set_jpeg_thread_count(1);
+        stbi_set_flip_vertically_on_load_thread(0);
+        report.print("decode into, " + file, differing, decodes, "decodes", "stbi_load");
+
+        // JPEGs big enough to be split over threads, split at their restart markers if they
+        // have any, must decode to the same bytes on 4 threads as on one
+        int width, height, fileChannels;
+        const bool jpeg = contents.size() > 2 && contents[0] == 0xff && contents[1] == 0xd8;
+        if (!jpeg || !stbi_info_from_memory(contents.data(), static_cast<int>(contents.size()), &width, &height, &fileChannels)
+            || width * height < JPEG_PARALLEL_MIN_PIXELS)
+            continue;
+        std::size_t threadedDiffering = 0, threadedDecodes = 0;
+        for (int flip = 0; flip < 2; ++flip)
+        {
+            stbi_set_flip_vertically_on_load_thread(flip);
+            for (int channels = 0; channels <= 4; ++channels, ++threadedDecodes)
+            {
+                unsigned char* decoded[2];
+                for (int threaded = 0; threaded < 2; ++threaded)
+                {
+                    stbi_set_jpeg_thread_count(threaded ? 4 : 1);
+                    decoded[threaded] = stbi_load_from_memory(contents.data(), static_cast<int>(contents.size()), &width, &height, &fileChannels, channels);
+                }
+                const std::size_t size = static_cast<std::size_t>(width) * height * (channels != 0 ? channels : fileChannels);
+                const bool same = decoded[0] != nullptr && decoded[1] != nullptr && std::equal(decoded[0], decoded[0] + size, decoded[1]);
+                threadedDiffering += same ? 0 : 1;
+                stbi_image_free(decoded[0]);
+                stbi_image_free(decoded[1]);
+            }
+        }
+        stbi_set_jpeg_thread_count(1);
+        stbi_set_flip_vertically_on_load_thread(0);
+        const int restartInterval = jpeg_restart_interval(contents);
+        report.print("4 threads, " + file + (restartInterval != 0 ? ", restart every " + std::to_string(restartInterval) + " MCUs" : ", no restart markers"),
+            threadedDiffering, threadedDecodes, "decodes", "1 thread");
+    }
+
+    // CPU mip chains built with the scalar loops against the SSE2 ones, which sum in the same
+    // order and so must give the same bytes: both filters, sRGB and linear, 1 to 4 channels,
+    // odd sizes
+    if (levels.size() > 1)
+    {
+        static const int SIZES[][2] = { { 1, 1 }, { 1, 9 }, { 3, 5 }, { 17, 9 }, { 33, 67 }, { 255, 129 }, { 513, 257 } };
+        for (const MipmapFilter filter : { MipmapFilter::Box, MipmapFilter::Kaiser })
+        {
+            for (int srgb = 0; srgb < 2; ++srgb)
+            {
+                std::size_t differing = 0, total = 0;
+                for (int channels = 1; channels <= 4; ++channels)
+                {
+                    for (const auto& size : SIZES)
+                    {
+                        std::vector<unsigned char> pixels(static_cast<std::size_t>(size[0]) * size[1] * channels);
+                        for (std::size_t i = 0; i < pixels.size(); ++i)
+                            pixels[i] = static_cast<unsigned char>(i * 7 / channels + random() % 32);
+                        const std::size_t chain = MipmapGenerator::chainSize(size[0], size[1], channels) - pixels.size();
+                        OutputPair out(chain);
+                        out.reset();
+                        stbi_set_simd_level(STBI_simd_scalar);
+                        MipmapGenerator::generate(pixels.data(), size[0], size[1], channels, filter, srgb != 0, out.referenceData());
+                        stbi_set_simd_level(STBI_simd_sse2);
+                        MipmapGenerator::generate(pixels.data(), size[0], size[1], channels, filter, srgb != 0, out.testedData());
+                        stbi_set_simd_level(STBI_simd_avx2);
+                        std::size_t wrong = 0;
+                        for (std::size_t i = 0; i < chain; ++i)
+                            wrong += out.referenceData()[i] != out.testedData()[i] ? 1 : 0;
+                        differing += wrong == 0 && !out.same(chain) ? 1 : wrong;
+                        total += chain;
+                    }
+                }
+                report.print(std::string("mipmaps, ") + (filter == MipmapFilter::Box ? "box" : "Kaiser") + (srgb ? ", sRGB" : ", linear") + ", SSE2",
+                    differing, total, "bytes");
+            }
+        }
+    }
+
+    // previews against the full decode, for every req_comp, flipped and not: interlaced PNGs of
+    // 1 to 4 channels and odd sizes, in stored blocks (some bigger than the first Adam7 pass)
+    // and in Huffman-coded ones, must match every 8th pixel exactly; the JPEGs among the files
+    // must stay within JPEG_PREVIEW_ERROR of the block means on average
+    {
+        static const int SIZES[][2] = { { 1, 1 }, { 7, 5 }, { 9, 9 }, { 33, 17 }, { 100, 61 }, { 257, 130 }, { 1000, 700 } };
+        for (int deflate = 0; deflate < 2; ++deflate)
+        {
+            std::size_t differing = 0, images = 0;
+            for (int channels = 1; channels <= 4; ++channels)
+            {
+                for (const auto& size : SIZES)
+                {
+                    // a gradient with some noise, so the filters and runs all get used
+                    std::vector<unsigned char> pixels(static_cast<std::size_t>(size[0]) * size[1] * channels);
+                    for (std::size_t i = 0; i < pixels.size(); ++i)
+                        pixels[i] = static_cast<unsigned char>(i / channels % size[0] + i / channels / size[0] * 3 + (random() % 8 == 0 ? random() : 0));
+                    std::vector<int> filters(16);
+                    for (int& filter : filters)
+                        filter = static_cast<int>(random() % 5);
+                    const std::vector<unsigned char> png = encode_png(pixels, size[0], size[1], channels, filters, true,
+                        deflate == 0 ? Deflate::Stored : Deflate::Fixed);
+                    differing += worst_preview_error(png, false) != 0.0 ? 1 : 0;
+                    ++images;
+                }
+            }
+            report.print(deflate == 0 ? "preview, interlaced PNG, stored blocks" : "preview, interlaced PNG, Huffman-coded", differing, images, "images",
+                "every 8th pixel");
+        }
+        for (const std::string& file : files)
+        {
+            const std::vector<unsigned char> contents = read_file(file);
+            const bool jpeg = contents.size() > 2 && contents[0] == 0xff && contents[1] == 0xd8;
+            if (contents.empty())
+                continue;
+            const double error = worst_preview_error(contents, jpeg);
+            if (error < 0.0)
+            {
+                std::cout << "preview, " << file << ": has none" << '\n';
+                continue;
+            }
+            const bool close = jpeg ? error <= JPEG_PREVIEW_ERROR : error == 0.0;
+            std::cout << "preview, " << file << ": " << (jpeg ? "mean" : "largest") << " difference " << error << " from the full decode"
+                << (close ? "" : " FAILED") << '\n';
+            if (!close)
+                report.fail("preview, " + file);
+        }
+    }
+
+    // BC1 and BC3 round trips: flat, gradient, noise and alpha ramp images of 1 to 4 channels
+    // and odd sizes are compressed, their DDS headers parsed back, and every level's blocks
+    // decoded and compared per channel with the mip chain they were encoded from. Flat images
+    // (whose endpoints are equal, so the blocks are in BC1's three-color mode) must come back
+    // exactly, and no BC1 pixel may come back transparent. One thread and many must write the
+    // same file
+    {
+        static const int SIZES[][2] = { { 1, 1 }, { 1, 7 }, { 3, 5 }, { 13, 7 }, { 17, 9 }, { 65, 33 }, { 255, 129 } };
+        static const char* const PATTERNS[] = { "flat", "gradient", "noise", "alpha ramp" };
+        for (int pattern = 0; pattern < 4; ++pattern)
+        {
+            const double bound = pattern == 0 ? 0.0 : pattern == 2 ? BLOCK_NOISE_ERROR : BLOCK_GRADIENT_ERROR;
+            double worst[4] = {};
+            std::size_t headers = 0, transparent = 0, threaded = 0;
+            for (int channels = pattern == 3 ? 4 : 1; channels <= 4; ++channels)
+            {
+                for (const auto& size : SIZES)
+                {
+                    const int width = size[0], height = size[1];
+                    // the flat colors fit 5:6:5 exactly, alpha included when it isn't opaque
+                    const unsigned char flat[4] = { 0x84, 0x41, 0xde, static_cast<unsigned char>(channels == 4 ? 0x80 : 0xff) };
+                    std::vector<unsigned char> pixels(static_cast<std::size_t>(width) * height * channels);
+                    for (int y = 0; y < height; ++y)
+                    {
+                        for (int x = 0; x < width; ++x)
+                        {
+                            for (int c = 0; c < channels; ++c)
+                            {
+                                int value = flat[c];
+                                if (pattern == 1)
+                                    value = std::min(x + y / 2 + c * 20, 255);
+                                else if (pattern == 2)
+                                    value = static_cast<int>(random() & 255);
+                                else if (pattern == 3)
+                                    value = c == 3 ? std::min(x * 4, 255) : std::min(y + c * 40, 255);
+                                pixels[(static_cast<std::size_t>(y) * width + x) * channels + c] = static_cast<unsigned char>(value);
+                            }
+                        }
+                    }
+                    const std::vector<unsigned char> file = TextureCompressor::compress(pixels.data(), width, height, channels, MipmapFilter::Box, 1);
+                    if (TextureCompressor::compress(pixels.data(), width, height, channels, MipmapFilter::Box, 4) != file)
+                        ++threaded;
+
+                    // the chain the blocks were encoded from: RGBA the way GL expands the image
+                    std::vector<unsigned char> chain(MipmapGenerator::chainSize(width, height, 4));
+                    bool opaque = true;
+                    for (std::size_t i = 0; i < static_cast<std::size_t>(width) * height; ++i)
+                    {
+                        for (int c = 0; c < 4; ++c)
+                            chain[4 * i + c] = c < channels ? pixels[channels * i + c] : c == 3 ? 255 : 0;
+                        opaque = opaque && chain[4 * i + 3] == 255;
+                    }
+                    MipmapGenerator::generate(chain.data(), width, height, 4, MipmapFilter::Box, true,
+                        chain.data() + static_cast<std::size_t>(width) * height * 4);
+
+                    CompressedTextureInfo info;
+                    if (file.size() < CompressedTextureInfo::HEADER_SIZE || !CompressedTextureInfo::parse(file.data(), info)
+                        || info.format != (opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+                        || info.width != width || info.height != height || info.levels != MipmapGenerator::levelCount(width, height)
+                        || file.size() != CompressedTextureInfo::HEADER_SIZE + info.dataSize())
+                    {
+                        ++headers;
+                        continue;
+                    }
+                    double squared[4] = {};
+                    std::size_t count = 0;
+                    const unsigned char* expected = chain.data();
+                    for (int level = 0; level < info.levels; ++level)
+                    {
+                        const std::vector<unsigned char> decoded = decode_blocks(file, info, level);
+                        for (std::size_t i = 0; i < decoded.size(); ++i)
+                        {
+                            const double difference = static_cast<double>(decoded[i]) - expected[i];
+                            squared[i % 4] += difference * difference;
+                            if (i % 4 == 3 && opaque && decoded[i] != 255)
+                                ++transparent;
+                        }
+                        count += decoded.size() / 4;
+                        expected += decoded.size();
+                    }
+                    for (int c = 0; c < 4; ++c)
+                        worst[c] = std::max(worst[c], std::sqrt(squared[c] / count));
+                }
+            }
+            const bool close = std::all_of(worst, worst + 4, [bound](const double error) { return error <= bound; });
+            std::cout << "blocks, " << PATTERNS[pattern] << ": worst RMSE per channel " << worst[0] << " " << worst[1] << " " << worst[2] << " "
+                << worst[3] << " (at most " << bound << ")" << (close ? "" : " FAILED") << '\n';
+            if (!close)
+                report.fail(std::string("blocks, ") + PATTERNS[pattern]);
+            if (headers != 0)
+                report.fail(std::string("blocks, ") + PATTERNS[pattern] + ", " + std::to_string(headers) + " DDS headers");
+            if (transparent != 0)
+                report.fail(std::string("blocks, ") + PATTERNS[pattern] + ", " + std::to_string(transparent) + " transparent BC1 pixels");
+            if (threaded != 0)
+                report.fail(std::string("blocks, ") + PATTERNS[pattern] + ", " + std::to_string(threaded) + " files differing between 1 and 4 threads");
+        }
+    }
+
+    std::cout << (report.passed() ? "image check passed" : "image check FAILED") << '\n';
+    return report.passed();
+}
+
+void ImageValidation::benchmark(const unsigned long rounds, const std::vector<std::string>& files, const std::string& jsonPath)
+{
+    const std::vector<stbi_jpeg_kernels> levels = jpeg_kernels();
+    std::mt19937 random(20240611u);
+
+    BenchmarkJson json(jsonPath);
+    // times body with every variant and prints the time per item, items being what one call of
+    // body handles
+    const auto measure = [&](const std::string& name, const char* unit, const std::size_t items, const std::vector<std::string>& variants,
+        const std::function<void(std::size_t)>& body)
+    {
+        std::cout << name << ":";
+        for (std::size_t variant = 0; variant < variants.size(); ++variant)
+        {
+            const double nanoseconds = FrameTimeSummary::measure(rounds, [&] { body(variant); }).p50 * 1.0e6 / static_cast<double>(items);
+            std::cout << (variant == 0 ? " " : ", ") << nanoseconds << " ns per " << unit << " " << variants[variant];
+            if (json.enabled())
+                json.add() << "\"kernel\": \"" << name << "\", \"variant\": \"" << variants[variant] << "\", \"ns_per_" << unit << "\": " << nanoseconds << " }";
+        }
+        std::cout << '\n';
+    };
+    std::vector<std::string> levelNames;
+    for (std::size_t level = 0; level < levels.size(); ++level)
+        levelNames.push_back(level_name(static_cast<int>(level)));
+
+    // a 512x512 plane of encoded blocks, as the decoder writes them
+    {
+        constexpr int SIDE = 512;
+        constexpr std::size_t BLOCKS = (SIDE / 8) * (SIDE / 8);
+        std::vector<short> blocks(BLOCKS * 64);
+        for (std::size_t block = 0; block < BLOCKS; ++block)
+            encode_block(random, &blocks[block * 64]);
+        std::vector<unsigned char> plane(SIDE * SIDE);
+        measure("IDCT", "block", BLOCKS, levelNames, [&](const std::size_t level)
+        {
+            const stbi_jpeg_kernels& kernels = levels[level];
+            for (std::size_t block = 0; block < BLOCKS; ++block)
+            {
+                alignas(16) short data[64];
+                std::memcpy(data, &blocks[block * 64], sizeof(data));
+                kernels.idct_block(&plane[(block / (SIDE / 8)) * 8 * SIDE + (block % (SIDE / 8)) * 8], SIDE, data);
+            }
+        });
+    }
+    {
+        constexpr int WIDTH = 8192;
+        std::vector<unsigned char> y(WIDTH), cb(WIDTH), cr(WIDTH), out(WIDTH * 4 + 1);
+        for (int i = 0; i < WIDTH; ++i)
+        {
+            y[i] = static_cast<unsigned char>(random());
+            cb[i] = static_cast<unsigned char>(random());
+            cr[i] = static_cast<unsigned char>(random());
+        }
+        measure("YCbCr to RGBA", "pixel", WIDTH, levelNames, [&](const std::size_t level)
+        {
+            levels[level].YCbCr_to_RGB(out.data(), y.data(), cb.data(), cr.data(), WIDTH, 4);
+        });
+    }
+    {
+        constexpr int WIDTH = 4096;
+        std::vector<unsigned char> nearRow(WIDTH + GUARD), farRow(WIDTH + GUARD), out(2 * WIDTH);
+        for (int i = 0; i < WIDTH; ++i)
+        {
+            nearRow[i] = static_cast<unsigned char>(random());
+            farRow[i] = static_cast<unsigned char>(random());
+        }
+        measure("hv_2 upsample", "pixel", 2 * WIDTH, levelNames, [&](const std::size_t level)
+        {
+            levels[level].resample_row_hv_2(out.data(), nearRow.data(), farRow.data(), WIDTH, 2);
+        });
+    }
+    // a 2048x512 image of random pixels filtered with one filter, through the whole PNG decoder;
+    // the image data is stored rather than compressed, so unfiltering takes most of the time
+    for (int channels = 3; channels <= 4; ++channels)
+    {
+        constexpr int WIDTH = 2048, HEIGHT = 512;
+        std::vector<unsigned char> pixels(static_cast<std::size_t>(WIDTH) * HEIGHT * channels);
+        for (unsigned char& pixel : pixels)
+            pixel = static_cast<unsigned char>(random());
+        for (int filter = FILTER_SUB; filter <= FILTER_PAETH; ++filter)
+        {
+            const std::vector<unsigned char> png = encode_png(pixels, WIDTH, HEIGHT, channels, std::vector<int>(HEIGHT, filter));
+            measure(std::string("PNG decode, ") + FILTER_NAMES[filter] + ", " + std::to_string(channels) + " bytes per pixel", "byte",
+                pixels.size(), levelNames, [&](const std::size_t level)
+            {
+                stbi_set_simd_level(static_cast<int>(level));
+                int width, height, channels;
+                stbi_image_free(stbi_load_from_memory(png.data(), static_cast<int>(png.size()), &width, &height, &channels, 0));
+                stbi_set_simd_level(STBI_simd_avx2);
+            });
+        }
+    }
+    for (const std::string& file : files)
+    {
+        ZlibStream stream;
+        if (!png_zlib_stream(read_file(file), stream))
+            continue;
+        std::vector<unsigned char> out(stream.inflatedLength);
+        measure("inflate " + file, "byte", out.size(), { "original", "fast" }, [&](const std::size_t fast)
+        {
+            inflate(stream, out.data(), fast != 0);
+        });
+    }
+}
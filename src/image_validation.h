@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+// checks stb_image's SIMD kernels against its scalar ones, its fast inflate loop against the
+// original one, decoding into the caller's rows and previews against stbi_load, and block
+// compression against the source pixels, and times the kernels and the inflate loops.
+// stbi_set_simd_level caps the kernels the decoders pick and stbi_set_fast_inflate turns the
+// fast loop off, so every variant runs on the same inputs on one machine.
+class ImageValidation
+{
+public:
+    // runs every kernel at every level the CPU supports and compares its output with the scalar
+    // kernel's, prints how many results differ per kernel and level and returns whether none
+    // did. The JPEG IDCT sees every block with a single coefficient in the range of baseline
+    // 8-bit JPEG data and blocks encoded from random pixels, the colour converter every YCbCr
+    // triple and the chroma upsampler rows of every width up to 512 and every pair of inputs.
+    // The PNG unfilter sees every filter at 3 and 4 bytes per pixel with every combination of
+    // neighbouring bytes, and small random images. The image data of every PNG in files is
+    // inflated both ways, and every file in files is decoded into caller-provided rows and
+    // compared with stbi_load's result; JPEGs big enough to be threaded must decode to the same
+    // bytes on 4 threads as on one. Previews of generated interlaced PNGs and of the files
+    // are compared with the full decode, and MipmapGenerator's scalar loops with its SSE2 ones.
+    // TextureCompressor's BC1 and BC3 files are parsed and decoded back, and must stay within
+    // a per-channel RMSE of the images they were encoded from
+    static bool check(const std::vector<std::string>& files);
+
+    // times each kernel at each level, PNG decoding per filter at each level and the two
+    // inflate loops on every PNG in files, prints the time per block, pixel or byte and writes
+    // it to jsonPath unless that is empty
+    static void benchmark(unsigned long rounds, const std::vector<std::string>& files, const std::string& jsonPath);
+};
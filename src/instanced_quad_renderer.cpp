@@ -0,0 +1,126 @@
+#include "instanced_quad_renderer.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+    constexpr float quad_vertices[] = {
+        // positions          // colors           // texture coords
+         0.5f,  0.5f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 1.0f,   // top right
+         0.5f, -0.5f, 0.0f,   0.0f, 1.0f, 0.0f,   1.0f, 0.0f,   // bottom right
+        -0.5f, -0.5f, 0.0f,   0.0f, 0.0f, 1.0f,   0.0f, 0.0f,   // bottom left
+        -0.5f,  0.5f, 0.0f,   1.0f, 1.0f, 0.0f,   0.0f, 1.0f    // top left
+    };
+    constexpr unsigned int quad_indices[] = {
+        0, 1, 3,  // first Triangle
+        1, 2, 3   // second Triangle
+    };
+
+    // first attribute location used by per-instance data (see shaders/instanced.vs and shaders/atlas.vs)
+    constexpr unsigned int INSTANCE_ATTRIBUTE = 3;
+}
+
+InstancedQuadRenderer::InstancedQuadRenderer()
+{
+    glGenVertexArrays(1, &vertexArrayObject);
+    glGenBuffers(1, &vertexBufferObject);
+    glGenBuffers(1, &elementBufferObject);
+    glGenBuffers(1, &instanceBufferObject);
+
+    glBindVertexArray(vertexArrayObject);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferObject);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(quad_indices), quad_indices, GL_STATIC_DRAW);
+
+    // position attribute
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), static_cast<void*>(nullptr));
+    glEnableVertexAttribArray(0);
+    // color attribute
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), reinterpret_cast<void*>(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    // texture coord attribute
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), reinterpret_cast<void*>(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+
+    pointInstanceAttributes(instanceBufferObject, 0, 0);
+    for (unsigned int attribute = INSTANCE_ATTRIBUTE; attribute < INSTANCE_ATTRIBUTE + 7; ++attribute)
+    {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+
+    glBindVertexArray(0);
+}
+
+InstancedQuadRenderer::~InstancedQuadRenderer()
+{
+    glDeleteVertexArrays(1, &vertexArrayObject);
+    glDeleteBuffers(1, &vertexBufferObject);
+    glDeleteBuffers(1, &elementBufferObject);
+    glDeleteBuffers(1, &instanceBufferObject);
+}
+
+// expects the vertex array to be bound
+void InstancedQuadRenderer::pointInstanceAttributes(const unsigned int buffer, const std::uint64_t ring, const GLintptr offset)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    // instance attributes: a mat4 takes four consecutive vec4 locations
+    constexpr auto stride = static_cast<GLsizei>(sizeof(QuadInstance));
+    for (unsigned int column = 0; column < 4; ++column)
+    {
+        const std::uintptr_t columnOffset = offset + offsetof(QuadInstance, transform) + column * sizeof(glm::vec4);
+        glVertexAttribPointer(INSTANCE_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(columnOffset));
+    }
+    glVertexAttribPointer(INSTANCE_ATTRIBUTE + 4, 4, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offset + offsetof(QuadInstance, tint)));
+    glVertexAttribPointer(INSTANCE_ATTRIBUTE + 5, 1, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void*>(offset + offsetof(QuadInstance, mixValue)));
+    glVertexAttribIPointer(INSTANCE_ATTRIBUTE + 6, 1, GL_UNSIGNED_INT, stride, reinterpret_cast<void*>(offset + offsetof(QuadInstance, image)));
+    sourceRing = ring;
+    sourceOffset = offset;
+}
+
+void InstancedQuadRenderer::upload(const QuadInstance* instances, const std::size_t count)
+{
+    if (sourceRing != 0 || sourceOffset != 0)
+    {
+        glBindVertexArray(vertexArrayObject);
+        pointInstanceAttributes(instanceBufferObject, 0, 0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBufferObject);
+    const auto size = static_cast<GLsizeiptr>(count * sizeof(QuadInstance));
+    if (count > instanceCapacity)
+    {
+        glBufferData(GL_ARRAY_BUFFER, size, instances, GL_STREAM_DRAW);
+        instanceCapacity = count;
+    }
+    else
+    {
+        // orphan the old storage so we never wait on draws still reading it
+        glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(instanceCapacity * sizeof(QuadInstance)), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances);
+    }
+    instanceCount = count;
+}
+
+bool InstancedQuadRenderer::stream(StreamRingBuffer& ring, const QuadInstance* instances, const std::size_t count)
+{
+    const StreamRingBuffer::Allocation allocation = ring.allocate(count * sizeof(QuadInstance), 16);
+    if (allocation.data == nullptr)
+        return false;
+    std::memcpy(allocation.data, instances, allocation.size);
+    ring.flush();
+
+    // without separate vertex formats (GL 4.3) moving the source means re-pointing the attributes
+    glBindVertexArray(vertexArrayObject);
+    if (sourceRing != ring.serial() || sourceOffset != allocation.offset)
+        pointInstanceAttributes(ring.buffer(), ring.serial(), allocation.offset);
+    instanceCount = count;
+    return true;
+}
+
+void InstancedQuadRenderer::draw(const std::size_t count) const
+{
+    glBindVertexArray(vertexArrayObject);
+    glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(count));
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "stream_ring_buffer.h"
+
+
+// per-quad data streamed to the instance buffer; layout matches shaders/instanced.vs and
+// shaders/atlas.vs
+struct QuadInstance
+{
+    glm::mat4 transform;
+    glm::vec4 tint;
+    float mixValue;
+    // TextureAtlas region to show, only read by shaders/atlas.vs
+    std::uint32_t image;
+};
+
+// draws any number of textured quads with a single glDrawElementsInstanced call. Quad geometry
+// is shared; transform, tint, mix value and atlas region come from a per-instance vertex buffer.
+class InstancedQuadRenderer
+{
+public:
+    InstancedQuadRenderer();
+    InstancedQuadRenderer(const InstancedQuadRenderer&) = delete;
+    InstancedQuadRenderer& operator=(const InstancedQuadRenderer&) = delete;
+    ~InstancedQuadRenderer();
+
+    // replaces the instance data, growing the buffer when needed
+    void upload(const QuadInstance* instances, std::size_t count);
+    // writes this frame's instance data straight into a ring buffer region and draws from there;
+    // returns false when the ring's region is too small for count instances
+    bool stream(StreamRingBuffer& ring, const QuadInstance* instances, std::size_t count);
+    // draws the first count uploaded instances (all of them by default)
+    void draw(std::size_t count) const;
+    void draw() const { draw(instanceCount); }
+
+    unsigned int vertexArray() const { return vertexArrayObject; }
+    std::size_t size() const { return instanceCount; }
+
+private:
+    unsigned int vertexArrayObject = 0;
+    unsigned int vertexBufferObject = 0;
+    unsigned int elementBufferObject = 0;
+    unsigned int instanceBufferObject = 0;
+    std::size_t instanceCount = 0;
+    std::size_t instanceCapacity = 0;
+    // where the instance attributes currently point: the serial of the ring (0 for our own
+    // buffer), as a new ring may get a deleted ring's buffer name, and the offset into it
+    std::uint64_t sourceRing = 0;
+    GLintptr sourceOffset = 0;
+
+    void pointInstanceAttributes(unsigned int buffer, std::uint64_t ring, GLintptr offset);
+};
@@ -1,23 +1,50 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/simd/matrix.h>
 
+#include "frame_benchmark.h"
+#include "frustum_culler.h"
+#include "gl_state_cache.h"
+#include "glm_validation.h"
+#include "image_arena.h"
+#include "image_validation.h"
+#include "instanced_quad_renderer.h"
+#include "mipmap_generator.h"
+#include "stream_ring_buffer.h"
+#include "render_context.h"
 #include "shader.h"
 #include "stb_image/stb_image.h"
+#include "texture_atlas.h"
+#include "texture_compressor.h"
+#include "texture_loader.h"
+#include "transform_batch.h"
 
 constexpr unsigned int SCR_WIDTH = 800;
 constexpr unsigned int SCR_HEIGHT = 600;
 
-void frame_buffer_size_callback(GLFWwindow* window, const int width, const int height)
-{
-    glViewport(0, 0, width, height);
-}
-
 void process_input(GLFWwindow* window, float& mixValue)
 {
+    if (window == nullptr)
+        return;
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
     if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
@@ -34,90 +61,969 @@ void process_input(GLFWwindow* window, float& mixValue)
     }
 }
 
-GLFWwindow* initialize_window()
+struct LaunchOptions
 {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    ContextOptions context;
+    // number of frames to render before exiting, 0 renders until the window closes
+    unsigned long frameLimit = 0;
+    // directory to write every rendered frame to as PPM, empty disables dumping
+    std::string dumpDirectory;
+    // render this many uncapped frames on a fixed clock and report frame times, 0 disables
+    unsigned long benchmarkFrames = 0;
+    std::string benchmarkJson = "benchmark.json";
+    // draw 1 to 1M instanced quads and report throughput instead of running the scene
+    bool instancingBenchmark = false;
+    // rewrite the instance data every frame through a persistently mapped ring buffer
+    bool streamInstances = false;
+    // decode every image this many times and report decode times instead of rendering, 0 disables
+    unsigned long decodeBenchmarkRounds = 0;
+    // images for the decode benchmark and the image check, the bundled textures when empty
+    std::vector<std::string> decodeFiles;
+    // threads stb_image may use for a single large JPEG
+    int jpegThreads = 1;
+    // decode out of a per-thread arena instead of the heap
+    bool imageArena = true;
+    // decode benchmark: write every image into one reused buffer, like the texture loader
+    // writes into its staging buffer, instead of a fresh allocation per image
+    bool decodeInto = false;
+    // decode benchmark and compressor: keep stb_image's top-down row order instead of flipping for GL
+    bool decodeFlip = true;
+    // decode benchmark: decode stb_image's 1/8-scale previews instead of the full images
+    bool decodePreview = false;
+    // start rendering right away and let the textures come in as they decode, previews first
+    bool streamTextures = false;
+    // write a block-compressed .dds next to every --decode-file (the bundled textures when none
+    // are given) instead of rendering
+    bool compressTextures = false;
+    // threads the compressor may use, 0 picks one per hardware thread
+    unsigned int compressThreads = 0;
+    // load the .dds versions of the bundled textures when they exist and the driver can sample them
+    bool compressedTextures = false;
+    // build mipmaps on the loader threads with this filter instead of glGenerateMipmap; the
+    // decode benchmark includes the chain in its times and the compressor filters with it
+    MipmapFilter mipmapFilter = MipmapFilter::Driver;
+    // draw quads showing many different images, once with a bind and a draw per quad and once
+    // batched through a texture atlas, and report both instead of running the scene
+    bool atlasBenchmark = false;
+    // transform points and matrices this many times, one at a time and in batches, and report
+    // the time per element instead of rendering, 0 disables
+    unsigned long transformBenchmarkRounds = 0;
+    // points and matrices per round, and the inputs --glm-check tries
+    std::size_t transformCount = 250000;
+    // cull bounding spheres and boxes against a camera this many times, with every SIMD level
+    // and then on several threads, and report the time per object instead of rendering, 0 disables
+    unsigned long cullBenchmarkRounds = 0;
+    // spheres and boxes per round
+    std::size_t cullCount = 1000000;
+    // threads for the threaded cull, 0 picks one per hardware thread
+    unsigned int cullThreads = 0;
+    // compare glm's SIMD results with its scalar ones and exit, failing when any is out of bounds
+    bool glmCheck = false;
+    // time glm's mat4 operations this many times on the aligned and the packed types, 0 disables
+    unsigned long glmBenchmarkRounds = 0;
+    // compare stb_image's SIMD kernels with its scalar ones and its fast inflate with the
+    // original on the --decode-file PNGs, and exit, failing when any differs
+    bool imageCheck = false;
+    // time stb_image's kernels this many times at every SIMD level and both inflate loops on the
+    // --decode-file PNGs, 0 disables
+    unsigned long imageBenchmarkRounds = 0;
+};
 
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", nullptr, nullptr);
-    if (window == nullptr)
+void print_usage(const char* program)
+{
+    std::cout << "Usage: " << program << " [--headless] [--frames N] [--dump-frames DIR]"
+        " [--no-shader-cache] [--benchmark N] [--instancing-benchmark] [--stream-instances]"
+        " [--benchmark-json PATH] [--decode-benchmark N] [--decode-file PATH] [--jpeg-threads N]"
+        " [--no-image-arena] [--decode-into] [--no-flip] [--preview] [--stream-textures]"
+        " [--compress-textures] [--compress-threads N] [--compressed-textures] [--cpu-mipmaps box|kaiser]"
+        " [--atlas-benchmark] [--transform-benchmark N] [--transform-count N]"
+        " [--cull-benchmark N] [--cull-count N] [--cull-threads N] [--glm-check] [--glm-benchmark N]"
+        " [--image-check] [--image-benchmark N]" << '\n';
+}
+
+bool parse_arguments(const int argc, char* argv[], LaunchOptions& options)
+{
+    int i = 1;
+    try
     {
-	    std::cout << "Failed to create GLFW window" << '\n';
-        glfwTerminate();
-        return nullptr;
+        for (; i < argc; ++i)
+        {
+            const std::string argument = argv[i];
+            if (argument == "--headless")
+            {
+                options.context.headless = true;
+            }
+            else if (argument == "--frames" && i + 1 < argc)
+            {
+                options.frameLimit = std::stoul(argv[++i]);
+            }
+            else if (argument == "--dump-frames" && i + 1 < argc)
+            {
+                options.dumpDirectory = argv[++i];
+            }
+            else if (argument == "--no-shader-cache")
+            {
+                ProgramCache::directory().clear();
+            }
+            else if (argument == "--benchmark" && i + 1 < argc)
+            {
+                options.benchmarkFrames = std::stoul(argv[++i]);
+            }
+            else if (argument == "--instancing-benchmark")
+            {
+                options.instancingBenchmark = true;
+            }
+            else if (argument == "--stream-instances")
+            {
+                options.streamInstances = true;
+            }
+            else if (argument == "--benchmark-json" && i + 1 < argc)
+            {
+                options.benchmarkJson = argv[++i];
+            }
+            else if (argument == "--decode-benchmark" && i + 1 < argc)
+            {
+                options.decodeBenchmarkRounds = std::stoul(argv[++i]);
+            }
+            else if (argument == "--decode-file" && i + 1 < argc)
+            {
+                options.decodeFiles.push_back(argv[++i]);
+            }
+            else if (argument == "--jpeg-threads" && i + 1 < argc)
+            {
+                options.jpegThreads = std::stoi(argv[++i]);
+            }
+            else if (argument == "--no-image-arena")
+            {
+                options.imageArena = false;
+            }
+            else if (argument == "--decode-into")
+            {
+                options.decodeInto = true;
+            }
+            else if (argument == "--no-flip")
+            {
+                options.decodeFlip = false;
+            }
+            else if (argument == "--preview")
+            {
+                options.decodePreview = true;
+            }
+            else if (argument == "--stream-textures")
+            {
+                options.streamTextures = true;
+            }
+            else if (argument == "--compress-textures")
+            {
+                options.compressTextures = true;
+            }
+            else if (argument == "--compress-threads" && i + 1 < argc)
+            {
+                options.compressThreads = static_cast<unsigned int>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--compressed-textures")
+            {
+                options.compressedTextures = true;
+            }
+            else if (argument == "--cpu-mipmaps" && i + 1 < argc && (argv[i + 1] == std::string("box") || argv[i + 1] == std::string("kaiser")))
+            {
+                options.mipmapFilter = argv[++i] == std::string("box") ? MipmapFilter::Box : MipmapFilter::Kaiser;
+            }
+            else if (argument == "--atlas-benchmark")
+            {
+                options.atlasBenchmark = true;
+            }
+            else if (argument == "--transform-benchmark" && i + 1 < argc)
+            {
+                options.transformBenchmarkRounds = std::stoul(argv[++i]);
+            }
+            else if (argument == "--transform-count" && i + 1 < argc)
+            {
+                options.transformCount = std::stoul(argv[++i]);
+            }
+            else if (argument == "--cull-benchmark" && i + 1 < argc)
+            {
+                options.cullBenchmarkRounds = std::stoul(argv[++i]);
+            }
+            else if (argument == "--cull-count" && i + 1 < argc)
+            {
+                options.cullCount = std::stoul(argv[++i]);
+            }
+            else if (argument == "--cull-threads" && i + 1 < argc)
+            {
+                options.cullThreads = static_cast<unsigned int>(std::stoul(argv[++i]));
+            }
+            else if (argument == "--glm-check")
+            {
+                options.glmCheck = true;
+            }
+            else if (argument == "--glm-benchmark" && i + 1 < argc)
+            {
+                options.glmBenchmarkRounds = std::stoul(argv[++i]);
+            }
+            else if (argument == "--image-check")
+            {
+                options.imageCheck = true;
+            }
+            else if (argument == "--image-benchmark" && i + 1 < argc)
+            {
+                options.imageBenchmarkRounds = std::stoul(argv[++i]);
+            }
+            else
+            {
+                print_usage(argv[0]);
+                return false;
+            }
+        }
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, frame_buffer_size_callback);
+    // std::stoul and std::stoi on a value that isn't a number, or is too big for one
+    catch (const std::invalid_argument&)
+    {
+        std::cout << "Not a number: " << argv[i] << '\n';
+        print_usage(argv[0]);
+        return false;
+    }
+    catch (const std::out_of_range&)
+    {
+        std::cout << "Out of range: " << argv[i] << '\n';
+        print_usage(argv[0]);
+        return false;
+    }
+    // there is nobody to close a headless window, so render a single frame unless told otherwise
+    if (options.context.headless && options.frameLimit == 0 && options.benchmarkFrames == 0)
+        options.frameLimit = 1;
+    return true;
+}
 
-    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))  // NOLINT(clang-diagnostic-cast-function-type-strict)
+std::string frame_dump_path(const std::string& directory, const unsigned long frame)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "frame_%05lu.ppm", frame);
+    return directory + "/" + name;
+}
+
+// lays count quads out on a square grid covering the viewport, each with its own rotation,
+// tint and mix value, so every instance attribute is exercised
+std::vector<QuadInstance> make_quad_grid(const std::size_t count)
+{
+    std::vector<QuadInstance> instances(count);
+    const auto side = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    const float cell = 2.0f / static_cast<float>(side);
+    for (std::size_t i = 0; i < count; ++i)
     {
-	    std::cout << "Failed to initialize GLAD" << '\n';
-        return nullptr;
+        const float x = -1.0f + cell * (static_cast<float>(i % side) + 0.5f);
+        const float y = -1.0f + cell * (static_cast<float>(i / side) + 0.5f);
+        auto transformation = glm::translate(glm::mat4(1.0f), glm::vec3(x, y, 0.0f));
+        transformation = glm::rotate(transformation, static_cast<float>(i) * 0.1f, glm::vec3(0.0f, 0.0f, 1.0f));
+        transformation = glm::scale(transformation, glm::vec3(cell * 0.9f));
+        instances[i].transform = transformation;
+        instances[i].tint = glm::vec4(0.5f + 0.5f * std::sin(static_cast<float>(i)), 0.5f + 0.5f * std::cos(static_cast<float>(i)), 1.0f, 1.0f);
+        instances[i].mixValue = static_cast<float>(i % 101) / 100.0f;
     }
+    return instances;
+}
 
-    return window;
+// draws 1, 10, ... 1M instanced quads in one call each and reports the sustained throughput;
+// false when the window is closed before every count is measured
+bool run_instancing_benchmark(RenderContext& context, const unsigned int textures[2], const LaunchOptions& options)
+{
+    const Shader instancedShader("shaders/instanced.vs", "shaders/instanced.fs");
+    instancedShader.use();
+    instancedShader.setInt("texture1", 0);
+    instancedShader.setInt("texture2", 1);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, textures[0]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, textures[1]);
+    context.setSwapInterval(0);
+
+    const unsigned long frames = options.benchmarkFrames != 0 ? options.benchmarkFrames : 30;
+    InstancedQuadRenderer renderer;
+    BenchmarkJson json(options.benchmarkJson);
+
+    for (std::size_t count = 1; count <= 1000000; count *= 10)
+    {
+        const std::vector<QuadInstance> instances = make_quad_grid(count);
+        std::unique_ptr<StreamRingBuffer> ring;
+        if (options.streamInstances)
+            ring.reset(new StreamRingBuffer(GL_ARRAY_BUFFER, count * sizeof(QuadInstance) + 16));
+        else
+            renderer.upload(instances.data(), instances.size());
+
+        std::vector<double> times;
+        times.reserve(frames);
+        // one unmeasured frame absorbs the upload and any lazy driver work
+        for (unsigned long frame = 0; frame <= frames; ++frame)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            if (ring)
+            {
+                ring->beginFrame();
+                renderer.stream(*ring, instances.data(), instances.size());
+            }
+            renderer.draw();
+            if (ring)
+                ring->endFrame();
+            context.swapBuffers();
+            // wait for the GPU so the time covers the work actually done
+            glFinish();
+            if (frame != 0)
+                times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            context.pollEvents();
+            if (context.shouldClose())
+            {
+                std::cout << "benchmark stopped: the window was closed at " << count << " instances" << '\n';
+                return false;
+            }
+        }
+
+        const FrameTimeSummary summary = FrameTimeSummary::from(times);
+        const double instancesPerSecond = static_cast<double>(count) / (summary.mean / 1000.0);
+        std::cout << "instances " << count << ": mean " << summary.mean << " ms, p95 " << summary.p95
+            << " ms, " << instancesPerSecond / 1.0e6 << " M instances/s" << '\n';
+        if (json.enabled())
+        {
+            json.add() << "\"instances\": " << count << ", \"mean_ms\": " << summary.mean << ", \"p95_ms\": " << summary.p95
+                << ", \"instances_per_second\": " << instancesPerSecond << " }";
+        }
+    }
+    return true;
 }
 
-int main()
+// a small procedural image: a two-color checkerboard whose colors and cell size vary with index
+std::vector<unsigned char> make_sprite(const unsigned int index, const int width, const int height)
 {
-    GLFWwindow* window = initialize_window();
-    if (window == nullptr)
+    std::vector<unsigned char> pixels(static_cast<std::size_t>(width) * height * 4);
+    const unsigned int hash = index * 2654435761u;
+    const unsigned char colors[2][3] = {
+        { static_cast<unsigned char>(hash >> 24), static_cast<unsigned char>(hash >> 16), static_cast<unsigned char>(hash >> 8) },
+        { static_cast<unsigned char>(~hash >> 8), static_cast<unsigned char>(~hash >> 24), static_cast<unsigned char>(~hash >> 16) }
+    };
+    const int cell = 2 + static_cast<int>(index % 7);
+    for (int y = 0; y < height; ++y)
     {
-        return -1;
+        for (int x = 0; x < width; ++x)
+        {
+            unsigned char* pixel = &pixels[(static_cast<std::size_t>(y) * width + x) * 4];
+            const unsigned char* color = colors[(x / cell + y / cell) & 1];
+            pixel[0] = color[0];
+            pixel[1] = color[1];
+            pixel[2] = color[2];
+            pixel[3] = 255;
+        }
     }
+    return pixels;
+}
 
-    const Shader ourShader("shaders/shader.vs", "shaders/shader.fs");
+// draws a grid of quads cycling through the bundled textures (or --decode-file images) and a few
+// hundred generated sprites: first the way the scene does it, a texture bind and a draw per
+// quad, then every quad in one instanced draw reading a TextureAtlas. False when the window is
+// closed before both are measured
+bool run_atlas_benchmark(RenderContext& context, const LaunchOptions& options)
+{
+    constexpr std::size_t QUAD_COUNT = 10000;
+    constexpr unsigned int SPRITE_COUNT = 254;
+    struct Image
+    {
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+    };
+    std::vector<Image> images;
+    const std::vector<std::string> files = options.decodeFiles.empty()
+        ? std::vector<std::string>{ "assets/container.jpg", "assets/awesomeface.png" } : options.decodeFiles;
+    stbi_set_flip_vertically_on_load_thread(1);
+    for (const std::string& file : files)
+    {
+        int width, height, channels;
+        unsigned char* pixels = stbi_load(file.c_str(), &width, &height, &channels, 4);
+        if (pixels == nullptr)
+        {
+            std::cout << "Failed to load texture " << file << ": " << stbi_failure_reason() << '\n';
+            return false;
+        }
+        images.push_back({ width, height, std::vector<unsigned char>(pixels, pixels + static_cast<std::size_t>(width) * height * 4) });
+        stbi_image_free(pixels);
+    }
+    for (unsigned int sprite = 0; sprite < SPRITE_COUNT; ++sprite)
+    {
+        const int width = 16 + static_cast<int>(sprite * 37 % 113);
+        const int height = 16 + static_cast<int>(sprite * 53 % 97);
+        images.push_back({ width, height, make_sprite(sprite, width, height) });
+    }
 
-	// texture loading
-    unsigned int textures[2];
-    glGenTextures(2, textures);
-    // texture 1
-    // ---------
-    glBindTexture(GL_TEXTURE_2D, textures[0]);
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    // load image, create texture and generate mipmaps
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true); // tell stb_image.h to flip loaded texture's on the y-axis.
-    unsigned char* data = stbi_load("assets/container.jpg", &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+    // the same images both ways: one texture each, and packed into the atlas
+    TextureAtlas atlas;
+    std::vector<unsigned int> textures(images.size());
+    glGenTextures(static_cast<GLsizei>(textures.size()), textures.data());
+    for (std::size_t i = 0; i < images.size(); ++i)
+    {
+        if (atlas.add(images[i].pixels.data(), images[i].width, images[i].height) < 0)
+        {
+            std::cout << "Failed to add image " << i << " to the texture atlas" << '\n';
+            return false;
+        }
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, images[i].width, images[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, images[i].pixels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glGenerateMipmap(GL_TEXTURE_2D);
     }
-    else
+    if (!atlas.build())
+        return false;
+
+    std::vector<QuadInstance> instances = make_quad_grid(QUAD_COUNT);
+    for (std::size_t i = 0; i < instances.size(); ++i)
     {
-        std::cout << "Failed to load texture" << '\n';
+        instances[i].tint = glm::vec4(1.0f);
+        instances[i].image = static_cast<std::uint32_t>(i % images.size());
     }
-    stbi_image_free(data);
-    // texture 2
-    // ---------
-    glBindTexture(GL_TEXTURE_2D, textures[1]);
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    // load image, create texture and generate mipmaps
-    data = stbi_load("assets/awesomeface.png", &width, &height, &nrChannels, 0);
-    if (data)
-    {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    InstancedQuadRenderer renderer;
+    renderer.upload(instances.data(), instances.size());
+
+    const Shader separateShader("shaders/shader.vs", "shaders/shader.fs");
+    separateShader.use();
+    separateShader.setInt("texture1", 0);
+    separateShader.setInt("texture2", 0);
+    separateShader.setFloat("mixValue", 0.0f);
+    const int transformLocation = separateShader.uniformLocation("transform");
+    const Shader atlasShader("shaders/atlas.vs", "shaders/atlas.fs");
+    atlasShader.use();
+    atlasShader.setInt("atlas", 0);
+    TextureAtlas::attach(atlasShader.id);
+    context.setSwapInterval(0);
+
+    const unsigned long frames = options.benchmarkFrames != 0 ? options.benchmarkFrames : 30;
+    BenchmarkJson json(options.benchmarkJson);
+    for (const bool batched : { false, true })
+    {
+        GLStateCache glState;
+        std::size_t binds = 0, draws = 0;
+        std::vector<double> times;
+        times.reserve(frames);
+        // one unmeasured frame absorbs any lazy driver work
+        for (unsigned long frame = 0; frame <= frames; ++frame)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glState.bindVertexArray(renderer.vertexArray());
+            binds = draws = 0;
+            if (batched)
+            {
+                glState.useProgram(atlasShader.id);
+                atlas.bind(0);
+                renderer.draw();
+                binds = draws = 1;
+            }
+            else
+            {
+                glState.useProgram(separateShader.id);
+                unsigned int bound = 0;
+                for (const QuadInstance& instance : instances)
+                {
+                    // the cache drops the bind when neighbours share an image; with the grid cycling
+                    // through the images they never do
+                    glState.bindTexture(0, GL_TEXTURE_2D, textures[instance.image]);
+                    if (textures[instance.image] != bound)
+                        ++binds;
+                    bound = textures[instance.image];
+                    Shader::setMat4(transformLocation, instance.transform);
+                    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+                    ++draws;
+                }
+            }
+            if (!options.dumpDirectory.empty() && frame == frames)
+                context.dumpFrame(options.dumpDirectory + (batched ? "/atlas_batched.ppm" : "/atlas_separate.ppm"));
+            context.swapBuffers();
+            // wait for the GPU so the time covers the work actually done
+            glFinish();
+            if (frame != 0)
+                times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            context.pollEvents();
+            glState.endFrame();
+            if (context.shouldClose())
+            {
+                std::cout << "benchmark stopped: the window was closed" << '\n';
+                glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+                return false;
+            }
+        }
+
+        const FrameTimeSummary summary = FrameTimeSummary::from(times);
+        const char* name = batched ? "atlas" : "separate textures";
+        std::cout << name << ": " << instances.size() << " quads, " << images.size() << " images";
+        if (batched)
+            std::cout << " in " << atlas.layerCount() << " layers";
+        std::cout << ", " << binds << " texture binds and " << draws << " draws per frame: mean " << summary.mean
+            << " ms, p95 " << summary.p95 << " ms" << '\n';
+        if (json.enabled())
+        {
+            json.add() << "\"mode\": \"" << (batched ? "atlas" : "separate") << "\", \"binds\": " << binds << ", \"draws\": " << draws
+                << ", \"mean_ms\": " << summary.mean << ", \"p95_ms\": " << summary.p95 << " }";
+        }
+    }
+    glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+    return true;
+}
+
+// stb_image output callback handing out one growing buffer
+unsigned char* reuse_buffer(void* buffer, const int width, const int height, const int channels, int* stride)
+{
+    auto& pixels = *static_cast<std::vector<unsigned char>*>(buffer);
+    pixels.resize(static_cast<std::size_t>(width) * height * channels);
+    *stride = width * channels;
+    return pixels.data();
+}
+
+// decodes each image rounds times from memory, the way the texture loader does, and reports
+// how long stb_image takes; file I/O and GL are kept out of the measurement
+bool run_decode_benchmark(const LaunchOptions& options)
+{
+    std::vector<std::string> files = options.decodeFiles;
+    if (files.empty())
+        files = { "assets/container.jpg", "assets/awesomeface.png" };
+    BenchmarkJson json(options.benchmarkJson);
+
+    stbi_set_flip_vertically_on_load_thread(options.decodeFlip ? 1 : 0);
+    for (const std::string& file : files)
+    {
+        std::ifstream stream(file, std::ios::binary);
+        const std::vector<unsigned char> encoded((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+        if (encoded.empty())
+        {
+            std::cout << "Failed to read " << file << '\n';
+            return false;
+        }
+
+        std::vector<unsigned char> output;
+        std::vector<unsigned char> mipmaps;
+        int width = 0, height = 0, channels = 0;
+        bool failed = false;
+        const FrameTimeSummary summary = FrameTimeSummary::measure(options.decodeBenchmarkRounds, [&]
+        {
+            if (failed)
+                return;
+            unsigned char* pixels;
+            {
+                const ImageArena::Scope arena(options.imageArena);
+                if (options.decodePreview)
+                {
+                    pixels = static_cast<unsigned char*>(arena.keep(
+                        stbi_load_preview_from_memory(encoded.data(), static_cast<int>(encoded.size()), &width, &height, &channels, 0)));
+                }
+                else if (options.decodeInto)
+                {
+                    pixels = stbi_load_into_from_memory(encoded.data(), static_cast<int>(encoded.size()), &width, &height, &channels, 0,
+                        &reuse_buffer, &output) ? output.data() : nullptr;
+                }
+                else
+                {
+                    pixels = static_cast<unsigned char*>(arena.keep(
+                        stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), &width, &height, &channels, 0)));
+                }
+            }
+            if (pixels == nullptr)
+            {
+                failed = true;
+                return;
+            }
+            if (options.mipmapFilter != MipmapFilter::Driver)
+            {
+                // the loader writes the chain right behind the image, here it gets a buffer of its own
+                mipmaps.resize(MipmapGenerator::chainSize(width, height, channels) - static_cast<std::size_t>(width) * height * channels);
+                MipmapGenerator::generate(pixels, width, height, channels, options.mipmapFilter, true, mipmaps.data());
+            }
+            if (options.decodePreview || !options.decodeInto)
+                stbi_image_free(pixels);
+        });
+        if (failed)
+        {
+            std::cout << "Failed to decode " << file << ": " << stbi_failure_reason() << '\n';
+            return false;
+        }
+
+        const double megapixelsPerSecond = static_cast<double>(width) * height / (summary.mean / 1000.0) / 1.0e6;
+        std::cout << file << " (" << width << "x" << height << "): mean " << summary.mean << " ms, p50 "
+            << summary.p50 << " ms, p95 " << summary.p95 << " ms, " << megapixelsPerSecond << " MP/s" << '\n';
+        if (json.enabled())
+        {
+            json.add() << "\"file\": \"" << file << "\", \"width\": " << width << ", \"height\": " << height
+                << ", \"mean_ms\": " << summary.mean << ", \"p50_ms\": " << summary.p50 << ", \"p95_ms\": " << summary.p95
+                << ", \"megapixels_per_second\": " << megapixelsPerSecond << " }";
+        }
+    }
+    return true;
+}
+
+// transforms points by a view-projection matrix and multiplies it with model matrices, one
+// glm operator* at a time and then through every TransformBatch level the CPU supports, and
+// reports the time per element and how far each batch kernel strays from glm
+bool run_transform_benchmark(const LaunchOptions& options)
+{
+    const std::size_t count = options.transformCount;
+    const glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 4.0f / 3.0f, 0.1f, 1000.0f)
+        * glm::lookAt(glm::vec3(0.0f, 20.0f, 60.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    // scattered points and model matrices, the same every run
+    std::vector<glm::vec4> points(count);
+    std::vector<glm::mat4> models(count);
+    // the same without the scale
+    std::vector<glm::mat4> rigidModels(count);
+    std::vector<float> components(count * 4);
+    const Vec4Stream in = { &components[0], &components[count], &components[2 * count], nullptr };
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto t = static_cast<float>(i);
+        points[i] = glm::vec4(50.0f * std::sin(t * 0.37f), 20.0f * std::cos(t * 0.11f), std::fmod(t * 0.7f, 100.0f) - 50.0f, 1.0f);
+        in.x[i] = points[i].x;
+        in.y[i] = points[i].y;
+        in.z[i] = points[i].z;
+        rigidModels[i] = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(points[i])), t * 0.01f, glm::normalize(glm::vec3(1.0f, t, 2.0f)));
+        models[i] = glm::scale(rigidModels[i], glm::vec3(1.0f + std::fmod(t, 3.0f)));
+    }
+    std::vector<glm::vec4> glmPoints(count);
+    std::vector<glm::mat4> glmMatrices(count);
+    std::vector<float> transformed(count * 4);
+    const Vec4Stream out = { &transformed[0], &transformed[count], &transformed[2 * count], &transformed[3 * count] };
+    std::vector<glm::mat4> products(count);
+
+    BenchmarkJson json(options.benchmarkJson);
+    // check, when given, returns the error against glm once the rounds are done
+    const auto measure = [&](const std::string& name, const std::function<void()>& body, const std::function<double()>& check)
+    {
+        const FrameTimeSummary summary = FrameTimeSummary::measure(options.transformBenchmarkRounds, body);
+        const double nanoseconds = summary.p50 * 1.0e6 / static_cast<double>(count);
+        std::cout << name << ": p50 " << summary.p50 << " ms, " << nanoseconds << " ns per element";
+        if (check)
+            std::cout << ", at most " << check() << " ulp from glm";
+        std::cout << '\n';
+        if (json.enabled())
+        {
+            json.add() << "\"kernel\": \"" << name << "\", \"count\": " << count << ", \"p50_ms\": " << summary.p50
+                << ", \"ns_per_element\": " << nanoseconds << " }";
+        }
+    };
+
+    measure("glm mat4 * vec4", [&]
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            glmPoints[i] = viewProjection * points[i];
+    }, nullptr);
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    std::vector<glm::vec4> simdPoints(count);
+    measure("glm_mat4_mul_vec4", [&]
+    {
+        const glm_vec4 columns[4] = { viewProjection[0].data, viewProjection[1].data, viewProjection[2].data, viewProjection[3].data };
+        for (std::size_t i = 0; i < count; ++i)
+            simdPoints[i].data = glm_mat4_mul_vec4(columns, points[i].data);
+    }, [&] { return GlmValidation::ulpError(&simdPoints[0][0], &glmPoints[0][0], count); });
+#endif
+    const auto checkTransformed = [&]
+    {
+        std::vector<glm::vec4> gathered(count);
+        for (std::size_t i = 0; i < count; ++i)
+            gathered[i] = glm::vec4(out.x[i], out.y[i], out.z[i], out.w[i]);
+        return GlmValidation::ulpError(&gathered[0][0], &glmPoints[0][0], count);
+    };
+    for (int level = 0; level <= static_cast<int>(TransformBatch::supportedLevel()); ++level)
+    {
+        TransformBatch::limitLevel(static_cast<SimdLevel>(level));
+        const std::string name = std::string("batch transform, ") + TransformBatch::levelName(static_cast<SimdLevel>(level));
+        measure(name, [&] { TransformBatch::transform(viewProjection, in, out, count); }, checkTransformed);
+    }
+
+    measure("glm mat4 * mat4", [&]
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            glmMatrices[i] = viewProjection * models[i];
+    }, nullptr);
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    measure("glm_mat4_mul", [&]
+    {
+        const glm_vec4 columns[4] = { viewProjection[0].data, viewProjection[1].data, viewProjection[2].data, viewProjection[3].data };
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            glm_vec4 product[4];
+            glm_mat4_mul(columns, &models[i][0].data, product);
+            for (int c = 0; c < 4; ++c)
+                products[i][c].data = product[c];
+        }
+    }, [&] { return GlmValidation::ulpError(&products[0][0][0], &glmMatrices[0][0][0], count * 4); });
+#endif
+    for (int level = 0; level <= static_cast<int>(TransformBatch::supportedLevel()); ++level)
+    {
+        TransformBatch::limitLevel(static_cast<SimdLevel>(level));
+        const std::string name = std::string("batch multiply, ") + TransformBatch::levelName(static_cast<SimdLevel>(level));
+        measure(name, [&] { TransformBatch::multiply(viewProjection, models.data(), products.data(), count); },
+            [&] { return GlmValidation::ulpError(&products[0][0][0], &glmMatrices[0][0][0], count * 4); });
+    }
+
+    // the models scale, so they are affine; without the scale they are rigid
+    std::vector<glm::mat4> glmInverses(count);
+    measure("glm inverse", [&]
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            glmInverses[i] = glm::inverse(models[i]);
+    }, nullptr);
+    measure("glm affineInverse", [&]
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            products[i] = glm::affineInverse(models[i]);
+    }, [&] { return GlmValidation::ulpError(&products[0][0][0], &glmInverses[0][0][0], count * 4); });
+    std::vector<glm::mat4> glmRigidInverses(count);
+    for (std::size_t i = 0; i < count; ++i)
+        glmRigidInverses[i] = glm::inverse(rigidModels[i]);
+    const struct
+    {
+        MatrixKind kind;
+        const char* name;
+        const std::vector<glm::mat4>& matrices;
+        const std::vector<glm::mat4>& reference;
+    } inverses[] = {
+        { MatrixKind::General, "general", models, glmInverses },
+        { MatrixKind::Affine, "affine", models, glmInverses },
+        { MatrixKind::Rigid, "rigid", rigidModels, glmRigidInverses },
+    };
+    for (const auto& inverse : inverses)
+    {
+        for (int level = 0; level <= static_cast<int>(TransformBatch::supportedLevel()); ++level)
+        {
+            TransformBatch::limitLevel(static_cast<SimdLevel>(level));
+            const std::string name = std::string("batch inverse, ") + inverse.name + ", " + TransformBatch::levelName(static_cast<SimdLevel>(level));
+            measure(name, [&] { TransformBatch::inverse(inverse.matrices.data(), products.data(), count, inverse.kind); },
+                [&] { return GlmValidation::ulpError(&products[0][0][0], &inverse.reference[0][0][0], count * 4); });
+        }
+    }
+    TransformBatch::limitLevel(TransformBatch::supportedLevel());
+    return true;
+}
+
+// culls a million scattered spheres and boxes against a camera, on one thread with every
+// TransformBatch level the CPU supports and then with the widest level on several threads, and
+// reports the time per object and whether each run found the same objects as the scalar one;
+// false when any run didn't
+bool run_cull_benchmark(const LaunchOptions& options)
+{
+    const std::size_t count = options.cullCount;
+    constexpr StaticMat4 projection = StaticTransform::perspective(StaticTransform::radians(60.0f), 4.0f / 3.0f, 0.1f, 400.0f);
+    const glm::mat4 viewProjection = projection.toMat4()
+        * glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const FrustumCuller culler(viewProjection);
+    // objects scattered through a box around the camera, the same every run
+    std::vector<float> fields(count * 6);
+    float* centerX = &fields[0];
+    float* centerY = &fields[count];
+    float* centerZ = &fields[2 * count];
+    float* extentX = &fields[3 * count];
+    float* extentY = &fields[4 * count];
+    float* extentZ = &fields[5 * count];
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto t = static_cast<float>(i);
+        centerX[i] = 500.0f * std::sin(t * 0.37f);
+        centerY[i] = 500.0f * std::cos(t * 0.113f);
+        centerZ[i] = 500.0f * std::sin(t * 0.0071f + 1.0f);
+        extentX[i] = 0.5f + std::fmod(t * 0.61f, 5.0f);
+        extentY[i] = 0.5f + std::fmod(t * 0.29f, 5.0f);
+        extentZ[i] = 0.5f + std::fmod(t * 0.83f, 5.0f);
     }
-    else
+    const SphereStream spheres = { centerX, centerY, centerZ, extentX };
+    const BoxStream boxes = { centerX, centerY, centerZ, extentX, extentY, extentZ };
+    std::vector<std::uint32_t> visible(count), reference;
+
+    BenchmarkJson json(options.benchmarkJson);
+    bool allSame = true;
+    const auto measure = [&](const std::string& name, const std::function<std::size_t()>& cull, const bool isReference)
     {
-        std::cout << "Failed to load texture" << '\n';
+        std::size_t found = 0;
+        const FrameTimeSummary summary = FrameTimeSummary::measure(options.cullBenchmarkRounds, [&] { found = cull(); });
+        if (isReference)
+            reference.assign(visible.begin(), visible.begin() + static_cast<std::ptrdiff_t>(found));
+        const bool same = found == reference.size() && std::equal(reference.begin(), reference.end(), visible.begin());
+        allSame = allSame && same;
+        const double nanoseconds = summary.p50 * 1.0e6 / static_cast<double>(count);
+        std::cout << name << ": p50 " << summary.p50 << " ms, " << nanoseconds << " ns per object, " << found << " of " << count << " visible"
+            << (isReference ? "" : same ? ", same as scalar" : ", DIFFERS from scalar") << '\n';
+        if (json.enabled())
+        {
+            json.add() << "\"kernel\": \"" << name << "\", \"count\": " << count << ", \"visible\": " << found
+                << ", \"p50_ms\": " << summary.p50 << ", \"ns_per_object\": " << nanoseconds << " }";
+        }
+    };
+
+    // what cull actually splits the objects over, fewer than asked for when there are too few
+    const unsigned int threads = FrustumCuller::threadsUsed(count, options.cullThreads);
+    for (int shape = 0; shape < 2; ++shape)
+    {
+        const char* shapeName = shape == 0 ? "spheres" : "boxes";
+        const auto cull = [&](const unsigned int threadCount)
+        {
+            return shape == 0 ? culler.cull(spheres, count, visible.data(), threadCount) : culler.cull(boxes, count, visible.data(), threadCount);
+        };
+        for (int level = 0; level <= static_cast<int>(TransformBatch::supportedLevel()); ++level)
+        {
+            TransformBatch::limitLevel(static_cast<SimdLevel>(level));
+            measure(std::string("cull ") + shapeName + ", " + TransformBatch::levelName(static_cast<SimdLevel>(level)),
+                [&] { return cull(1); }, level == 0);
+        }
+        measure(std::string("cull ") + shapeName + ", " + TransformBatch::levelName(TransformBatch::supportedLevel()) + ", "
+            + std::to_string(threads) + " threads", [&] { return cull(threads); }, false);
     }
-    stbi_image_free(data);
+    TransformBatch::limitLevel(TransformBatch::supportedLevel());
+    return allSame;
+}
 
+// the compressed texture written for path: the same name with a .dds extension
+std::string compressed_path(const std::string& path)
+{
+    const std::size_t dot = path.find_last_of('.');
+    return (dot == std::string::npos ? path : path.substr(0, dot)) + ".dds";
+}
+
+// the offline half of the compressed texture path: bakes every image to BC1/BC3 and reports
+// how long that took and how much smaller the texture got
+bool run_texture_compressor(const LaunchOptions& options)
+{
+    std::vector<std::string> files = options.decodeFiles;
+    if (files.empty())
+        files = { "assets/container.jpg", "assets/awesomeface.png" };
+    for (const std::string& file : files)
+    {
+        const std::string destination = compressed_path(file);
+        const auto start = std::chrono::steady_clock::now();
+        if (!TextureCompressor::compressFile(file, destination, options.decodeFlip, options.mipmapFilter, options.compressThreads))
+            return false;
+        const double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::ifstream stream(destination, std::ios::binary);
+        unsigned char header[CompressedTextureInfo::HEADER_SIZE];
+        CompressedTextureInfo info;
+        if (!stream.read(reinterpret_cast<char*>(header), sizeof(header)) || !CompressedTextureInfo::parse(header, info))
+        {
+            std::cout << "Failed to read back " << destination << '\n';
+            return false;
+        }
+        int width, height, channels;
+        stbi_info(file.c_str(), &width, &height, &channels);
+        // what the uncompressed path keeps in video memory: the image plus a third for its mipmaps
+        const double uncompressed = static_cast<double>(width) * height * channels * 4.0 / 3.0;
+        std::cout << file << " -> " << destination << " (" << width << "x" << height << ", "
+            << (info.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? "BC1" : "BC3") << ", " << info.levels << " levels): "
+            << elapsed << " ms, " << info.dataSize() / 1024 << " KB, " << uncompressed / static_cast<double>(info.dataSize())
+            << "x smaller than uncompressed" << '\n';
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    LaunchOptions options;
+    options.context.width = SCR_WIDTH;
+    options.context.height = SCR_HEIGHT;
+    if (!parse_arguments(argc, argv, options))
+    {
+        return -1;
+    }
+    stbi_set_jpeg_thread_count(options.jpegThreads);
+    if (options.decodeBenchmarkRounds != 0)
+    {
+        return run_decode_benchmark(options) ? 0 : -1;
+    }
+    if (options.compressTextures)
+    {
+        return run_texture_compressor(options) ? 0 : -1;
+    }
+    if (options.transformBenchmarkRounds != 0)
+    {
+        return run_transform_benchmark(options) ? 0 : -1;
+    }
+    if (options.cullBenchmarkRounds != 0)
+    {
+        return run_cull_benchmark(options) ? 0 : -1;
+    }
+    if (options.glmCheck)
+    {
+        return GlmValidation::check(options.transformCount) ? 0 : -1;
+    }
+    if (options.glmBenchmarkRounds != 0)
+    {
+        GlmValidation::benchmark(options.glmBenchmarkRounds, options.benchmarkJson);
+        return 0;
+    }
+    if (options.imageCheck || options.imageBenchmarkRounds != 0)
+    {
+        std::vector<std::string> files = options.decodeFiles;
+        // the CMYK JPEG and the one with a restart marker every 7 MCUs are only there for the
+        // check: they take the decoder's rarer colour paths and split the threaded decode
+        // unevenly
+        if (files.empty())
+            files = { "assets/container.jpg", "assets/awesomeface.png", "assets/container_cmyk.jpg", "assets/container_restart.jpg" };
+        if (options.imageCheck)
+            return ImageValidation::check(files) ? 0 : -1;
+        ImageValidation::benchmark(options.imageBenchmarkRounds, files, options.benchmarkJson);
+        return 0;
+    }
+
+    RenderContext context;
+    if (!context.initialize(options.context))
+    {
+        return -1;
+    }
+
+    if (options.atlasBenchmark)
+    {
+        return run_atlas_benchmark(context, options) ? 0 : -1;
+    }
+
+    const Shader ourShader("shaders/shader.vs", "shaders/shader.fs");
+
+	// texture loading
+    // decode both images in parallel on worker threads, then upload them on this thread
+    const auto loadStart = std::chrono::steady_clock::now();
+    TextureLoader textureLoader(0, options.imageArena);
+    TextureParameters containerParameters;
+    containerParameters.wrapS = GL_CLAMP_TO_EDGE;
+    containerParameters.wrapT = GL_CLAMP_TO_EDGE;
+    containerParameters.progressive = options.streamTextures;
+    containerParameters.mipmapFilter = options.mipmapFilter;
+    TextureParameters faceParameters;
+    faceParameters.progressive = options.streamTextures;
+    faceParameters.mipmapFilter = options.mipmapFilter;
+    std::string containerPath = "assets/container.jpg";
+    std::string facePath = "assets/awesomeface.png";
+    if (options.compressedTextures)
+    {
+        if (TextureLoader::supportsCompressedTextures())
+        {
+            // fall back to the source image for anything that hasn't been compressed yet
+            for (std::string* path : { &containerPath, &facePath })
+            {
+                if (std::ifstream(compressed_path(*path)).good())
+                    *path = compressed_path(*path);
+                else
+                    std::cout << "No compressed texture for " << *path << ", run with --compress-textures first" << '\n';
+            }
+        }
+        else
+        {
+            std::cout << "S3TC texture compression is not supported, loading the uncompressed textures" << '\n';
+        }
+    }
+    unsigned int textures[2];
+    textures[0] = textureLoader.load(containerPath, containerParameters);
+    textures[1] = textureLoader.load(facePath, faceParameters);
+    // streamed textures are uploaded by the render loop as they arrive
+    if (!options.streamTextures || options.instancingBenchmark)
+        textureLoader.uploadAll();
+
+    if (options.instancingBenchmark)
+    {
+        return run_instancing_benchmark(context, textures, options) ? 0 : -1;
+    }
 
     // set up vertex data
     constexpr float vertices[] = {
@@ -137,7 +1043,7 @@ int main()
     glGenBuffers(1, &elementBufferObject);
 
     glBindVertexArray(vertexArrayObject);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexArrayObject);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBufferObject);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBufferObject);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
@@ -155,37 +1061,87 @@ int main()
     ourShader.use();
     ourShader.setInt("texture1", 0);
     ourShader.setInt("texture2", 1);
+    // resolve per-frame uniforms once, outside the render loop
+    const int transformLocation = ourShader.uniformLocation("transform");
+    const int mixValueLocation = ourShader.uniformLocation("mixValue");
 	float mixValue = 0.f;
-    while (!glfwWindowShouldClose(window))
+    unsigned long frame = 0;
+
+    // setup above bound state directly, so the cache starts out knowing nothing
+    GLStateCache glState;
+
+    std::unique_ptr<FrameBenchmark> benchmark;
+    if (options.benchmarkFrames != 0)
     {
-        process_input(window, mixValue);
+        context.setSwapInterval(0);
+        benchmark.reset(new FrameBenchmark(options.benchmarkFrames));
+    }
+    // benchmarks, headless runs and frame dumps animate on a fixed step instead of the wall
+    // clock, so the same arguments always render the same frames
+    const bool fixedClock = benchmark || options.context.headless || !options.dumpDirectory.empty();
+    while (!context.shouldClose())
+    {
+        if (benchmark)
+            benchmark->beginFrame();
+        process_input(context.window, mixValue);
+        if (textureLoader.pendingCount() != 0 && textureLoader.uploadReady() != 0)
+        {
+            // the loader binds textures behind the cache's back
+            glState.invalidate();
+            if (textureLoader.pendingCount() == 0)
+            {
+                std::cout << "textures complete after " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count()
+                    << " ms (frame " << frame << ")" << '\n';
+            }
+        }
 
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 		
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textures[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, textures[1]);
+        glState.bindTexture(0, GL_TEXTURE_2D, textures[0]);
+        glState.bindTexture(1, GL_TEXTURE_2D, textures[1]);
 
         auto transformation = glm::mat4(1.0f);
         // transformation = translate(transformation, glm::vec3(0.5f, -0.5f, 0.0f));
-        transformation = rotate(transformation, static_cast<float>(glfwGetTime()), glm::vec3(0.0f, 0.0f, 1.0f));
-        glUniformMatrix4fv(glGetUniformLocation(ourShader.id, "transform"), 1, GL_FALSE, value_ptr(transformation));
-        ourShader.setFloat("mixValue", mixValue);
+        const double time = fixedClock ? static_cast<double>(frame) * FrameBenchmark::FIXED_TIME_STEP : context.time();
+        transformation = rotate(transformation, static_cast<float>(time), glm::vec3(0.0f, 0.0f, 1.0f));
+        Shader::setMat4(transformLocation, transformation);
+        Shader::setFloat(mixValueLocation, mixValue);
 
-        ourShader.use();
-        glBindVertexArray(vertexArrayObject);
+        glState.useProgram(ourShader.id);
+        glState.bindVertexArray(vertexArrayObject);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
 
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        if (!options.dumpDirectory.empty())
+            context.dumpFrame(frame_dump_path(options.dumpDirectory, frame));
+
+        context.swapBuffers();
+        if (options.streamTextures && frame == 0)
+            std::cout << "first frame after " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count() << " ms" << '\n';
+        context.pollEvents();
+        glState.endFrame();
+        if (benchmark)
+        {
+            benchmark->endFrame();
+            if (benchmark->done())
+                context.requestClose();
+        }
+        ++frame;
+        if (options.frameLimit != 0 && frame >= options.frameLimit)
+            context.requestClose();
+    }
+    if (benchmark)
+    {
+        benchmark->finish(options.benchmarkJson);
+        const GLStateCache::Counters& calls = glState.totalCounters();
+        const double frames = static_cast<double>(glState.frameCount());
+        std::cout << "state cache: " << static_cast<double>(calls.issued) / frames << " calls issued, "
+            << static_cast<double>(calls.avoided) / frames << " avoided per frame" << '\n';
     }
 
     glDeleteVertexArrays(1, &vertexArrayObject);
     glDeleteBuffers(1, &vertexBufferObject);
     glDeleteBuffers(1, &elementBufferObject);
 
-    glfwTerminate();
     return 0;
 }
@@ -0,0 +1,348 @@
+#include "mipmap_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "stb_image/stb_image.h"
+
+#if !defined(MIPMAP_GENERATOR_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MIPMAP_GENERATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    constexpr int MAX_TAPS = 8;
+    // the linear to sRGB table is indexed by the top bits of the linear value
+    constexpr int ENCODE_TABLE_SIZE = 4096;
+
+    // output pixel i of a 2x reduction covers source pixels 2i + first ... 2i + first + taps - 1
+    struct Kernel
+    {
+        int taps;
+        int first;
+        float weights[MAX_TAPS];
+    };
+
+    double bessel_i0(const double x)
+    {
+        // the power series converges quickly for the arguments a Kaiser window needs
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    Kernel make_kernel(const MipmapFilter filter)
+    {
+        if (filter != MipmapFilter::Kaiser)
+            return { 2, 0, { 0.5f, 0.5f } };
+
+        // sinc at half the source rate, windowed over two output pixels either side
+        constexpr double PI = 3.14159265358979323846;
+        constexpr double ALPHA = 4.0;
+        Kernel kernel = { MAX_TAPS, -MAX_TAPS / 2 + 1, {} };
+        double total = 0.0;
+        double weights[MAX_TAPS];
+        for (int k = 0; k < MAX_TAPS; ++k)
+        {
+            // distance from the output pixel's center, in source pixels
+            const double distance = k + kernel.first + 0.5 - 1.0;
+            const double x = distance / 2.0;
+            const double sinc = std::fabs(x) < 1e-9 ? 1.0 : std::sin(PI * x) / (PI * x);
+            const double t = distance / (MAX_TAPS / 2.0);
+            const double window = bessel_i0(ALPHA * std::sqrt(std::max(0.0, 1.0 - t * t))) / bessel_i0(ALPHA);
+            weights[k] = sinc * window;
+            total += weights[k];
+        }
+        for (int k = 0; k < MAX_TAPS; ++k)
+            kernel.weights[k] = static_cast<float>(weights[k] / total);
+        return kernel;
+    }
+
+    struct ConversionTables
+    {
+        float srgbToLinear[256];
+        float unormToFloat[256];
+        // smallest sRGB code whose range may hold a linear value, and the linear value halfway
+        // between each code and the next, to settle the rest
+        unsigned char encodeStart[ENCODE_TABLE_SIZE + 1];
+        float encodeThresholds[256];
+
+        ConversionTables()
+        {
+            const auto decode = [](const double encoded)
+            {
+                return encoded <= 0.04045 ? encoded / 12.92 : std::pow((encoded + 0.055) / 1.055, 2.4);
+            };
+            for (int i = 0; i < 256; ++i)
+            {
+                srgbToLinear[i] = static_cast<float>(decode(i / 255.0));
+                unormToFloat[i] = static_cast<float>(i / 255.0);
+                encodeThresholds[i] = i < 255 ? static_cast<float>(decode((i + 0.5) / 255.0)) : 2.0f;
+            }
+            int code = 0;
+            for (int i = 0; i <= ENCODE_TABLE_SIZE; ++i)
+            {
+                const float linear = static_cast<float>(i) / ENCODE_TABLE_SIZE;
+                while (code < 255 && linear >= encodeThresholds[code])
+                    ++code;
+                encodeStart[i] = static_cast<unsigned char>(code);
+            }
+        }
+
+        unsigned char encodeSrgb(const float linear) const
+        {
+            if (!(linear > 0.0f))
+                return 0;
+            if (linear >= 1.0f)
+                return 255;
+            int code = encodeStart[static_cast<int>(linear * ENCODE_TABLE_SIZE)];
+            while (linear >= encodeThresholds[code])
+                ++code;
+            return static_cast<unsigned char>(code);
+        }
+    };
+
+    const ConversionTables& tables()
+    {
+        static const ConversionTables instance;
+        return instance;
+    }
+
+    unsigned char encode_unorm(const float value)
+    {
+        return static_cast<unsigned char>(std::min(255.0f, std::max(0.0f, value * 255.0f + 0.5f)));
+    }
+
+    // one 2x reduction. Source rows are converted to floats once each, into a ring with a slot
+    // per tap, then filtered vertically into one row and horizontally into the output row
+    class LevelFilter
+    {
+    public:
+        LevelFilter(const int width, const int channels, const Kernel& kernel, const bool srgb, const bool simd)
+            : width(width), channels(channels), kernel(kernel), srgb(srgb), simd(simd),
+              // every float row is padded so that a 3-channel pixel can be loaded as four floats
+              rowLength(static_cast<std::size_t>(width) * channels + 4),
+              ring(rowLength * kernel.taps), ringRows(kernel.taps, -1), column(rowLength), filtered(rowLength)
+        {
+        }
+
+        void filterRow(const unsigned char* source, const int sourceHeight, const int y, unsigned char* out)
+        {
+            const float* rows[MAX_TAPS];
+            for (int k = 0; k < kernel.taps; ++k)
+            {
+                const int sourceY = std::min(std::max(2 * y + kernel.first + k, 0), sourceHeight - 1);
+                rows[k] = convertedRow(source, sourceY);
+            }
+            const int outWidth = std::max(1, width / 2);
+            if (kernel.taps == 2)
+            {
+                filterVertically<2>(rows);
+                filterHorizontally<2>(outWidth);
+            }
+            else
+            {
+                filterVertically<MAX_TAPS>(rows);
+                filterHorizontally<MAX_TAPS>(outWidth);
+            }
+            encode(outWidth, out);
+        }
+
+    private:
+        int width;
+        int channels;
+        Kernel kernel;
+        bool srgb;
+        // use the SSE2 loops; the scalar ones give the same bytes, summing in the same order
+        bool simd;
+        std::size_t rowLength;
+        std::vector<float> ring;
+        std::vector<int> ringRows;
+        std::vector<float> column;
+        std::vector<float> filtered;
+
+        bool isAlpha(const int channel) const
+        {
+            return (channels == 2 || channels == 4) && channel == channels - 1;
+        }
+
+        const float* convertedRow(const unsigned char* source, const int y)
+        {
+            // the rows one output row needs are consecutive, so they never share a slot
+            const int slot = y % kernel.taps;
+            float* row = &ring[slot * rowLength];
+            if (ringRows[slot] != y)
+            {
+                const ConversionTables& table = tables();
+                const unsigned char* pixels = source + static_cast<std::size_t>(y) * width * channels;
+                for (int c = 0; c < channels; ++c)
+                {
+                    const float* lookup = srgb && !isAlpha(c) ? table.srgbToLinear : table.unormToFloat;
+                    for (int x = c; x < width * channels; x += channels)
+                        row[x] = lookup[pixels[x]];
+                }
+                ringRows[slot] = y;
+            }
+            return row;
+        }
+
+        // the tap count is a template parameter so that the tap loops unroll
+        template <int TAPS>
+        void filterVertically(const float* const* rows)
+        {
+            const int count = width * channels;
+            int i = 0;
+#ifdef MIPMAP_GENERATOR_SSE2
+            __m128 weights[TAPS];
+            for (int k = 0; k < TAPS; ++k)
+                weights[k] = _mm_set1_ps(kernel.weights[k]);
+            for (; simd && i + 4 <= count; i += 4)
+            {
+                __m128 sum = _mm_mul_ps(_mm_loadu_ps(rows[0] + i), weights[0]);
+                for (int k = 1; k < TAPS; ++k)
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), weights[k]));
+                _mm_storeu_ps(&column[i], sum);
+            }
+#endif
+            for (; i < count; ++i)
+            {
+                float sum = rows[0][i] * kernel.weights[0];
+                for (int k = 1; k < TAPS; ++k)
+                    sum += rows[k][i] * kernel.weights[k];
+                column[i] = sum;
+            }
+        }
+
+        template <int TAPS>
+        void filterHorizontally(const int outWidth)
+        {
+            // output pixels whose taps all fall inside the row skip the edge clamping
+            const int interiorBegin = std::min(outWidth, (-kernel.first + 1) / 2);
+            const int lastStart = width - TAPS - kernel.first;     // 2x may go up to this
+            const int interiorEnd = lastStart < 0 ? interiorBegin : std::max(interiorBegin, std::min(outWidth, lastStart / 2 + 1));
+            filterHorizontallyClamped<TAPS>(0, interiorBegin);
+#ifdef MIPMAP_GENERATOR_SSE2
+            if (simd && channels >= 3)
+            {
+                // a whole pixel per register; for three channels the fourth lane is the next
+                // pixel's first value, overwritten when that pixel is stored
+                __m128 weights[TAPS];
+                for (int k = 0; k < TAPS; ++k)
+                    weights[k] = _mm_set1_ps(kernel.weights[k]);
+                for (int x = interiorBegin; x < interiorEnd; ++x)
+                {
+                    const float* source = &column[(2 * x + kernel.first) * channels];
+                    __m128 sum = _mm_mul_ps(_mm_loadu_ps(source), weights[0]);
+                    for (int k = 1; k < TAPS; ++k)
+                        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(source + k * channels), weights[k]));
+                    _mm_storeu_ps(&filtered[x * channels], sum);
+                }
+                filterHorizontallyClamped<TAPS>(interiorEnd, outWidth);
+                return;
+            }
+#endif
+            for (int x = interiorBegin; x < interiorEnd; ++x)
+            {
+                const float* source = &column[(2 * x + kernel.first) * channels];
+                for (int c = 0; c < channels; ++c)
+                {
+                    float sum = source[c] * kernel.weights[0];
+                    for (int k = 1; k < TAPS; ++k)
+                        sum += source[k * channels + c] * kernel.weights[k];
+                    filtered[x * channels + c] = sum;
+                }
+            }
+            filterHorizontallyClamped<TAPS>(interiorEnd, outWidth);
+        }
+
+        template <int TAPS>
+        void filterHorizontallyClamped(const int begin, const int end)
+        {
+            for (int x = begin; x < end; ++x)
+            {
+                for (int c = 0; c < channels; ++c)
+                {
+                    float sum = column[std::min(std::max(2 * x + kernel.first, 0), width - 1) * channels + c] * kernel.weights[0];
+                    for (int k = 1; k < TAPS; ++k)
+                    {
+                        const int sourceX = std::min(std::max(2 * x + kernel.first + k, 0), width - 1);
+                        sum += column[sourceX * channels + c] * kernel.weights[k];
+                    }
+                    filtered[x * channels + c] = sum;
+                }
+            }
+        }
+
+        void encode(const int outWidth, unsigned char* out) const
+        {
+            const ConversionTables& table = tables();
+            for (int c = 0; c < channels; ++c)
+            {
+                const bool linear = srgb && !isAlpha(c);
+                for (int x = c; x < outWidth * channels; x += channels)
+                    out[x] = linear ? table.encodeSrgb(filtered[x]) : encode_unorm(filtered[x]);
+            }
+        }
+    };
+}
+
+int MipmapGenerator::levelCount(const int width, const int height)
+{
+    int levels = 1;
+    while ((std::max(width, height) >> levels) != 0)
+        ++levels;
+    return levels;
+}
+
+std::size_t MipmapGenerator::chainSize(int width, int height, const int channels)
+{
+    std::size_t size = 0;
+    const int levels = levelCount(width, height);
+    for (int level = 0; level < levels; ++level)
+    {
+        size += static_cast<std::size_t>(width) * height * channels;
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+    }
+    return size;
+}
+
+void MipmapGenerator::generate(const unsigned char* pixels, int width, int height, const int channels, const MipmapFilter filter,
+    const bool srgb, unsigned char* levels)
+{
+    const Kernel kernel = make_kernel(filter);
+    // the SSE2 loops follow the SIMD level stb_image's decoders use, so --image-check can run
+    // the scalar ones against them
+#ifdef MIPMAP_GENERATOR_SSE2
+    const bool simd = stbi_simd_level() >= STBI_simd_sse2;
+#else
+    const bool simd = false;
+#endif
+    // each level is filtered from a heap copy of the one above, never from levels
+    std::vector<unsigned char> current, next;
+    const unsigned char* source = pixels;
+    const int levelTotal = levelCount(width, height);
+    for (int level = 1; level < levelTotal; ++level)
+    {
+        const int outWidth = std::max(1, width / 2);
+        const int outHeight = std::max(1, height / 2);
+        const std::size_t outRow = static_cast<std::size_t>(outWidth) * channels;
+        next.resize(outRow * outHeight);
+        LevelFilter levelFilter(width, channels, kernel, srgb, simd);
+        for (int y = 0; y < outHeight; ++y)
+            levelFilter.filterRow(source, height, y, &next[y * outRow]);
+        std::memcpy(levels, next.data(), next.size());
+        levels += next.size();
+        current.swap(next);
+        source = current.data();
+        width = outWidth;
+        height = outHeight;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+
+
+enum class MipmapFilter
+{
+    Driver,     // glGenerateMipmap on the GL thread, whatever the driver does
+    Box,        // 2x2 average
+    Kaiser,     // 8-tap Kaiser-windowed sinc, keeps distant levels sharper than the box
+};
+
+// builds mip chains on the CPU, so they can be made on the loader threads and uploaded in one
+// go with the base level instead of costing a glGenerateMipmap on the GL thread. Each level is
+// filtered from the one above it, a row at a time in floats, four values at a time with SSE2
+// where available (MIPMAP_GENERATOR_NO_SIMD turns that off at build time, stbi_set_simd_level
+// at run time; both give the same bytes).
+class MipmapGenerator
+{
+public:
+    // levels down to 1x1, the base level included
+    static int levelCount(int width, int height);
+    // bytes of every level, base included, tightly packed one after the other
+    static std::size_t chainSize(int width, int height, int channels);
+
+    // writes levels 1 and up of the image at pixels to levels, tightly packed one after the
+    // other. With srgb the color channels are filtered in linear light and stored sRGB-encoded
+    // again; the last channel of 2- and 4-channel images is alpha and always filtered as it is.
+    // levels is only ever written, so it may point into write-combined GPU memory
+    static void generate(const unsigned char* pixels, int width, int height, int channels, MipmapFilter filter,
+        bool srgb, unsigned char* levels);
+};
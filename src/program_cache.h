@@ -0,0 +1,150 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <limits>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+
+// on-disk cache of linked program binaries (glGetProgramBinary/glProgramBinary). Entries are
+// keyed by the shader sources and the driver's vendor, renderer and version strings, so a
+// driver update or a source edit simply misses instead of loading a stale binary.
+class ProgramCache
+{
+public:
+    // where cache files live; an empty directory disables the cache
+    static std::string& directory()
+    {
+        static std::string cacheDirectory = "shader_cache";
+        return cacheDirectory;
+    }
+
+    // program binaries need GL 4.1 (or ARB_get_program_binary) and at least one binary format
+    static bool supported()
+    {
+        if (directory().empty() || glGetProgramBinary == nullptr || glProgramBinary == nullptr)
+            return false;
+        int formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    static std::uint64_t key(const std::string& vertexCode, const std::string& fragmentCode)
+    {
+        std::uint64_t h = 14695981039346656037ull;
+        const auto mix = [&h](const char* data, const std::size_t length)
+        {
+            for (std::size_t i = 0; i < length; ++i)
+            {
+                h ^= static_cast<unsigned char>(data[i]);
+                h *= 1099511628211ull;
+            }
+            // separator so "ab"+"c" and "a"+"bc" hash differently
+            h ^= 0xff;
+            h *= 1099511628211ull;
+        };
+        mix(vertexCode.data(), vertexCode.size());
+        mix(fragmentCode.data(), fragmentCode.size());
+        for (const GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        {
+            const auto* value = reinterpret_cast<const char*>(glGetString(name));
+            if (value != nullptr)
+                mix(value, std::strlen(value));
+        }
+        return h;
+    }
+
+    // replaces the contents of an unlinked program with the cached binary; false on a miss or
+    // when the driver rejects the binary, in which case the caller compiles from source
+    static bool load(const unsigned int program, const std::uint64_t key)
+    {
+        std::ifstream file(path(key), std::ios::binary);
+        if (!file)
+            return false;
+        Header header{};
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, magic(), sizeof(header.magic)) != 0 || header.key != key)
+            return false;
+        // the length comes from disk, so a truncated or corrupt file must not get to allocate
+        // more than the file still holds
+        const std::streamoff start = file.tellg();
+        file.seekg(0, std::ios::end);
+        const std::streamoff remaining = file.tellg() - start;
+        file.seekg(start);
+        if (header.length == 0 || static_cast<std::streamoff>(header.length) > remaining ||
+            header.length > static_cast<std::uint32_t>(std::numeric_limits<int>::max()))
+            return false;
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), static_cast<std::streamsize>(binary.size())))
+            return false;
+
+        glProgramBinary(program, header.format, binary.data(), static_cast<int>(binary.size()));
+        int success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success != 0;
+    }
+
+    // writes a successfully linked program's binary to the cache
+    static void store(const unsigned int program, const std::uint64_t key)
+    {
+        int length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(static_cast<std::size_t>(length));
+        GLenum format = 0;
+        glGetProgramBinary(program, length, &length, &format, binary.data());
+
+        makeDirectory(directory());
+        std::ofstream file(path(key), std::ios::binary | std::ios::trunc);
+        if (!file)
+            return;
+        Header header{};
+        std::memcpy(header.magic, magic(), sizeof(header.magic));
+        header.key = key;
+        header.format = format;
+        header.length = static_cast<std::uint32_t>(length);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+    }
+
+private:
+    // identifies cache files written by this format version (first 8 bytes of the file)
+    static const char* magic() { return "LOGLPRG1"; }
+
+    struct Header
+    {
+        char magic[8];
+        std::uint64_t key;
+        std::uint32_t format;
+        std::uint32_t length;
+    };
+
+    static std::string path(const std::uint64_t key)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+        return directory() + "/" + name;
+    }
+
+    static void makeDirectory(const std::string& path)
+    {
+#ifdef _WIN32
+        _mkdir(path.c_str());
+#else
+        mkdir(path.c_str(), 0755);
+#endif
+    }
+};
@@ -0,0 +1,271 @@
+#include "render_context.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#if LEARNOPENGL_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+namespace
+{
+    double steady_seconds()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+bool RenderContext::initialize(const ContextOptions& options)
+{
+    headless = options.headless;
+    closeRequested = false;
+    framebufferWidth = options.width;
+    framebufferHeight = options.height;
+
+    const bool initialized = headless ? initializeHeadless(options) : initializeWindow(options);
+    if (!initialized)
+    {
+        terminate();
+        return false;
+    }
+    startTime = steady_seconds();
+    return true;
+}
+
+bool RenderContext::initializeWindow(const ContextOptions& options)
+{
+    glfwInit();
+    glfwInitialized = true;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    window = glfwCreateWindow(static_cast<int>(options.width), static_cast<int>(options.height), options.title, nullptr, nullptr);
+    if (window == nullptr)
+    {
+        std::cout << "Failed to create GLFW window" << '\n';
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+    // the framebuffer can be larger than the window on high-DPI displays
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    framebufferWidth = static_cast<unsigned int>(width);
+    framebufferHeight = static_cast<unsigned int>(height);
+    glfwSetWindowUserPointer(window, this);
+    glfwSetFramebufferSizeCallback(window, frameBufferSizeCallback);
+
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(glfwGetProcAddress)))  // NOLINT(clang-diagnostic-cast-function-type-strict)
+    {
+        std::cout << "Failed to initialize GLAD" << '\n';
+        return false;
+    }
+    return true;
+}
+
+#if LEARNOPENGL_HEADLESS_EGL
+bool RenderContext::initializeHeadless(const ContextOptions& options)
+{
+    (void)options;
+    // prefer Mesa's surfaceless platform: it needs neither a display server nor a GPU
+    EGLDisplay display = EGL_NO_DISPLAY;
+    const auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    if (getPlatformDisplay != nullptr)
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+    {
+        std::cout << "Failed to initialize EGL display" << '\n';
+        return false;
+    }
+    eglDisplay = display;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+    {
+        std::cout << "Failed to bind the OpenGL API through EGL" << '\n';
+        return false;
+    }
+
+    // EGL_SURFACE_TYPE defaults to EGL_WINDOW_BIT, which surfaceless displays never offer
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+    {
+        std::cout << "Failed to find an EGL config" << '\n';
+        return false;
+    }
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    const EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT)
+    {
+        std::cout << "Failed to create EGL context" << '\n';
+        return false;
+    }
+    eglContext = context;
+
+    // no surface at all: everything is drawn into our own framebuffer object
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+    {
+        std::cout << "Failed to make the surfaceless EGL context current" << '\n';
+        return false;
+    }
+
+    if (!gladLoadGLLoader(reinterpret_cast<GLADloadproc>(eglGetProcAddress)))  // NOLINT(clang-diagnostic-cast-function-type-strict)
+    {
+        std::cout << "Failed to initialize GLAD" << '\n';
+        return false;
+    }
+    return createOffscreenTarget();
+}
+#else
+bool RenderContext::initializeHeadless(const ContextOptions& options)
+{
+    (void)options;
+    std::cout << "Headless rendering is not supported on this platform" << '\n';
+    return false;
+}
+#endif
+
+bool RenderContext::createOffscreenTarget()
+{
+    const auto width = static_cast<int>(framebufferWidth);
+    const auto height = static_cast<int>(framebufferHeight);
+
+    glGenRenderbuffers(1, &colorRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Offscreen framebuffer is not complete" << '\n';
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    return true;
+}
+
+void RenderContext::terminate()
+{
+    if (framebuffer != 0)
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteRenderbuffers(1, &colorRenderbuffer);
+        glDeleteRenderbuffers(1, &depthRenderbuffer);
+        framebuffer = colorRenderbuffer = depthRenderbuffer = 0;
+    }
+#if LEARNOPENGL_HEADLESS_EGL
+    if (eglDisplay != nullptr)
+    {
+        eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (eglContext != nullptr)
+            eglDestroyContext(eglDisplay, eglContext);
+        eglTerminate(eglDisplay);
+    }
+#endif
+    eglDisplay = nullptr;
+    eglContext = nullptr;
+    if (glfwInitialized)
+    {
+        glfwTerminate();
+        glfwInitialized = false;
+    }
+    window = nullptr;
+}
+
+bool RenderContext::shouldClose() const
+{
+    if (closeRequested)
+        return true;
+    return window != nullptr && glfwWindowShouldClose(window);
+}
+
+void RenderContext::requestClose()
+{
+    closeRequested = true;
+    if (window != nullptr)
+        glfwSetWindowShouldClose(window, true);
+}
+
+void RenderContext::swapBuffers()
+{
+    if (window != nullptr)
+        glfwSwapBuffers(window);
+    else
+        glFlush();
+}
+
+void RenderContext::setSwapInterval(const int interval)
+{
+    if (window != nullptr)
+        glfwSwapInterval(interval);
+}
+
+void RenderContext::pollEvents()
+{
+    if (window != nullptr)
+        glfwPollEvents();
+}
+
+double RenderContext::time() const
+{
+    return steady_seconds() - startTime;
+}
+
+bool RenderContext::dumpFrame(const std::string& path) const
+{
+    const auto width = static_cast<int>(framebufferWidth);
+    const auto height = static_cast<int>(framebufferHeight);
+    std::vector<unsigned char> pixels(static_cast<std::size_t>(width) * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "Failed to open " << path << " for writing" << '\n';
+        return false;
+    }
+    file << "P6\n" << width << ' ' << height << "\n255\n";
+    // GL rows start at the bottom, PPM rows at the top
+    const std::size_t rowSize = static_cast<std::size_t>(width) * 3;
+    for (int y = height - 1; y >= 0; --y)
+        file.write(reinterpret_cast<const char*>(pixels.data() + y * rowSize), static_cast<std::streamsize>(rowSize));
+    return static_cast<bool>(file);
+}
+
+void RenderContext::frameBufferSizeCallback(GLFWwindow* window, const int width, const int height)
+{
+    auto* context = static_cast<RenderContext*>(glfwGetWindowUserPointer(window));
+    if (context != nullptr)
+    {
+        context->framebufferWidth = static_cast<unsigned int>(width);
+        context->framebufferHeight = static_cast<unsigned int>(height);
+    }
+    glViewport(0, 0, width, height);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <string>
+
+// headless rendering goes through a surfaceless EGL context (Mesa picks llvmpipe when
+// there is no GPU). Linux builds need to link against libEGL.
+#if !defined(LEARNOPENGL_HEADLESS_EGL) && defined(__linux__)
+#define LEARNOPENGL_HEADLESS_EGL 1
+#endif
+
+
+struct ContextOptions
+{
+    unsigned int width = 800;
+    unsigned int height = 600;
+    const char* title = "LearnOpenGL";
+    // render into an offscreen framebuffer instead of opening a window
+    bool headless = false;
+};
+
+// owns the GL context and the default render target: a GLFW window, or an FBO backed by
+// a surfaceless EGL context when running headless (CI, render servers).
+class RenderContext
+{
+public:
+    // null when headless
+    GLFWwindow* window = nullptr;
+
+    RenderContext() = default;
+    RenderContext(const RenderContext&) = delete;
+    RenderContext& operator=(const RenderContext&) = delete;
+    ~RenderContext() { terminate(); }
+
+    // creates the context, makes it current and loads GL through glad
+    bool initialize(const ContextOptions& options);
+    void terminate();
+
+    bool isHeadless() const { return headless; }
+    unsigned int width() const { return framebufferWidth; }
+    unsigned int height() const { return framebufferHeight; }
+
+    bool shouldClose() const;
+    void requestClose();
+    void swapBuffers();
+    // 0 disables vsync; ignored when headless since there is nothing to sync to
+    void setSwapInterval(int interval);
+    void pollEvents();
+    // seconds since initialization
+    double time() const;
+
+    // reads back the current render target and writes it as a binary PPM
+    bool dumpFrame(const std::string& path) const;
+
+private:
+    bool headless = false;
+    bool closeRequested = false;
+    bool glfwInitialized = false;
+    unsigned int framebufferWidth = 0;
+    unsigned int framebufferHeight = 0;
+
+    // offscreen render target used in headless mode
+    unsigned int framebuffer = 0;
+    unsigned int colorRenderbuffer = 0;
+    unsigned int depthRenderbuffer = 0;
+
+    // EGL handles, kept opaque so the EGL headers stay out of this header
+    void* eglDisplay = nullptr;
+    void* eglContext = nullptr;
+    double startTime = 0.0;
+
+    bool initializeWindow(const ContextOptions& options);
+    bool initializeHeadless(const ContextOptions& options);
+    bool createOffscreenTarget();
+
+    static void frameBufferSizeCallback(GLFWwindow* window, int width, int height);
+};
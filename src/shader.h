@@ -2,11 +2,18 @@
 
 #include <glad/glad.h> // include glad to get all the required OpenGL headers
 
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "program_cache.h"
+#include "static_transform.h"
+#include "uniform_table.h"
 
 class Shader
 {
@@ -48,7 +55,38 @@ public:
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
 
-        // 2. compile shaders
+        // 2. load the linked program from the binary cache, or compile and cache it
+        id = glCreateProgram();
+        const bool cacheable = ProgramCache::supported();
+        const std::uint64_t cacheKey = cacheable ? ProgramCache::key(vertexCode, fragmentCode) : 0;
+        if (!cacheable || !ProgramCache::load(id, cacheKey))
+        {
+            compile(vShaderCode, fShaderCode, cacheable);
+            if (cacheable && isLinked())
+                ProgramCache::store(id, cacheKey);
+        }
+        cacheUniformLocations();
+    }
+	~Shader() { glDeleteProgram(id); }
+    // use/activate the shader
+    void use() const { glUseProgram(id); }
+    // look up a uniform location once, then pass it to the setters below in the hot path
+    int uniformLocation(const std::string& name) const { return uniforms.find(name); }
+    // utility uniform functions (by cached location)
+    static void setBool(const int location, const bool value) { glUniform1i(location, static_cast<int>(value)); }
+    static void setInt(const int location, const int value) { glUniform1i(location, value); }
+    static void setFloat(const int location, const float value) { glUniform1f(location, value); }
+    static void setMat4(const int location, const glm::mat4& value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+    static void setMat4(const int location, const StaticMat4& value) { glUniformMatrix4fv(location, 1, GL_FALSE, value.data()); }
+    // utility uniform functions (by name, resolved through the cache)
+    void setBool(const std::string& name, const bool value) const { setBool(uniformLocation(name), value); }
+    void setInt(const std::string& name, const int value) const { setInt(uniformLocation(name), value); }
+    void setFloat(const std::string& name, const float value) const { setFloat(uniformLocation(name), value); }
+    void setMat4(const std::string& name, const glm::mat4& value) const { setMat4(uniformLocation(name), value); }
+
+private:
+    void compile(const char* vShaderCode, const char* fShaderCode, const bool retrievable)
+    {
         unsigned int vertex, fragment;
 
         // vertex Shader
@@ -64,7 +102,11 @@ public:
         checkCompileErrors(fragment, "FRAGMENT");
 
     	// shader Program
-    	id = glCreateProgram();
+        // a rejected cached binary may have left the program in a failed state, start clean
+        glDeleteProgram(id);
+        id = glCreateProgram();
+        if (retrievable)
+            glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glAttachShader(id, vertex);
         glAttachShader(id, fragment);
         glLinkProgram(id);
@@ -74,15 +116,53 @@ public:
         glDeleteShader(vertex);
         glDeleteShader(fragment);
     }
-	~Shader() { glDeleteProgram(id); }
-    // use/activate the shader
-    void use() const { glUseProgram(id); }
-    // utility uniform functions
-    void setBool(const std::string& name, const bool value) const { glUniform1i(glGetUniformLocation(id, name.c_str()), static_cast<int>(value)); }
-    void setInt(const std::string& name, const int value) const { glUniform1i(glGetUniformLocation(id, name.c_str()), value); }
-    void setFloat(const std::string& name, const float value) const { glUniform1f(glGetUniformLocation(id, name.c_str()), value); }
 
-private:
+    bool isLinked() const
+    {
+        int success = 0;
+        glGetProgramiv(id, GL_LINK_STATUS, &success);
+        return success != 0;
+    }
+
+    // active uniform name -> location, filled after linking
+    UniformTable uniforms;
+
+    // query every active uniform once so setters never call glGetUniformLocation
+    void cacheUniformLocations()
+    {
+        uniforms.clear();
+        int count = 0;
+        int maxLength = 0;
+        glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (int i = 0; i < count; ++i)
+        {
+            int length = 0;
+            int size = 0;
+            GLenum type;
+            glGetActiveUniform(id, static_cast<unsigned int>(i), maxLength, &length, &size, &type, &name[0]);
+            std::string uniformName(name.data(), length);
+            const int location = glGetUniformLocation(id, uniformName.c_str());
+            if (location < 0)
+                continue;   // uniform block member, not settable through glUniform*
+            uniforms.insert(uniformName, location);
+
+            // arrays are reported as "name[0]": also register "name" and every element
+            const std::size_t bracket = uniformName.rfind("[0]");
+            if (bracket != std::string::npos && bracket + 3 == uniformName.size())
+            {
+                const std::string base = uniformName.substr(0, bracket);
+                uniforms.insert(base, location);
+                for (int element = 1; element < size; ++element)
+                {
+                    const std::string elementName = base + "[" + std::to_string(element) + "]";
+                    uniforms.insert(elementName, glGetUniformLocation(id, elementName.c_str()));
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     static void checkCompileErrors(const unsigned int shader, const std::string& type)
     {
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+
+// a 4x4 matrix laid out like glm::mat4, 16 floats column after column (element (column c,
+// row r) at 4c + r), that can be built in a constant expression. glm's own types can't be:
+// glm turns constexpr off whenever it uses intrinsics, as the x64 builds do
+struct StaticMat4
+{
+    float elements[16];
+
+    constexpr float at(const int column, const int row) const { return elements[4 * column + row]; }
+    const float* data() const { return elements; }
+    glm::mat4 toMat4() const { return glm::make_mat4(elements); }
+};
+
+// constexpr versions of glm's identity, translate, scale, rotate, ortho and perspective, with the
+// same formulas and the same handedness and depth range glm is configured for, so fixed
+// transforms (scenery that never moves, UI projections) can be baked into read-only data:
+//     constexpr StaticMat4 projection = StaticTransform::ortho(0.0f, 800.0f, 0.0f, 600.0f);
+// They may be called at run time as well. Sines, cosines and square roots are evaluated in
+// double precision by series and Newton's method, so results may differ from glm's in the last bit.
+class StaticTransform
+{
+public:
+    static constexpr double PI = 3.14159265358979323846;
+
+    static constexpr float radians(const float degrees) { return static_cast<float>(degrees * (PI / 180.0)); }
+
+    static constexpr StaticMat4 identity()
+    {
+        return { { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f } };
+    }
+
+    // a * b
+    static constexpr StaticMat4 multiply(const StaticMat4& a, const StaticMat4& b)
+    {
+        StaticMat4 result{};
+        for (int c = 0; c < 4; ++c)
+        {
+            for (int r = 0; r < 4; ++r)
+                result.elements[4 * c + r] = a.at(0, r) * b.at(c, 0) + a.at(1, r) * b.at(c, 1) + a.at(2, r) * b.at(c, 2) + a.at(3, r) * b.at(c, 3);
+        }
+        return result;
+    }
+
+    // m * a translation by (x, y, z), as glm::translate(m, vec3(x, y, z))
+    static constexpr StaticMat4 translate(const StaticMat4& m, const float x, const float y, const float z)
+    {
+        StaticMat4 result = m;
+        for (int r = 0; r < 4; ++r)
+            result.elements[12 + r] = m.at(0, r) * x + m.at(1, r) * y + m.at(2, r) * z + m.at(3, r);
+        return result;
+    }
+
+    // m * a scale by (x, y, z), as glm::scale(m, vec3(x, y, z))
+    static constexpr StaticMat4 scale(const StaticMat4& m, const float x, const float y, const float z)
+    {
+        StaticMat4 result = m;
+        const float factors[3] = { x, y, z };
+        for (int c = 0; c < 3; ++c)
+        {
+            for (int r = 0; r < 4; ++r)
+                result.elements[4 * c + r] = m.at(c, r) * factors[c];
+        }
+        return result;
+    }
+
+    // m * a rotation by angle radians around (x, y, z), which need not be normalized, as
+    // glm::rotate(m, angle, vec3(x, y, z))
+    static constexpr StaticMat4 rotate(const StaticMat4& m, const float angle, const float x, const float y, const float z)
+    {
+        const float c = static_cast<float>(cosine(angle));
+        const float s = static_cast<float>(sine(angle));
+        const double length = squareRoot(static_cast<double>(x) * x + static_cast<double>(y) * y + static_cast<double>(z) * z);
+        const float axis[3] = { static_cast<float>(x / length), static_cast<float>(y / length), static_cast<float>(z / length) };
+        const float temp[3] = { (1.0f - c) * axis[0], (1.0f - c) * axis[1], (1.0f - c) * axis[2] };
+        const float rotation[3][3] = {
+            { c + temp[0] * axis[0], temp[0] * axis[1] + s * axis[2], temp[0] * axis[2] - s * axis[1] },
+            { temp[1] * axis[0] - s * axis[2], c + temp[1] * axis[1], temp[1] * axis[2] + s * axis[0] },
+            { temp[2] * axis[0] + s * axis[1], temp[2] * axis[1] - s * axis[0], c + temp[2] * axis[2] },
+        };
+        StaticMat4 result = m;
+        for (int column = 0; column < 3; ++column)
+        {
+            for (int r = 0; r < 4; ++r)
+                result.elements[4 * column + r] = m.at(0, r) * rotation[column][0] + m.at(1, r) * rotation[column][1] + m.at(2, r) * rotation[column][2];
+        }
+        return result;
+    }
+
+    // as glm::ortho(left, right, bottom, top): depth is left alone, for 2D and UI
+    static constexpr StaticMat4 ortho(const float left, const float right, const float bottom, const float top)
+    {
+        StaticMat4 result = identity();
+        result.elements[0] = 2.0f / (right - left);
+        result.elements[5] = 2.0f / (top - bottom);
+        result.elements[10] = -1.0f;
+        result.elements[12] = -(right + left) / (right - left);
+        result.elements[13] = -(top + bottom) / (top - bottom);
+        return result;
+    }
+
+    // as glm::ortho(left, right, bottom, top, zNear, zFar)
+    static constexpr StaticMat4 ortho(const float left, const float right, const float bottom, const float top, const float zNear, const float zFar)
+    {
+        StaticMat4 result = ortho(left, right, bottom, top);
+#if GLM_CONFIG_CLIP_CONTROL & GLM_CLIP_CONTROL_ZO_BIT
+        result.elements[10] = 1.0f / (zFar - zNear);
+        result.elements[14] = -zNear / (zFar - zNear);
+#else
+        result.elements[10] = 2.0f / (zFar - zNear);
+        result.elements[14] = -(zFar + zNear) / (zFar - zNear);
+#endif
+#if !(GLM_CONFIG_CLIP_CONTROL & GLM_CLIP_CONTROL_LH_BIT)
+        result.elements[10] = -result.elements[10];
+#endif
+        return result;
+    }
+
+    // as glm::perspective(fovy, aspect, zNear, zFar), fovy in radians
+    static constexpr StaticMat4 perspective(const float fovy, const float aspect, const float zNear, const float zFar)
+    {
+        const float tanHalfFovy = static_cast<float>(sine(fovy / 2.0f) / cosine(fovy / 2.0f));
+        StaticMat4 result{};
+        result.elements[0] = 1.0f / (aspect * tanHalfFovy);
+        result.elements[5] = 1.0f / tanHalfFovy;
+#if GLM_CONFIG_CLIP_CONTROL & GLM_CLIP_CONTROL_ZO_BIT
+        result.elements[10] = zFar / (zFar - zNear);
+        result.elements[14] = -(zFar * zNear) / (zFar - zNear);
+#else
+        result.elements[10] = (zFar + zNear) / (zFar - zNear);
+        result.elements[14] = -(2.0f * zFar * zNear) / (zFar - zNear);
+#endif
+        result.elements[11] = 1.0f;
+#if !(GLM_CONFIG_CLIP_CONTROL & GLM_CLIP_CONTROL_LH_BIT)
+        // right-handed: the camera looks down -z
+        result.elements[10] = -result.elements[10];
+        result.elements[11] = -1.0f;
+#endif
+        return result;
+    }
+
+private:
+    // x reduced to -pi ... pi, where the series below converge quickly
+    static constexpr double reduceAngle(const double x)
+    {
+        const double turns = x / (2.0 * PI);
+        const auto nearest = static_cast<long long>(turns < 0.0 ? turns - 0.5 : turns + 0.5);
+        return x - static_cast<double>(nearest) * (2.0 * PI);
+    }
+
+    static constexpr double sine(const double angle)
+    {
+        const double x = reduceAngle(angle);
+        double term = x, sum = x;
+        for (int n = 1; n < 14; ++n)
+        {
+            term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+            sum += term;
+        }
+        return sum;
+    }
+
+    static constexpr double cosine(const double angle)
+    {
+        const double x = reduceAngle(angle);
+        double term = 1.0, sum = 1.0;
+        for (int n = 1; n < 14; ++n)
+        {
+            term *= -x * x / ((2.0 * n - 1.0) * (2.0 * n));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Newton's method from above, which only ever steps down until it settles
+    static constexpr double squareRoot(const double x)
+    {
+        if (!(x > 0.0))
+            return 0.0;
+        double guess = x > 1.0 ? x : 1.0;
+        for (int i = 0; i < 1100; ++i)
+        {
+            const double next = 0.5 * (guess + x / guess);
+            if (!(next < guess))
+                break;
+            guess = next;
+        }
+        return guess;
+    }
+};
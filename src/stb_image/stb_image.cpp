@@ -1,2 +1,8 @@
+#include "../image_arena.h"
+
+// decode scratch comes from a per-thread arena while an ImageArena::Scope is alive
+#define STBI_MALLOC(size) ImageArena::allocate(size)
+#define STBI_REALLOC(pointer, size) ImageArena::reallocate(pointer, size)
+#define STBI_FREE(pointer) ImageArena::release(pointer)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
\ No newline at end of file
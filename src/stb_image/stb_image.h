@@ -259,7 +259,8 @@ RECENT REVISION HISTORY:
 //
 // The JPEG decoder will try to automatically use SIMD kernels on x86 when
 // supported by the compiler. For ARM Neon support, you must explicitly
-// request it.
+// request it. On x86 the PNG decoder also undoes the row filters of 8-bit
+// RGB and RGBA images with SIMD code.
 //
 // (The old do-it-yourself SIMD API is no longer supported in the current
 // code.)
@@ -276,6 +277,80 @@ RECENT REVISION HISTORY:
 //
 // ===========================================================================
 //
+// Multithreaded JPEG decoding
+//
+// Call stbi_set_jpeg_thread_count(n) with n > 1 to let the JPEG decoder use
+// up to n threads for large images (64K pixels and up). The output is
+// bit-identical to the single-threaded decoder:
+//
+//  - the IDCT, upsampling and color conversion are always split into
+//    bands of MCU rows, one band per thread;
+//  - baseline JPEGs with restart markers (DRI) that are decoded from
+//    memory also split the entropy-coded data at the restart markers,
+//    so the huffman decoding itself runs in parallel.
+//
+// Threads are started per image with pthreads or the Windows CRT; define
+// STBI_NO_THREADS to compile this out, in which case the setting is ignored.
+// The default thread count is 1, which decodes on the calling thread only.
+//
+// ===========================================================================
+//
+// Fast inflate
+//
+// While enough input and output space is left, the zlib decoder (PNG IDAT
+// data and the stbi_zlib_* functions) runs a faster inner loop: the bit
+// buffer is refilled 64 bits at a time, a single table lookup can decode a
+// pair of literals or a length code with its extra-bit count, and matches are
+// copied 8 or 16 bytes at a time. The last few hundred bytes of input and
+// output, and anything the fast loop can't handle, go through the original
+// symbol-at-a-time loop, so valid streams decode to the same bytes as before
+// (on truncated streams the point where the missing data is noticed can
+// shift by a few bytes, since it depends on the bit buffer refill pattern).
+// The fast loop may write up to 16 bytes past the current output position
+// (never past the end of the output buffer). Define STBI_NO_FAST_INFLATE to
+// use only the original loop, or call stbi_set_fast_inflate(0) to switch to
+// it at run time, e.g. to compare the two on the same files.
+//
+// ===========================================================================
+//
+// Decoding into your own buffer
+//
+// stbi_load_into_from_memory and stbi_load_into_mapped decode into memory
+// you provide, e.g. a mapped pixel buffer object, instead of returning a
+// block for you to copy and free. As soon as the image size is known, your
+// callback is asked for the destination:
+//
+//    stbi_uc *output(void *user, int x, int y, int channels, int *stride);
+//
+// It returns where the top-left pixel of x*y pixels of 'channels' 8-bit
+// components goes and sets *stride to the distance in bytes between the
+// starts of consecutive rows (at least x*channels). Returning NULL fails the
+// load. With stbi_set_flip_vertically_on_load the bottom row ends up first.
+//
+// Baseline and progressive JPEGs and non-interlaced 8-bit-or-less PNGs
+// without a palette or tRNS chunk write their rows straight into the
+// destination; everything else is decoded as usual and copied once.
+//
+// ===========================================================================
+//
+// Previews
+//
+// stbi_load_preview_from_memory and stbi_load_preview_mapped decode a
+// reduced-size version of an image, something to show while the full image
+// is still loading. The preview is 1/8 scale in each direction, (x+7)/8 by
+// (y+7)/8 pixels, and is only available where the format makes it cheap:
+//
+//    - JPEG: one pixel per 8x8 block, taken from its DC coefficient. The
+//      inverse DCT, most of the upsampling and color conversion are skipped;
+//      a progressive JPEG's AC scans aren't even huffman-decoded
+//    - interlaced PNG: the first Adam7 pass, which is every 8th pixel of
+//      every 8th row; only the start of the zlib stream is inflated
+//
+// Other images fail with "no preview"; load them in full instead. Previews
+// honor stbi_set_flip_vertically_on_load and the requested channel count.
+//
+// ===========================================================================
+//
 // HDR image support   (disable by defining STBI_NO_HDR)
 //
 // stb_image supports loading HDR images in general, and currently the Radiance
@@ -427,6 +502,26 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk  , void
 STBIDEF stbi_uc *stbi_load            (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
 STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
 // for stbi_load_from_file, file pointer is left pointing immediately after image
+STBIDEF stbi_uc *stbi_load_mapped     (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
+// stbi_load_mapped memory-maps the file and decodes straight from the mapping,
+// like stbi_load_from_memory; it falls back to stbi_load_from_file where
+// mapping isn't available (define STBI_NO_MMAP to always fall back)
+#endif
+
+// decode into a buffer supplied by the callback (see "Decoding into your own
+// buffer" above); these return 1 on success and 0 on failure
+typedef stbi_uc *stbi_output_callback(void *user, int x, int y, int channels, int *stride);
+
+STBIDEF int stbi_load_into_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, stbi_output_callback *output, void *user);
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_into_mapped     (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, stbi_output_callback *output, void *user);
+#endif
+
+// 1/8-scale previews of JPEGs and interlaced PNGs (see "Previews" above);
+// *x and *y receive the preview's size
+STBIDEF stbi_uc *stbi_load_preview_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels);
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_uc *stbi_load_preview_mapped     (char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
 #endif
 
 #ifndef STBI_NO_GIF
@@ -514,7 +609,9 @@ STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultipl
 // or just pass them through "as-is"
 STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 
-// flip the image vertically, so the first pixel in the output array is the bottom left
+// flip the image vertically, so the first pixel in the output array is the bottom left.
+// The PNG, JPEG, BMP and TGA loaders write their rows bottom up as they decode; the
+// other formats are flipped in a pass over the finished image
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
 // as above, but only applies to images loaded on the thread that calls the function
@@ -524,8 +621,39 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// decode large JPEGs on up to thread_count threads (default 1, the calling thread only)
+STBIDEF void stbi_set_jpeg_thread_count(int thread_count);
+
+// caps the SIMD kernels the JPEG decoder and the PNG unfilter pick at run time,
+// so each level can be compared with the others on one machine:
+// STBI_simd_scalar keeps them on the portable C code, STBI_simd_sse2 allows the
+// SSE2 (or, for JPEG, NEON) kernels, and STBI_simd_avx2, the default, also the
+// AVX2 ones. Images already being decoded keep the kernels they started with
+enum
+{
+   STBI_simd_scalar = 0,
+   STBI_simd_sse2   = 1,
+   STBI_simd_avx2   = 2
+};
+STBIDEF void stbi_set_simd_level(int level);
+// the widest level the decoders use on this CPU under that cap
+STBIDEF int  stbi_simd_level(void);
+
+// the JPEG kernels stbi_simd_level selects, for checking them against the scalar
+// ones and timing them on their own; not defined under STBI_NO_JPEG
+typedef struct
+{
+   void     (*idct_block)(stbi_uc *out, int out_stride, short data[64]);
+   void     (*YCbCr_to_RGB)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
+   stbi_uc *(*resample_row_hv_2)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+} stbi_jpeg_kernels;
+STBIDEF int  stbi_get_jpeg_kernels(stbi_jpeg_kernels *kernels);
+
 // ZLIB client - used by PNG, available for other purposes
 
+// flag_true_if_fast is 1 by default; 0 makes streams that start decoding
+// afterwards use only the original inflate loop (see "Fast inflate" above)
+STBIDEF void  stbi_set_fast_inflate(int flag_true_if_fast);
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
 STBIDEF char *stbi_zlib_decode_malloc_guesssize_headerflag(const char *buffer, int len, int initial_size, int *outlen, int parse_header);
 STBIDEF char *stbi_zlib_decode_malloc(const char *buffer, int len, int *outlen);
@@ -638,17 +766,40 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
    #endif
 #endif
 
+#if !defined(STBI_NO_THREADS) && !defined(STBI_NO_JPEG)
+   #if defined(_WIN32)
+      #define STBI__THREADS_WIN32
+      #include <process.h>  // _beginthreadex
+   #elif defined(__unix__) || defined(__APPLE__)
+      #define STBI__THREADS_PTHREAD
+      #include <pthread.h>
+   #endif
+#endif
+
+#if !defined(STBI_NO_STDIO) && !defined(STBI_NO_MMAP)
+   #if defined(_WIN32)
+      #define STBI__MMAP_WIN32
+      #include <io.h>  // _get_osfhandle, _filelengthi64
+   #elif defined(__unix__) || defined(__APPLE__)
+      #define STBI__MMAP_POSIX
+      #include <sys/mman.h>
+      #include <sys/stat.h>
+   #endif
+#endif
+
 #if defined(_MSC_VER) || defined(__SYMBIAN32__)
 typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -750,7 +901,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -761,7 +912,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -774,6 +925,48 @@ static int stbi__sse2_available(void)
 #endif
 #endif
 
+// AVX2 kernels are compiled next to the SSE2 ones and picked at run time,
+// so the rest of the library doesn't need to be built with -mavx2. GCC and
+// Clang get them through per-function target attributes.
+#if defined(STBI_SSE2) && !defined(STBI_NO_AVX2) && (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && \
+    ((defined(_MSC_VER) && _MSC_VER >= 1800) || defined(__clang__) || \
+     (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define STBI_AVX2
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define STBI__AVX2_TARGET
+
+static int stbi__avx2_available(void)
+{
+   int info[4];
+   __cpuid(info,0);
+   if (info[0] < 7) return 0;
+   __cpuid(info,1);
+   // the OS has to save the ymm registers: OSXSAVE, then XCR0 bits 1 and 2
+   if (((info[2] >> 27) & 1) == 0 || (_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info,7,0);
+   return ((info[1] >> 5) & 1) != 0;
+}
+#else
+#include <cpuid.h>
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+
+static int stbi__avx2_available(void)
+{
+   unsigned int a,b,c,d, xcr0_lo, xcr0_hi;
+   if (__get_cpuid_max(0, NULL) < 7) return 0;
+   __cpuid(1, a,b,c,d);
+   if (((c >> 27) & 1) == 0) return 0;
+   __asm__ ("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+   STBI_NOTUSED(xcr0_hi);
+   if ((xcr0_lo & 6) != 6) return 0;
+   __cpuid_count(7, 0, a,b,c,d);
+   return ((b >> 5) & 1) != 0;
+}
+#endif
+#endif
+
 // ARM NEON
 #if defined(STBI_NO_SIMD) && defined(STBI_NEON)
 #undef STBI_NEON
@@ -792,6 +985,27 @@ static int stbi__sse2_available(void)
 #define STBI_SIMD_ALIGN(type, name) type name
 #endif
 
+static int stbi__simd_level_cap = STBI_simd_avx2;
+
+STBIDEF void stbi_set_simd_level(int level)
+{
+   stbi__simd_level_cap = level < STBI_simd_scalar ? STBI_simd_scalar : level > STBI_simd_avx2 ? STBI_simd_avx2 : level;
+}
+
+STBIDEF int stbi_simd_level(void)
+{
+   int level = STBI_simd_scalar;
+#if defined(STBI_SSE2) && (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG))
+   if (stbi__sse2_available()) level = STBI_simd_sse2;
+#elif defined(STBI_NEON)
+   level = STBI_simd_sse2;
+#endif
+#ifdef STBI_AVX2
+   if (level == STBI_simd_sse2 && stbi__simd_level_cap == STBI_simd_avx2 && stbi__avx2_available()) level = STBI_simd_avx2;
+#endif
+   return level < stbi__simd_level_cap ? level : stbi__simd_level_cap;
+}
+
 #ifndef STBI_MAX_DIMENSIONS
 #define STBI_MAX_DIMENSIONS (1 << 24)
 #endif
@@ -817,6 +1031,10 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   stbi_output_callback *output; // set by stbi_load_into_*, NULL when the loader allocates
+   void *output_user;
+   int preview;                  // set by stbi_load_preview_*
 } stbi__context;
 
 
@@ -830,6 +1048,8 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
    s->callback_already_read = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
    s->img_buffer_end = s->img_buffer_original_end = (stbi_uc *) buffer+len;
+   s->output = NULL;
+   s->preview = 0;
 }
 
 // initialize a callback-based context
@@ -843,6 +1063,8 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
    s->img_buffer = s->img_buffer_original = s->buffer_start;
    stbi__refill_buffer(s);
    s->img_buffer_original_end = s->img_buffer_end;
+   s->output = NULL;
+   s->preview = 0;
 }
 
 #ifndef STBI_NO_STDIO
@@ -903,6 +1125,8 @@ typedef struct
    int bits_per_channel;
    int num_channels;
    int channel_order;
+   int in_output; // the loader wrote straight into the stbi_load_into_* destination
+   int flipped;   // the loader already wrote the rows bottom up
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
@@ -1141,6 +1365,17 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
    ri->channel_order = STBI_ORDER_RGB; // all current input & output are this, but this is here so we can add BGR order
    ri->num_channels = 0;
 
+   if (s->preview) {
+      // only these formats have a cheap reduced-size decode
+      #ifndef STBI_NO_PNG
+      if (stbi__png_test(s))  return stbi__png_load(s,x,y,comp,req_comp, ri);
+      #endif
+      #ifndef STBI_NO_JPEG
+      if (stbi__jpeg_test(s)) return stbi__jpeg_load(s,x,y,comp,req_comp, ri);
+      #endif
+      return stbi__errpuc("no preview", "Image format has no reduced-size decode");
+   }
+
    // test the formats with a very explicit header first (at least a FOURCC
    // or distinctive magic number first)
    #ifndef STBI_NO_PNG
@@ -1257,6 +1492,68 @@ static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int byt
 }
 #endif
 
+// where a loader writes the rows of its output: row j of the image goes to
+// first + j*step. A flipped load starts at the bottom row and steps back, so
+// no separate flip pass is needed. image is the block to return, which is the
+// caller's buffer for stbi_load_into_*
+typedef struct
+{
+   stbi_uc *image;
+   stbi_uc *first;
+   ptrdiff_t step;
+   int in_output; // image is the stbi_load_into_* destination
+   int flipped;   // stbi_set_flip_vertically_on_load is taken care of
+} stbi__rows;
+
+// n is the channel count (16-bit images pass bytes per pixel; they are never final).
+// final says nothing converts the rows afterwards; only then can they go to the
+// caller's buffer. Otherwise they stay in a block of the loader's own, unflipped
+// when stbi__copy_to_output will flip them on the way to the caller
+static int stbi__start_rows(stbi__context *s, stbi__rows *rows, int w, int h, int n, int add, int final)
+{
+   ptrdiff_t stride;
+   if (!stbi__mad3sizes_valid(w, h, n, add)) return stbi__err("too large", "Image too large to decode");
+   rows->in_output = s->output && final;
+   rows->flipped = stbi__vertically_flip_on_load && (rows->in_output || !s->output);
+   if (rows->in_output) {
+      int output_stride = 0;
+      rows->image = s->output(s->output_user, w, h, n, &output_stride);
+      if (!rows->image) return stbi__err("no output", "Output callback gave no buffer");
+      if (output_stride < w*n) return stbi__err("bad stride", "Output rows overlap");
+      stride = output_stride;
+   } else {
+      rows->image = (stbi_uc *) stbi__malloc(w*h*n + add);
+      if (!rows->image) return stbi__err("outofmem", "Out of memory");
+      stride = w*n;
+   }
+   rows->first = rows->flipped && h > 0 ? rows->image + stride * (h-1) : rows->image;
+   rows->step = rows->flipped ? -stride : stride;
+   return 1;
+}
+
+#if !defined(STBI_NO_JPEG) || !defined(STBI_NO_BMP) || !defined(STBI_NO_TGA)
+static void stbi__free_rows(stbi__rows *rows)
+{
+   if (!rows->in_output) STBI_FREE(rows->image);
+}
+#endif
+
+// moves an image some loader decoded into its own block to the stbi_load_into_* destination
+static stbi_uc *stbi__copy_to_output(stbi__context *s, stbi_uc *image, int w, int h, int n)
+{
+   stbi__rows rows;
+   size_t row_bytes = (size_t) w * n;
+   int j;
+   if (!stbi__start_rows(s, &rows, w, h, n, 0, 1)) {
+      STBI_FREE(image);
+      return NULL;
+   }
+   for (j=0; j < h; ++j)
+      memcpy(rows.first + rows.step*j, image + row_bytes*j, row_bytes);
+   STBI_FREE(image);
+   return rows.image;
+}
+
 static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
@@ -1275,7 +1572,14 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 
    // @TODO: move stbi__convert_format to here
 
-   if (stbi__vertically_flip_on_load) {
+   if (s->output) {
+      // the flip is part of the row order of the caller's buffer
+      if (!ri.in_output)
+         result = stbi__copy_to_output(s, (stbi_uc *) result, *x, *y, req_comp ? req_comp : *comp);
+      return (unsigned char *) result;
+   }
+
+   if (stbi__vertically_flip_on_load && !ri.flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
    }
@@ -1302,7 +1606,7 @@ static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x,
    // @TODO: move stbi__convert_format16 to here
    // @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-   if (stbi__vertically_flip_on_load) {
+   if (stbi__vertically_flip_on_load && !ri.flipped) {
       int channels = req_comp ? req_comp : *comp;
       stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
    }
@@ -1409,6 +1713,116 @@ STBIDEF stbi_us *stbi_load_16(char const *filename, int *x, int *y, int *comp, i
    return result;
 }
 
+#if defined(STBI__MMAP_WIN32)
+STBI_EXTERN __declspec(dllimport) void * __stdcall CreateFileMappingA(void *file, void *attributes, unsigned long protect, unsigned long size_high, unsigned long size_low, const char *name);
+STBI_EXTERN __declspec(dllimport) void * __stdcall MapViewOfFile(void *mapping, unsigned long access, unsigned long offset_high, unsigned long offset_low, size_t bytes);
+STBI_EXTERN __declspec(dllimport) int __stdcall UnmapViewOfFile(const void *address);
+STBI_EXTERN __declspec(dllimport) int __stdcall CloseHandle(void *handle);
+#endif
+
+// maps all of f read-only; returns NULL for empty files, files too big for the
+// int-sized memory path, and anything that can't be mapped (pipes, etc.)
+static void *stbi__map_file(FILE *f, int *len)
+{
+#if defined(STBI__MMAP_WIN32)
+   void *mapping, *data;
+   __int64 size = _filelengthi64(_fileno(f));
+   if (size <= 0 || size > INT_MAX) return NULL;
+   mapping = CreateFileMappingA((void *) _get_osfhandle(_fileno(f)), NULL, 0x02 /* PAGE_READONLY */, 0, 0, NULL);
+   if (!mapping) return NULL;
+   data = MapViewOfFile(mapping, 0x0004 /* FILE_MAP_READ */, 0, 0, 0);
+   CloseHandle(mapping); // the view keeps the mapping alive
+   *len = (int) size;
+   return data;
+#elif defined(STBI__MMAP_POSIX)
+   void *data;
+   struct stat st;
+   if (fstat(fileno(f), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > INT_MAX) return NULL;
+   data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+   if (data == MAP_FAILED) return NULL;
+   // decoders read front to back, so ask for aggressive read-ahead
+   madvise(data, (size_t) st.st_size, MADV_SEQUENTIAL);
+   madvise(data, (size_t) st.st_size, MADV_WILLNEED);
+   *len = (int) st.st_size;
+   return data;
+#else
+   STBI_NOTUSED(f);
+   STBI_NOTUSED(len);
+   return NULL;
+#endif
+}
+
+static void stbi__unmap_file(void *data, int len)
+{
+#if defined(STBI__MMAP_WIN32)
+   STBI_NOTUSED(len);
+   UnmapViewOfFile(data);
+#elif defined(STBI__MMAP_POSIX)
+   munmap(data, (size_t) len);
+#else
+   STBI_NOTUSED(data);
+   STBI_NOTUSED(len);
+#endif
+}
+
+STBIDEF stbi_uc *stbi_load_mapped(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   unsigned char *result;
+   void *data;
+   int len = 0;
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   data = stbi__map_file(f, &len);
+   if (data) {
+      result = stbi_load_from_memory((stbi_uc const *) data, len, x, y, comp, req_comp);
+      stbi__unmap_file(data, len);
+   } else {
+      result = stbi_load_from_file(f,x,y,comp,req_comp);
+   }
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_into_mapped(char const *filename, int *x, int *y, int *comp, int req_comp, stbi_output_callback *output, void *user)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   void *data;
+   int len = 0, result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   data = stbi__map_file(f, &len);
+   if (data)
+      stbi__start_mem(&s, (stbi_uc const *) data, len);
+   else
+      stbi__start_file(&s, f);
+   s.output = output;
+   s.output_user = user;
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp) != NULL;
+   if (data) stbi__unmap_file(data, len);
+   fclose(f);
+   return result;
+}
+
+STBIDEF stbi_uc *stbi_load_preview_mapped(char const *filename, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   stbi__context s;
+   unsigned char *result;
+   void *data;
+   int len = 0;
+   if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+   data = stbi__map_file(f, &len);
+   if (data)
+      stbi__start_mem(&s, (stbi_uc const *) data, len);
+   else
+      stbi__start_file(&s, f);
+   s.preview = 1;
+   result = stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+   if (data) stbi__unmap_file(data, len);
+   fclose(f);
+   return result;
+}
+
 
 #endif //!STBI_NO_STDIO
 
@@ -1440,6 +1854,23 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_into_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, stbi_output_callback *output, void *user)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   s.output = output;
+   s.output_user = user;
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp) != NULL;
+}
+
+STBIDEF stbi_uc *stbi_load_preview_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   s.preview = 1;
+   return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -1932,6 +2363,99 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp)
 
 #ifndef STBI_NO_JPEG
 
+// worker threads for decoding one image; ranges of work items are handed out
+// up front, so no locking is needed beyond the final join
+#define STBI__MAX_THREADS               64
+#define STBI__JPEG_PARALLEL_MIN_PIXELS  (256*256)
+
+static int stbi__jpeg_thread_count = 1;
+
+STBIDEF void stbi_set_jpeg_thread_count(int thread_count)
+{
+   stbi__jpeg_thread_count = thread_count < 1 ? 1 : thread_count > STBI__MAX_THREADS ? STBI__MAX_THREADS : thread_count;
+}
+
+typedef void (*stbi__range_func)(void *ctx, int range, int first, int end);
+
+typedef struct
+{
+   stbi__range_func func;
+   void *ctx;
+   int range, first, end;
+} stbi__range_job;
+
+static void stbi__run_range_job(stbi__range_job *job)
+{
+   job->func(job->ctx, job->range, job->first, job->end);
+}
+
+#if defined(STBI__THREADS_WIN32)
+STBI_EXTERN __declspec(dllimport) unsigned long __stdcall WaitForSingleObject(void *handle, unsigned long milliseconds);
+STBI_EXTERN __declspec(dllimport) int __stdcall CloseHandle(void *handle);
+
+static unsigned __stdcall stbi__range_thread(void *job)
+{
+   stbi__run_range_job((stbi__range_job *) job);
+   return 0;
+}
+#elif defined(STBI__THREADS_PTHREAD)
+static void *stbi__range_thread(void *job)
+{
+   stbi__run_range_job((stbi__range_job *) job);
+   return NULL;
+}
+#endif
+
+// calls func on 'ranges' contiguous, nearly equal slices of [0,count), one per
+// thread. the calling thread takes range 0, and also any range whose thread
+// fails to start, so every item is always processed exactly once
+static void stbi__parallel_for(stbi__range_func func, void *ctx, int count, int ranges)
+{
+   stbi__range_job job[STBI__MAX_THREADS];
+#if defined(STBI__THREADS_WIN32)
+   uintptr_t thread[STBI__MAX_THREADS];
+#elif defined(STBI__THREADS_PTHREAD)
+   pthread_t thread[STBI__MAX_THREADS];
+#endif
+   int r, started = 1, chunk, extra;
+   if (ranges > count) ranges = count;
+   if (ranges > STBI__MAX_THREADS) ranges = STBI__MAX_THREADS;
+   if (ranges < 1) ranges = 1;
+   chunk = count / ranges;
+   extra = count % ranges;
+   for (r=0; r < ranges; ++r) {
+      job[r].func  = func;
+      job[r].ctx   = ctx;
+      job[r].range = r;
+      job[r].first = r*chunk + (r < extra ? r : extra);
+      job[r].end   = job[r].first + chunk + (r < extra);
+   }
+
+#if defined(STBI__THREADS_WIN32)
+   for (; started < ranges; ++started) {
+      thread[started] = _beginthreadex(NULL, 0, stbi__range_thread, &job[started], 0, NULL);
+      if (!thread[started]) break;
+   }
+#elif defined(STBI__THREADS_PTHREAD)
+   for (; started < ranges; ++started)
+      if (pthread_create(&thread[started], NULL, stbi__range_thread, &job[started]) != 0) break;
+#endif
+
+   for (r=started; r < ranges; ++r)
+      stbi__run_range_job(&job[r]);
+   stbi__run_range_job(&job[0]);
+
+#if defined(STBI__THREADS_WIN32)
+   for (r=1; r < started; ++r) {
+      WaitForSingleObject((void *) thread[r], 0xFFFFFFFF /* INFINITE */);
+      CloseHandle((void *) thread[r]);
+   }
+#elif defined(STBI__THREADS_PTHREAD)
+   for (r=1; r < started; ++r)
+      pthread_join(thread[r], NULL);
+#endif
+}
+
 // huffman decoding acceleration
 #define FAST_BITS   9  // larger handles more cases; smaller stomps less cache
 
@@ -1972,7 +2496,7 @@ typedef struct
       stbi_uc *data;
       void *raw_data, *raw_coeff;
       stbi_uc *linebuf;
-      short   *coeff;   // progressive only
+      short   *coeff;   // progressive, or baseline with deferred idct
       int      coeff_w, coeff_h; // number of 8x8 coefficient blocks
    } img_comp[4];
 
@@ -1994,6 +2518,11 @@ typedef struct
    int scan_n, order[4];
    int restart_interval, todo;
 
+   int            threads;     // threads used for this image, 1 = serial
+   int            defer_idct;  // baseline blocks are kept as coefficients and transformed in stbi__jpeg_finish
+   int            dc_only;     // preview: each 8x8 block becomes one pixel, its DC value; the planes and
+                               // coefficient buffers hold one entry per block
+
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
@@ -2272,7 +2801,7 @@ static int stbi__jpeg_decode_block_prog_dc(stbi__jpeg *j, short data[64], stbi__
 
    if (j->succ_high == 0) {
       // first scan for DC coefficient, must be first
-      memset(data,0,64*sizeof(data[0])); // 0 all the ac values now
+      if (!j->dc_only) memset(data,0,64*sizeof(data[0])); // 0 all the ac values now
       t = stbi__jpeg_huff_decode(j, hdc);
       if (t < 0 || t > 15) return stbi__err("can't merge dc and ac", "Corrupt JPEG");
       diff = t ? stbi__extend_receive(j, t) : 0;
@@ -2423,6 +2952,13 @@ stbi_inline static stbi_uc stbi__clamp(int x)
    return (stbi_uc) x;
 }
 
+// the value the inverse DCT gives every pixel of a block whose only nonzero
+// coefficient is its (dequantized) DC
+stbi_inline static stbi_uc stbi__jpeg_dc_pixel(int dc)
+{
+   return stbi__clamp(((dc + 4) >> 3) + 128);
+}
+
 #define stbi__f2f(x)  ((int) (((x) * 4096 + 0.5)))
 #define stbi__fsh(x)  ((x) * 4096)
 
@@ -2704,65 +3240,233 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
-#ifdef STBI_NEON
-
-// NEON integer IDCT. should produce bit-identical
-// results to the generic C version.
-static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
+#ifdef STBI_AVX2
+// avx2 version of the sse2 IDCT above: same 16-bit rows and transposes, but
+// each 32-bit intermediate covers a whole row in one ymm register instead of
+// a lo/hi pair. bit-identical to the sse2 version for every input.
+STBI__AVX2_TARGET
+static void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
 {
-   int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
-
-   int16x4_t rot0_0 = vdup_n_s16(stbi__f2f(0.5411961f));
-   int16x4_t rot0_1 = vdup_n_s16(stbi__f2f(-1.847759065f));
-   int16x4_t rot0_2 = vdup_n_s16(stbi__f2f( 0.765366865f));
-   int16x4_t rot1_0 = vdup_n_s16(stbi__f2f( 1.175875602f));
-   int16x4_t rot1_1 = vdup_n_s16(stbi__f2f(-0.899976223f));
-   int16x4_t rot1_2 = vdup_n_s16(stbi__f2f(-2.562915447f));
-   int16x4_t rot2_0 = vdup_n_s16(stbi__f2f(-1.961570560f));
-   int16x4_t rot2_1 = vdup_n_s16(stbi__f2f(-0.390180644f));
-   int16x4_t rot3_0 = vdup_n_s16(stbi__f2f( 0.298631336f));
-   int16x4_t rot3_1 = vdup_n_s16(stbi__f2f( 2.053119869f));
-   int16x4_t rot3_2 = vdup_n_s16(stbi__f2f( 3.072711026f));
-   int16x4_t rot3_3 = vdup_n_s16(stbi__f2f( 1.501321110f));
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
 
-#define dct_long_mul(out, inq, coeff) \
-   int32x4_t out##_l = vmull_s16(vget_low_s16(inq), coeff); \
-   int32x4_t out##_h = vmull_s16(vget_high_s16(inq), coeff)
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_setr_epi16((x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y),(x),(y))
 
-#define dct_long_mac(out, acc, inq, coeff) \
-   int32x4_t out##_l = vmlal_s16(acc##_l, vget_low_s16(inq), coeff); \
-   int32x4_t out##_h = vmlal_s16(acc##_h, vget_high_s16(inq), coeff)
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
 
-#define dct_widen(out, inq) \
-   int32x4_t out##_l = vshll_n_s16(vget_low_s16(inq), 12); \
-   int32x4_t out##_h = vshll_n_s16(vget_high_s16(inq), 12)
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
 
-// wide add
-#define dct_wadd(out, a, b) \
-   int32x4_t out##_l = vaddq_s32(a##_l, b##_l); \
-   int32x4_t out##_h = vaddq_s32(a##_h, b##_h)
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s); \
+         __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s); \
+         /* packs works per lane, so put the sum half and the dif half back together */ \
+         __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(sum, dif), 0xd8); \
+         out0 = _mm256_castsi256_si128(packed); \
+         out1 = _mm256_extracti128_si256(packed, 1); \
+      }
 
-// wide sub
-#define dct_wsub(out, a, b) \
-   int32x4_t out##_l = vsubq_s32(a##_l, b##_l); \
-   int32x4_t out##_h = vsubq_s32(a##_h, b##_h)
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
 
-// butterfly a/b, then shift using "shiftop" by "s" and pack
-#define dct_bfly32o(out0,out1, a,b,shiftop,s) \
-   { \
-      dct_wadd(sum, a, b); \
-      dct_wsub(dif, a, b); \
-      out0 = vcombine_s16(shiftop(sum_l, s), shiftop(sum_h, s)); \
-      out1 = vcombine_s16(shiftop(dif_l, s), shiftop(dif_h, s)); \
-   }
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
 
-#define dct_pass(shiftop, shift) \
-   { \
-      /* even part */ \
-      int16x8_t sum26 = vaddq_s16(row2, row6); \
-      dct_long_mul(p1e, sum26, rot0_0); \
-      dct_long_mac(t2e, p1e, row6, rot0_1); \
-      dct_long_mac(t3e, p1e, row2, rot0_2); \
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         __m256i x0 = _mm256_add_epi32(t0e, t3e); \
+         __m256i x3 = _mm256_sub_epi32(t0e, t3e); \
+         __m256i x1 = _mm256_add_epi32(t1e, t2e); \
+         __m256i x2 = _mm256_sub_epi32(t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         __m256i x4 = _mm256_add_epi32(y0o, y4o); \
+         __m256i x5 = _mm256_add_epi32(y1o, y5o); \
+         __m256i x6 = _mm256_add_epi32(y2o, y5o); \
+         __m256i x7 = _mm256_add_epi32(y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose pass 1
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      // transpose pass 2
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      // transpose pass 3
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack
+      __m128i p0 = _mm_packus_epi16(row0, row1); // a0a1a2a3...a7b0b1b2b3...b7
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      // 8bit 8x8 transpose pass 1
+      dct_interleave8(p0, p2); // a0e0a1e1...
+      dct_interleave8(p1, p3); // c0g0c1g1...
+
+      // transpose pass 2
+      dct_interleave8(p0, p1); // a0c0e0g0...
+      dct_interleave8(p2, p3); // b0d0f0h0...
+
+      // transpose pass 3
+      dct_interleave8(p0, p2); // a0b0c0d0...
+      dct_interleave8(p1, p3); // a4b4c4d4...
+
+      // store
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+   // avoid sse/avx transition stalls in the non-vex code that follows
+   _mm256_zeroupper();
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+#endif // STBI_AVX2
+
+#ifdef STBI_NEON
+
+// NEON integer IDCT. should produce bit-identical
+// results to the generic C version.
+static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
+{
+   int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
+
+   int16x4_t rot0_0 = vdup_n_s16(stbi__f2f(0.5411961f));
+   int16x4_t rot0_1 = vdup_n_s16(stbi__f2f(-1.847759065f));
+   int16x4_t rot0_2 = vdup_n_s16(stbi__f2f( 0.765366865f));
+   int16x4_t rot1_0 = vdup_n_s16(stbi__f2f( 1.175875602f));
+   int16x4_t rot1_1 = vdup_n_s16(stbi__f2f(-0.899976223f));
+   int16x4_t rot1_2 = vdup_n_s16(stbi__f2f(-2.562915447f));
+   int16x4_t rot2_0 = vdup_n_s16(stbi__f2f(-1.961570560f));
+   int16x4_t rot2_1 = vdup_n_s16(stbi__f2f(-0.390180644f));
+   int16x4_t rot3_0 = vdup_n_s16(stbi__f2f( 0.298631336f));
+   int16x4_t rot3_1 = vdup_n_s16(stbi__f2f( 2.053119869f));
+   int16x4_t rot3_2 = vdup_n_s16(stbi__f2f( 3.072711026f));
+   int16x4_t rot3_3 = vdup_n_s16(stbi__f2f( 1.501321110f));
+
+#define dct_long_mul(out, inq, coeff) \
+   int32x4_t out##_l = vmull_s16(vget_low_s16(inq), coeff); \
+   int32x4_t out##_h = vmull_s16(vget_high_s16(inq), coeff)
+
+#define dct_long_mac(out, acc, inq, coeff) \
+   int32x4_t out##_l = vmlal_s16(acc##_l, vget_low_s16(inq), coeff); \
+   int32x4_t out##_h = vmlal_s16(acc##_h, vget_high_s16(inq), coeff)
+
+#define dct_widen(out, inq) \
+   int32x4_t out##_l = vshll_n_s16(vget_low_s16(inq), 12); \
+   int32x4_t out##_h = vshll_n_s16(vget_high_s16(inq), 12)
+
+// wide add
+#define dct_wadd(out, a, b) \
+   int32x4_t out##_l = vaddq_s32(a##_l, b##_l); \
+   int32x4_t out##_h = vaddq_s32(a##_h, b##_h)
+
+// wide sub
+#define dct_wsub(out, a, b) \
+   int32x4_t out##_l = vsubq_s32(a##_l, b##_l); \
+   int32x4_t out##_h = vsubq_s32(a##_h, b##_h)
+
+// butterfly a/b, then shift using "shiftop" by "s" and pack
+#define dct_bfly32o(out0,out1, a,b,shiftop,s) \
+   { \
+      dct_wadd(sum, a, b); \
+      dct_wsub(dif, a, b); \
+      out0 = vcombine_s16(shiftop(sum_l, s), shiftop(sum_h, s)); \
+      out1 = vcombine_s16(shiftop(dif_l, s), shiftop(dif_h, s)); \
+   }
+
+#define dct_pass(shiftop, shift) \
+   { \
+      /* even part */ \
+      int16x8_t sum26 = vaddq_s16(row2, row6); \
+      dct_long_mul(p1e, sum26, rot0_0); \
+      dct_long_mac(t2e, p1e, row6, rot0_1); \
+      dct_long_mac(t3e, p1e, row2, rot0_2); \
       int16x8_t sum04 = vaddq_s16(row0, row4); \
       int16x8_t dif04 = vsubq_s16(row0, row4); \
       dct_widen(t0e, sum04); \
@@ -2946,10 +3650,139 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
    // since we don't even allow 1<<30 pixels
 }
 
+// decodes baseline MCUs [first,end) of the current scan into the coefficient
+// buffers, ignoring restart intervals (the caller starts each one afresh)
+static int stbi__jpeg_decode_baseline_mcus(stbi__jpeg *z, int first, int end)
+{
+   int m,k,x,y;
+   for (m=first; m < end; ++m) {
+      if (z->scan_n == 1) {
+         int n = z->order[0];
+         int w = (z->img_comp[n].x+7) >> 3;
+         int ha = z->img_comp[n].ha;
+         short *data = z->img_comp[n].coeff + 64 * (m % w + (m / w) * z->img_comp[n].coeff_w);
+         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+      } else {
+         int i = m % z->img_mcu_x;
+         int j = m / z->img_mcu_x;
+         for (k=0; k < z->scan_n; ++k) {
+            int n = z->order[k];
+            for (y=0; y < z->img_comp[n].v; ++y) {
+               for (x=0; x < z->img_comp[n].h; ++x) {
+                  int x2 = i*z->img_comp[n].h + x;
+                  int y2 = j*z->img_comp[n].v + y;
+                  int ha = z->img_comp[n].ha;
+                  short *data = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
+                  if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+               }
+            }
+         }
+      }
+   }
+   return 1;
+}
+
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi_uc **segment;  // restart interval k is segment[k] .. segment[k+1]
+   int segments, mcus;
+   int failed[STBI__MAX_THREADS];
+} stbi__jpeg_segments;
+
+static void stbi__jpeg_decode_segments(void *ctx, int range, int first, int end)
+{
+   stbi__jpeg_segments *job = (stbi__jpeg_segments *) ctx;
+   stbi__context s;
+   int k;
+   // each thread gets its own bit reader; the tables are shared read-only
+   stbi__jpeg *z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (!z) { job->failed[range] = 1; return; }
+   memcpy(z, job->z, sizeof(*z));
+   z->s = &s;
+   for (k=first; k < end; ++k) {
+      int m = k * z->restart_interval;
+      int m_end = job->mcus - m > z->restart_interval ? m + z->restart_interval : job->mcus;
+      stbi__start_mem(&s, job->segment[k], (int) (job->segment[k+1] - job->segment[k]));
+      stbi__jpeg_reset(z);
+      if (!stbi__jpeg_decode_baseline_mcus(z, m, m_end)) { job->failed[range] = 1; break; }
+      // same check the serial decoder makes before it resets at a restart marker
+      if (k+1 < job->segments) {
+         if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+         if (!STBI__RESTART(z->marker)) { job->failed[range] = 1; break; }
+      }
+   }
+   STBI_FREE(z);
+}
+
+// huffman-decodes a baseline scan from memory on several threads by splitting it
+// at its restart markers. returns 0 without touching the decoder state if the
+// scan doesn't split cleanly, in which case the caller decodes it serially
+static int stbi__jpeg_parse_restart_segments(stbi__jpeg *z)
+{
+   stbi__jpeg_segments job;
+   stbi_uc *p = z->s->img_buffer, *end = z->s->img_buffer_end, *scan_end = NULL;
+   int count = 0, k, ok = 1;
+
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      job.mcus = ((z->img_comp[n].x+7) >> 3) * ((z->img_comp[n].y+7) >> 3);
+   } else
+      job.mcus = z->img_mcu_x * z->img_mcu_y;
+   job.segments = (job.mcus + z->restart_interval-1) / z->restart_interval;
+   if (job.segments < 2) return 0;
+
+   job.segment = (stbi_uc **) stbi__malloc_mad2(job.segments+1, sizeof(stbi_uc *), 0);
+   if (!job.segment) return 0;
+
+   // find the restart markers; the scan ends at the first other marker
+   job.segment[count++] = p;
+   while (p < end) {
+      stbi_uc *q;
+      if (*p != 0xff) { ++p; continue; }
+      q = p+1;
+      while (q < end && *q == 0xff) ++q; // fill bytes
+      if (q == end) break;
+      if (*q == 0x00) { p = q+1; continue; } // stuffed zero
+      if (STBI__RESTART(*q)) {
+         if (count == job.segments) break;
+         job.segment[count++] = q+1;
+         p = q+1;
+         continue;
+      }
+      scan_end = p;
+      job.segment[count] = q+1;
+      break;
+   }
+   if (!scan_end || count != job.segments) {
+      STBI_FREE(job.segment);
+      return 0;
+   }
+
+   job.z = z;
+   memset(job.failed, 0, sizeof(job.failed));
+   stbi__parallel_for(stbi__jpeg_decode_segments, &job, job.segments, z->threads);
+   STBI_FREE(job.segment);
+   for (k=0; k < STBI__MAX_THREADS; ++k)
+      if (job.failed[k]) ok = 0;
+   if (!ok) return 0;
+
+   // leave the stream where the serial decoder would look for the next marker
+   z->s->img_buffer = scan_end;
+   z->code_buffer = 0;
+   z->code_bits = 0;
+   z->nomore = 0;
+   z->marker = STBI__MARKER_none;
+   return 1;
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
    if (!z->progressive) {
+      if (z->defer_idct && z->restart_interval && !z->s->read_from_callbacks)
+         if (stbi__jpeg_parse_restart_segments(z))
+            return 1;
       if (z->scan_n == 1) {
          int i,j;
          STBI_SIMD_ALIGN(short, data[64]);
@@ -2963,8 +3796,12 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               short *block = z->defer_idct ? z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w) : data;
+               if (!stbi__jpeg_decode_block(z, block, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+               if (z->dc_only)
+                  z->img_comp[n].data[z->img_comp[n].w2*j+i] = stbi__jpeg_dc_pixel(data[0]);
+               else if (!z->defer_idct)
+                  z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2991,8 +3828,12 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                         int x2 = (i*z->img_comp[n].h + x)*8;
                         int y2 = (j*z->img_comp[n].v + y)*8;
                         int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        short *block = z->defer_idct ? z->img_comp[n].coeff + 64 * (x2/8 + y2/8 * z->img_comp[n].coeff_w) : data;
+                        if (!stbi__jpeg_decode_block(z, block, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        if (z->dc_only)
+                           z->img_comp[n].data[z->img_comp[n].w2*(y2/8)+x2/8] = stbi__jpeg_dc_pixel(data[0]);
+                        else if (!z->defer_idct)
+                           z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
                      }
                   }
                }
@@ -3008,6 +3849,8 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          return 1;
       }
    } else {
+      // previews keep only the DC coefficient of each block
+      int block_size = z->dc_only ? 1 : 64;
       if (z->scan_n == 1) {
          int i,j;
          int n = z->order[0];
@@ -3019,7 +3862,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          int h = (z->img_comp[n].y+7) >> 3;
          for (j=0; j < h; ++j) {
             for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+               short *data = z->img_comp[n].coeff + block_size * (i + j * z->img_comp[n].coeff_w);
                if (z->spec_start == 0) {
                   if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
                      return 0;
@@ -3050,7 +3893,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                      for (x=0; x < z->img_comp[n].h; ++x) {
                         int x2 = (i*z->img_comp[n].h + x);
                         int y2 = (j*z->img_comp[n].v + y);
-                        short *data = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
+                        short *data = z->img_comp[n].coeff + block_size * (x2 + y2 * z->img_comp[n].coeff_w);
                         if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
                            return 0;
                      }
@@ -3077,25 +3920,41 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
       data[i] *= dequant[i];
 }
 
-static void stbi__jpeg_finish(stbi__jpeg *z)
-{
-   if (z->progressive) {
-      // dequantize and idct the data
-      int i,j,n;
-      for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
-         int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+// transform MCU rows [first,end) of every component
+static void stbi__jpeg_finish_rows(void *ctx, int range, int first, int end)
+{
+   stbi__jpeg *z = (stbi__jpeg *) ctx;
+   int i,j,n;
+   STBI_NOTUSED(range);
+   for (n=0; n < z->s->img_n; ++n) {
+      int w = (z->img_comp[n].x+7) >> 3;
+      int h = (z->img_comp[n].y+7) >> 3;
+      int j_end = end * z->img_comp[n].v;
+      if (j_end > h) j_end = h;
+      for (j=first * z->img_comp[n].v; j < j_end; ++j) {
+         if (z->dc_only) {
+            // progressive previews only; baseline ones were done while decoding
+            for (i=0; i < w; ++i)
+               z->img_comp[n].data[z->img_comp[n].w2*j+i] = stbi__jpeg_dc_pixel(z->img_comp[n].coeff[i + j * z->img_comp[n].coeff_w] * z->dequant[z->img_comp[n].tq][0]);
+            continue;
+         }
+         for (i=0; i < w; ++i) {
+            short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+            // baseline blocks were already dequantized by stbi__jpeg_decode_block
+            if (z->progressive)
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
+            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
          }
       }
    }
 }
 
+static void stbi__jpeg_finish(stbi__jpeg *z)
+{
+   // dequantize and idct the data
+   stbi__parallel_for(stbi__jpeg_finish_rows, z, z->img_mcu_y, z->threads);
+}
+
 static int stbi__process_marker(stbi__jpeg *z, int m)
 {
    int L;
@@ -3318,6 +4177,16 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
    z->img_mcu_x = (s->img_x + z->img_mcu_w-1) / z->img_mcu_w;
    z->img_mcu_y = (s->img_y + z->img_mcu_h-1) / z->img_mcu_h;
 
+   // small images aren't worth starting threads for
+   z->threads = s->img_x * s->img_y >= STBI__JPEG_PARALLEL_MIN_PIXELS ? stbi__jpeg_thread_count : 1;
+#if !defined(STBI__THREADS_WIN32) && !defined(STBI__THREADS_PTHREAD)
+   z->threads = 1;
+#endif
+   // previews are small enough to convert on one thread
+   if (z->dc_only) z->threads = 1;
+   // the serial decoder transforms each block as soon as it is decoded
+   z->defer_idct = !z->progressive && z->threads > 1;
+
    for (i=0; i < s->img_n; ++i) {
       // number of effective pixels (e.g. for non-interleaved MCU)
       z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max-1) / h_max;
@@ -3331,6 +4200,11 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // so these muls can't overflow with 32-bit ints (which we require)
       z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
       z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      if (z->dc_only) {
+         // one pixel per block
+         z->img_comp[i].w2 /= 8;
+         z->img_comp[i].h2 /= 8;
+      }
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3339,10 +4213,11 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
          return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
-      if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
+      if (z->progressive || z->defer_idct) {
+         // w2, h2 are multiples of 8 (see above), or already count blocks for dc_only;
+         // either way this is one short per coefficient kept
+         z->img_comp[i].coeff_w = z->dc_only ? z->img_comp[i].w2 : z->img_comp[i].w2 / 8;
+         z->img_comp[i].coeff_h = z->dc_only ? z->img_comp[i].h2 : z->img_comp[i].h2 / 8;
          z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
@@ -3408,6 +4283,29 @@ static stbi_uc stbi__skip_jpeg_junk_at_end(stbi__jpeg *j)
    return STBI__MARKER_none;
 }
 
+// skips the entropy-coded data of a scan, restart markers included, and
+// returns the marker after it; previews don't need the AC scans
+static stbi_uc stbi__jpeg_skip_scan(stbi__jpeg *j)
+{
+   stbi__context *s = j->s;
+   for (;;) {
+      stbi_uc x;
+      if (!s->read_from_callbacks) {
+         // in memory, jump straight to the next 0xff
+         stbi_uc *p = (stbi_uc *) memchr(s->img_buffer, 0xff, s->img_buffer_end - s->img_buffer);
+         s->img_buffer = p ? p : s->img_buffer_end;
+      }
+      if (stbi__at_eof(s)) return STBI__MARKER_none;
+      x = stbi__get8(s);
+      while (x == 0xff) {
+         if (stbi__at_eof(s)) return STBI__MARKER_none;
+         x = stbi__get8(s);
+         if (x != 0x00 && x != 0xff && !STBI__RESTART(x))
+            return x;
+      }
+   }
+}
+
 // decode image to YCbCr format
 static int stbi__decode_jpeg_image(stbi__jpeg *j)
 {
@@ -3422,6 +4320,11 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
+         if (j->dc_only && j->spec_start != 0) {
+            j->marker = stbi__jpeg_skip_scan(j);
+            m = stbi__get_marker(j);
+            continue;
+         }
          if (!stbi__parse_entropy_coded_data(j)) return 0;
          if (j->marker == STBI__MARKER_none ) {
          j->marker = stbi__skip_jpeg_junk_at_end(j);
@@ -3437,11 +4340,15 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
          if (NL != j->s->img_y) return stbi__err("bad DNL height", "Corrupt JPEG");
          m = stbi__get_marker(j);
       } else {
-         if (!stbi__process_marker(j, m)) return 1;
+         if (!stbi__process_marker(j, m)) {
+            // match the serial decoder, which has transformed every block it decoded
+            if (j->defer_idct) stbi__jpeg_finish(j);
+            return 1;
+         }
          m = stbi__get_marker(j);
       }
    }
-   if (j->progressive)
+   if (j->progressive || j->defer_idct)
       stbi__jpeg_finish(j);
    return 1;
 }
@@ -3817,26 +4724,193 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
-// set up the kernels
-static void stbi__setup_jpeg(stbi__jpeg *j)
+#ifdef STBI_AVX2
+// same filter as stbi__resample_row_hv_2, 16 input pixels per iteration
+STBI__AVX2_TARGET
+static stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   // need to generate 2x2 samples for every one in input
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   // process groups of 16 pixels for as long as we can.
+   // note we can't handle the last pixel in a row in this loop
+   // because we need to handle the filter boundary conditions.
+   for (; i < ((w-1) & ~15); i += 16) {
+      // load and perform the vertical filtering pass
+      // this uses 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff); // current row
+
+      // "prev" is current row shifted right by 1 pixel with t1 shifted in,
+      // "next" is current row shifted left by 1 pixel with the first pixel
+      // of the next block shifted in. alignr works per 128-bit lane, so the
+      // lane-crossing pixel comes from a lane-swapped copy.
+      __m256i lo_up = _mm256_permute2x128_si256(curr, curr, 0x08); // lanes: 0, curr.lo
+      __m256i hi_dn = _mm256_permute2x128_si256(curr, curr, 0x81); // lanes: curr.hi, 0
+      __m256i prev  = _mm256_alignr_epi8(curr, _mm256_insert_epi16(lo_up, (short) t1, 7), 14);
+      __m256i next  = _mm256_alignr_epi8(_mm256_insert_epi16(hi_dn, (short) (3*in_near[i+16] + in_far[i+16]), 8), curr, 2);
+
+      // horizontal filter, polyphase implementation since it's convenient:
+      // even pixels = 3*cur + prev = cur*4 + (prev - cur)
+      // odd  pixels = 3*cur + next = cur*4 + (next - cur)
+      // note the shared term.
+      __m256i bias  = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even and odd pixels, then undo scaling. the per-lane
+      // unpack and pack leave the 32 output bytes in order.
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+
+      // pack and write output
+      _mm256_storeu_si256((__m256i *) (out + i*2), _mm256_packus_epi16(de0, de1));
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+   _mm256_zeroupper();
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+
+// same arithmetic as the sse2 path of stbi__YCbCr_to_RGB_simd, 16 pixels at a
+// time; whatever is left over goes through that function so every pixel ends
+// up with exactly the value the sse2 build produces
+STBI__AVX2_TARGET
+static void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(128);
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+
+      for (; i+15 < count; i += 16) {
+         // load
+         __m128i y_bytes = _mm_loadu_si128((__m128i *) (y+i));
+         __m128i cr_bytes = _mm_loadu_si128((__m128i *) (pcr+i));
+         __m128i cb_bytes = _mm_loadu_si128((__m128i *) (pcb+i));
+         __m128i cr_biased = _mm_xor_si128(cr_bytes, signflip); // -128
+         __m128i cb_biased = _mm_xor_si128(cb_bytes, signflip); // -128
+
+         // widen to short (and left-shift y, cr, cb by 8)
+         __m256i yw  = _mm256_or_si256(_mm256_slli_epi16(_mm256_cvtepu8_epi16(y_bytes), 8), y_bias);
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cr_biased), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepu8_epi16(cb_biased), 8);
+
+         // color transform
+         __m256i yws = _mm256_srli_epi16(yw, 4);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte, set up for transpose
+         __m256i brb = _mm256_packus_epi16(rw, bw);
+         __m256i gxb = _mm256_packus_epi16(gw, xw);
+
+         // transpose to interleave channels; each lane ends up holding
+         // pixels 0-3/8-11 (o0) and 4-7/12-15 (o1)
+         __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+         __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+         __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+         __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+
+         // store
+         _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+         _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+         out += 64;
+      }
+      _mm256_zeroupper();
+   }
+
+   stbi__YCbCr_to_RGB_simd(out, y+i, pcb+i, pcr+i, count-i, step);
+}
+#endif
+
+// pick the widest kernels stbi_simd_level allows
+static int stbi__pick_jpeg_kernels(stbi_jpeg_kernels *k)
 {
-   j->idct_block_kernel = stbi__idct_block;
-   j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
-   j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
+   int level = stbi_simd_level();
+   k->idct_block = stbi__idct_block;
+   k->YCbCr_to_RGB = stbi__YCbCr_to_RGB_row;
+   k->resample_row_hv_2 = stbi__resample_row_hv_2;
 
-#ifdef STBI_SSE2
-   if (stbi__sse2_available()) {
-      j->idct_block_kernel = stbi__idct_simd;
-      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
-      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+   if (level >= STBI_simd_sse2) {
+      k->idct_block = stbi__idct_simd;
+      k->YCbCr_to_RGB = stbi__YCbCr_to_RGB_simd;
+      k->resample_row_hv_2 = stbi__resample_row_hv_2_simd;
    }
 #endif
 
-#ifdef STBI_NEON
-   j->idct_block_kernel = stbi__idct_simd;
-   j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
-   j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+#ifdef STBI_AVX2
+   if (level >= STBI_simd_avx2) {
+      k->idct_block = stbi__idct_avx2;
+      k->YCbCr_to_RGB = stbi__YCbCr_to_RGB_avx2;
+      k->resample_row_hv_2 = stbi__resample_row_hv_2_avx2;
+   }
 #endif
+   return level;
+}
+
+STBIDEF int stbi_get_jpeg_kernels(stbi_jpeg_kernels *kernels)
+{
+   return stbi__pick_jpeg_kernels(kernels);
+}
+
+// set up the kernels
+static void stbi__setup_jpeg(stbi__jpeg *j)
+{
+   stbi_jpeg_kernels k;
+   stbi__pick_jpeg_kernels(&k);
+   j->idct_block_kernel = k.idct_block;
+   j->YCbCr_to_RGB_kernel = k.YCbCr_to_RGB;
+   j->resample_row_hv_2_kernel = k.resample_row_hv_2;
 }
 
 // clean up the temporary component buffers
@@ -3862,6 +4936,149 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+typedef struct
+{
+   stbi__jpeg *z;
+   stbi__resample res_comp[4];  // resampler state at the first row
+   stbi_uc *output;             // row 0
+   ptrdiff_t step;              // distance between output rows
+   stbi_uc *scratch;            // per-range line buffers and spare output row
+   size_t scratch_stride;
+   int n, decode_n, is_rgb;
+   int spare_rows;              // some rows must be converted in the spare row, see below
+} stbi__jpeg_convert;
+
+// resample and color-convert output rows [first,end)
+static void stbi__jpeg_convert_rows(void *ctx, int range, int first, int end)
+{
+   stbi__jpeg_convert *c = (stbi__jpeg_convert *) ctx;
+   stbi__jpeg *z = c->z;
+   int n = c->n, decode_n = c->decode_n, is_rgb = c->is_rgb;
+   int k;
+   unsigned int i,j;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   stbi_uc *linebuf[4];
+   stbi_uc *scratch = c->scratch ? c->scratch + range * c->scratch_stride : NULL;
+   stbi__resample res_comp[4];
+
+   for (k=0; k < decode_n; ++k) {
+      stbi__resample *r = &res_comp[k];
+      *r = c->res_comp[k];
+      linebuf[k] = scratch ? scratch + k * (z->s->img_x + 3) : z->img_comp[k].linebuf;
+      // step the resampler past the rows before this range
+      for (j=0; j < (unsigned) first; ++j) {
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+   }
+
+   for (j=first; j < (unsigned) end; ++j) {
+      stbi_uc *row = c->output + c->step * j;
+      // 3-channel rows are written with one byte of overrun. Unless that byte is the start
+      // of the next row this thread writes, the row is converted in the spare row: it must
+      // not land in another thread's rows, a row already written, or a caller's memory
+      stbi_uc *dest = c->spare_rows && (c->step != n * (ptrdiff_t) z->s->img_x || j+1 == (unsigned) end) ? scratch + decode_n * (z->s->img_x + 3) : row;
+      stbi_uc *out = dest;
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               if (n == 2) out[1] = 255; // with n == 1 this byte is the next row, maybe written already
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               if (n == 2) out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+         }
+      }
+      if (dest != row)
+         memcpy(row, dest, n * z->s->img_x);
+   }
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3873,6 +5090,18 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+   if (z->dc_only) {
+      // from here on the preview is the image; each component shrinks the same way,
+      // so the resamplers see the usual subsampling ratios
+      int k;
+      z->s->img_x = (z->s->img_x + 7) >> 3;
+      z->s->img_y = (z->s->img_y + 7) >> 3;
+      for (k=0; k < z->s->img_n; ++k) {
+         z->img_comp[k].x = (z->img_comp[k].x + 7) >> 3;
+         z->img_comp[k].y = (z->img_comp[k].y + 7) >> 3;
+      }
+   }
+
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -3889,15 +5118,12 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
    // resample and color-convert
    {
-      int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
-
-      stbi__resample res_comp[4];
+      int k, ranges;
+      stbi__rows rows;
+      stbi__jpeg_convert c;
 
       for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
+         stbi__resample *r = &c.res_comp[k];
 
          // allocate line buffer big enough for upsampling off the edges
          // with upsample factor of 4
@@ -3918,110 +5144,37 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          else                               r->resample = stbi__resample_row_generic;
       }
 
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      // the one byte of slack is for the overrun of the last 3-channel row
+      if (!stbi__start_rows(z->s, &rows, z->s->img_x, z->s->img_y, n, 1, 1)) { stbi__cleanup_jpeg(z); return NULL; }
 
       // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
+      c.z = z;
+      c.output = rows.first;
+      c.step = rows.step;
+      c.n = n;
+      c.decode_n = decode_n;
+      c.is_rgb = is_rgb;
+      c.scratch = NULL;
+      c.scratch_stride = (size_t) decode_n * (z->s->img_x + 3) + n * z->s->img_x + 1;
+      ranges = z->threads;
+      c.spare_rows = n == 3 && (ranges > 1 || rows.step != n * (ptrdiff_t) z->s->img_x || z->s->output);
+      if (ranges > 1 || c.spare_rows) {
+         c.scratch = (stbi_uc *) stbi__malloc(ranges * c.scratch_stride);
+         if (!c.scratch && c.spare_rows) {
+            stbi__free_rows(&rows);
+            stbi__cleanup_jpeg(z);
+            return stbi__errpuc("outofmem", "Out of memory");
          }
+         if (!c.scratch) ranges = 1;
       }
+      stbi__parallel_for(stbi__jpeg_convert_rows, &c, z->s->img_y, ranges);
+      if (c.scratch) STBI_FREE(c.scratch);
+
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
       if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-      return output;
+      return rows.image;
    }
 }
 
@@ -4031,10 +5184,13 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
    stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
    if (!j) return stbi__errpuc("outofmem", "Out of memory");
    memset(j, 0, sizeof(stbi__jpeg));
-   STBI_NOTUSED(ri);
    j->s = s;
+   j->dc_only = s->preview;
    stbi__setup_jpeg(j);
    result = load_jpeg_image(j, x,y,comp,req_comp);
+   // load_jpeg_image always writes its final rows through stbi__start_rows
+   ri->in_output = s->output != NULL;
+   ri->flipped = stbi__vertically_flip_on_load;
    STBI_FREE(j);
    return result;
 }
@@ -4091,6 +5247,8 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
+#define STBI__ZMULTI_BITS 11 // literal/length lookup bits in the fast inflate loop
+#define STBI__ZMULTI_MASK ((1 << STBI__ZMULTI_BITS) - 1)
 
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
@@ -4187,6 +5345,11 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+#ifndef STBI_NO_FAST_INFLATE
+   int zfast;
+   int zmulti_built;
+   stbi__uint32 zmulti[1 << STBI__ZMULTI_BITS];
+#endif
 } stbi__zbuf;
 
 stbi_inline static int stbi__zeof(stbi__zbuf *z)
@@ -4221,12 +5384,14 @@ stbi_inline static unsigned int stbi__zreceive(stbi__zbuf *z, int n)
    return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+// decodes a code too long for the fast table from the low 16 bits of code;
+// returns the symbol and its code length in *size, or -1 for an invalid code
+static int stbi__zhuffman_decode_code(stbi__zhuffman *z, int code, int *size)
 {
    int b,s,k;
    // not resolved by fast table, so compute it the slow way
    // use jpeg approach, which requires MSbits at top
-   k = stbi__bit_reverse(a->code_buffer, 16);
+   k = stbi__bit_reverse(code, 16);
    for (s=STBI__ZFAST_BITS+1; ; ++s)
       if (k < z->maxcode[s])
          break;
@@ -4235,9 +5400,17 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
    b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
    if (b >= STBI__ZNSYMS) return -1; // some data was corrupt somewhere!
    if (z->size[b] != s) return -1;  // was originally an assert, but report failure instead.
+   *size = s;
+   return z->value[b];
+}
+
+static int stbi__zhuffman_decode_slowpath(stbi__zbuf *a, stbi__zhuffman *z)
+{
+   int s, v = stbi__zhuffman_decode_code(z, (int) a->code_buffer, &s);
+   if (v < 0) return -1;
    a->code_buffer >>= s;
    a->num_bits -= s;
-   return z->value[b];
+   return v;
 }
 
 stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
@@ -4306,11 +5479,214 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+#ifndef STBI_NO_FAST_INFLATE
+// fast inflate loop, see "Fast inflate" at the top of the file. Each zmulti
+// entry decodes the low STBI__ZMULTI_BITS bits of the bit buffer:
+//    bits  0-3   number of bits consumed by the code(s)
+//    bits  4-7   1 or 2 literals, STBI__ZMULTI_LENGTH or STBI__ZMULTI_END;
+//                0 means the code is longer or invalid, decode it the slow way
+//    bits  8-15  first literal, or number of length extra bits
+//    bits 16-31  second literal, or length base
+#define STBI__ZMULTI_LENGTH 3
+#define STBI__ZMULTI_END    4
+#define STBI__ZMULTI_KIND(e)  (((e) >> 4) & 15)
+// one iteration emits at most two literal entries of 2 bytes, or a 258-byte
+// match copied in 16-byte chunks (272 bytes)
+#define STBI__ZFAST_OUT_MARGIN  (4 + 272)
+// and refills at most twice, each reading 8 bytes and consuming up to 7
+#define STBI__ZFAST_IN_MARGIN   16
+
+stbi_inline static int stbi__zhuffman_decode_bits(stbi__zhuffman *z, int code, int *size)
+{
+   int b = z->fast[code & STBI__ZFAST_MASK];
+   if (b) {
+      *size = b >> 9;
+      return b & 511;
+   }
+   return stbi__zhuffman_decode_code(z, code, size);
+}
+
+static stbi__uint32 stbi__zmulti_single(stbi__zhuffman *z, int code)
+{
+   int s, v = stbi__zhuffman_decode_bits(z, code, &s);
+   if (v < 0 || s > STBI__ZMULTI_BITS || v >= 286) return 0;
+   if (v < 256) return (stbi__uint32) (s | (1 << 4) | (v << 8));
+   if (v == 256) return (stbi__uint32) (s | (STBI__ZMULTI_END << 4));
+   v -= 257;
+   return (stbi__uint32) (s | (STBI__ZMULTI_LENGTH << 4) | (stbi__zlength_extra[v] << 8) | (stbi__zlength_base[v] << 16));
+}
+
+static void stbi__zbuild_multi(stbi__zbuf *a)
+{
+   int i;
+   stbi__uint32 *t = a->zmulti;
+   for (i=0; i < (1 << STBI__ZMULTI_BITS); ++i)
+      t[i] = stbi__zmulti_single(&a->z_length, i);
+   // pair up literals whose codes fit in the lookup together; going down,
+   // t[i >> s] hasn't been paired yet
+   for (i=(1 << STBI__ZMULTI_BITS)-1; i > 0; --i) {
+      stbi__uint32 e = t[i], e2;
+      int s = e & 15;
+      if (STBI__ZMULTI_KIND(e) != 1) continue;
+      e2 = t[i >> s];
+      if (STBI__ZMULTI_KIND(e2) == 1 && (int) (e2 & 15) <= STBI__ZMULTI_BITS - s)
+         t[i] = (stbi__uint32) (s + (e2 & 15)) | (2 << 4) | (e & 0xff00) | ((e2 & 0xff00) << 8);
+   }
+}
+
+stbi_inline static int stbi__zfast_ready(stbi__zbuf *a, char *zout)
+{
+   return !a->hit_zeof_once && a->zbuffer_end - a->zbuffer >= STBI__ZFAST_IN_MARGIN && a->zout_end - zout >= STBI__ZFAST_OUT_MARGIN;
+}
+
+stbi_inline static stbi__uint64 stbi__zload64(const stbi_uc *p)
+{
+#if defined(_MSC_VER) || (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+   stbi__uint64 v;
+   memcpy(&v, p, 8);
+   return v;
+#else
+   return  (stbi__uint64) p[0]        | ((stbi__uint64) p[1] <<  8) | ((stbi__uint64) p[2] << 16) | ((stbi__uint64) p[3] << 24) |
+          ((stbi__uint64) p[4] << 32) | ((stbi__uint64) p[5] << 40) | ((stbi__uint64) p[6] << 48) | ((stbi__uint64) p[7] << 56);
+#endif
+}
+
+// tops the bit buffer up to at least 56 bits without a loop; bytes that only
+// partially fit are read again next time, into the same bit positions
+#define STBI__ZFAST_REFILL()                      \
+   do {                                           \
+      bits |= stbi__zload64(in) << num_bits;      \
+      in += (63 - num_bits) >> 3;                 \
+      num_bits |= 56;                             \
+   } while (0)
+
+#define STBI__ZFAST_CONSUME(n)                    \
+   do {                                           \
+      bits >>= (n);                               \
+      num_bits -= (n);                            \
+   } while (0)
+
+// runs until the end of the block (returns 1), an error (returns 0), or until
+// input or output gets within the margins above (returns 2); the caller must
+// check stbi__zfast_ready first
+static int stbi__parse_huffman_block_fast(stbi__zbuf *a)
+{
+   const stbi_uc *in = a->zbuffer;
+   const stbi_uc *in_end = a->zbuffer_end - STBI__ZFAST_IN_MARGIN;
+   stbi_uc *zout = (stbi_uc *) a->zout;
+   stbi_uc *zout_end = (stbi_uc *) a->zout_end - STBI__ZFAST_OUT_MARGIN;
+   stbi_uc *zout_start = (stbi_uc *) a->zout_start;
+   const stbi__uint32 *multi = a->zmulti;
+   stbi__uint64 bits = a->code_buffer;
+   int num_bits = a->num_bits;
+   int result = 2;
+
+   if (!a->zmulti_built) {
+      stbi__zbuild_multi(a);
+      a->zmulti_built = 1;
+   }
+
+   while (in <= in_end && zout <= zout_end) {
+      stbi__uint32 e;
+      stbi_uc *p;
+      int len, dist, z, s;
+      STBI__ZFAST_REFILL();
+      e = multi[bits & STBI__ZMULTI_MASK];
+      if (STBI__ZMULTI_KIND(e) - 1 < 2) {
+         zout[0] = (stbi_uc) (e >> 8);
+         zout[1] = (stbi_uc) (e >> 16);
+         zout += STBI__ZMULTI_KIND(e);
+         STBI__ZFAST_CONSUME(e & 15);
+         e = multi[bits & STBI__ZMULTI_MASK];
+         if (STBI__ZMULTI_KIND(e) - 1 < 2) {
+            zout[0] = (stbi_uc) (e >> 8);
+            zout[1] = (stbi_uc) (e >> 16);
+            zout += STBI__ZMULTI_KIND(e);
+            STBI__ZFAST_CONSUME(e & 15);
+            continue;
+         }
+         // a length and distance need up to 48 bits
+         if (num_bits < 48) STBI__ZFAST_REFILL();
+      }
+
+      if (STBI__ZMULTI_KIND(e) == STBI__ZMULTI_LENGTH) {
+         int extra = (e >> 8) & 15;
+         STBI__ZFAST_CONSUME(e & 15);
+         len = (int) (e >> 16) + (int) (bits & ((1 << extra) - 1));
+         STBI__ZFAST_CONSUME(extra);
+      } else if (STBI__ZMULTI_KIND(e) == STBI__ZMULTI_END) {
+         STBI__ZFAST_CONSUME(e & 15);
+         result = 1;
+         break;
+      } else {
+         z = stbi__zhuffman_decode_bits(&a->z_length, (int) (bits & 0xffff), &s);
+         if (z < 0 || z >= 286) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+         STBI__ZFAST_CONSUME(s);
+         if (z < 256) {
+            *zout++ = (stbi_uc) z;
+            continue;
+         }
+         if (z == 256) {
+            result = 1;
+            break;
+         }
+         z -= 257;
+         len = stbi__zlength_base[z] + (int) (bits & ((1 << stbi__zlength_extra[z]) - 1));
+         STBI__ZFAST_CONSUME(stbi__zlength_extra[z]);
+      }
+
+      z = stbi__zhuffman_decode_bits(&a->z_distance, (int) (bits & 0xffff), &s);
+      if (z < 0 || z >= 30) { result = stbi__err("bad huffman code","Corrupt PNG"); break; }
+      STBI__ZFAST_CONSUME(s);
+      dist = stbi__zdist_base[z] + (int) (bits & ((1 << stbi__zdist_extra[z]) - 1));
+      STBI__ZFAST_CONSUME(stbi__zdist_extra[z]);
+      if (zout - zout_start < dist) { result = stbi__err("bad dist","Corrupt PNG"); break; }
+
+      // copies may run up to 15 bytes past the match, inside the output margin
+      p = zout - dist;
+      if (dist >= 16) {
+         stbi_uc *end = zout + len;
+         do { memcpy(zout, p, 16); zout += 16; p += 16; } while (zout < end);
+         zout = end;
+      } else if (dist >= 8) {
+         stbi_uc *end = zout + len;
+         do { memcpy(zout, p, 8); zout += 8; p += 8; } while (zout < end);
+         zout = end;
+      } else if (dist == 1) {
+         memset(zout, *p, len);
+         zout += len;
+      } else {
+         do *zout++ = *p++; while (--len);
+      }
+   }
+
+   // hand the whole bytes left in the bit buffer back to the input, so the
+   // careful loop continues with its usual 32-bit buffer
+   in -= num_bits >> 3;
+   num_bits &= 7;
+   a->zbuffer = (stbi_uc *) in;
+   a->code_buffer = (stbi__uint32) (bits & ((1u << num_bits) - 1));
+   a->num_bits = num_bits;
+   a->zout = (char *) zout;
+   return result;
+}
+#endif // STBI_NO_FAST_INFLATE
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z;
+#ifndef STBI_NO_FAST_INFLATE
+      if (a->zfast && stbi__zfast_ready(a, zout)) {
+         int r;
+         a->zout = zout;
+         r = stbi__parse_huffman_block_fast(a);
+         if (r != 2) return r;
+         zout = a->zout;
+      }
+#endif
+      z = stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4427,8 +5803,17 @@ static int stbi__parse_uncompressed_block(stbi__zbuf *a)
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return stbi__err("zlib corrupt","Corrupt PNG");
    if (a->zbuffer + len > a->zbuffer_end) return stbi__err("read past buffer","Corrupt PNG");
-   if (a->zout + len > a->zout_end)
+   if (a->zout + len > a->zout_end) {
+      if (!a->z_expandable) {
+         // fill a fixed buffer as far as it goes before failing, so a prefix decode
+         // (stbi__zlib_decode_prefix) gets its bytes out of a block that runs past it
+         k = (int) (a->zout_end - a->zout);
+         memcpy(a->zout, a->zbuffer, k);
+         a->zout += k;
+         return stbi__err("output buffer limit","Corrupt PNG");
+      }
       if (!stbi__zexpand(a, a->zout, len)) return 0;
+   }
    memcpy(a->zout, a->zbuffer, len);
    a->zbuffer += len;
    a->zout += len;
@@ -4501,18 +5886,31 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
+#ifndef STBI_NO_FAST_INFLATE
+         a->zmulti_built = 0;
+#endif
          if (!stbi__parse_huffman_block(a)) return 0;
       }
    } while (!final);
    return 1;
 }
 
+static int stbi__fast_inflate = 1;
+
+STBIDEF void stbi_set_fast_inflate(int flag_true_if_fast)
+{
+   stbi__fast_inflate = flag_true_if_fast;
+}
+
 static int stbi__do_zlib(stbi__zbuf *a, char *obuf, int olen, int exp, int parse_header)
 {
    a->zout_start = obuf;
    a->zout       = obuf;
    a->zout_end   = obuf + olen;
    a->z_expandable = exp;
+#ifndef STBI_NO_FAST_INFLATE
+   a->zfast = stbi__fast_inflate;
+#endif
 
    return stbi__parse_zlib(a, parse_header);
 }
@@ -4632,6 +6030,7 @@ typedef struct
    stbi__context *s;
    stbi_uc *idata, *expanded, *out;
    int depth;
+   stbi__rows rows; // where create_png_image_raw writes
 } stbi__png;
 
 
@@ -4692,25 +6091,184 @@ static void stbi__create_png_alpha_expand8(stbi_uc *dest, stbi_uc *src, stbi__ui
    }
 }
 
+#ifdef STBI_SSE2
+// SIMD row unfiltering for 8-bit images with 3 or 4 bytes per pixel. Up has
+// no dependency between pixels and is done 16 (or 32, with AVX2) bytes at a
+// time. Sub runs a prefix sum over 4 pixels per register. Avg and Paeth depend
+// on the pixel just decoded, so they work on one pixel at a time, with all its
+// channels in one register. Each kernel leaves a scalar tail for the last
+// bytes, so no load or store goes past the end of the row.
+
+stbi_inline static __m128i stbi__png_load4(const stbi_uc *p)
+{
+   int v;
+   memcpy(&v, p, 4);
+   return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store4(stbi_uc *p, __m128i v)
+{
+   int x = _mm_cvtsi128_si32(v);
+   memcpy(p, &x, 4);
+}
+
+static void stbi__png_unfilter_up_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int k, int nk)
+{
+   for (; k+16 <= nk; k += 16) {
+      __m128i r = _mm_loadu_si128((const __m128i *) (raw+k));
+      __m128i b = _mm_loadu_si128((const __m128i *) (prior+k));
+      _mm_storeu_si128((__m128i *) (cur+k), _mm_add_epi8(r, b));
+   }
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+#ifdef STBI_AVX2
+STBI__AVX2_TARGET static void stbi__png_unfilter_up_avx2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk)
+{
+   int k;
+   for (k=0; k+32 <= nk; k += 32) {
+      __m256i r = _mm256_loadu_si256((const __m256i *) (raw+k));
+      __m256i b = _mm256_loadu_si256((const __m256i *) (prior+k));
+      _mm256_storeu_si256((__m256i *) (cur+k), _mm256_add_epi8(r, b));
+   }
+   _mm256_zeroupper();
+   stbi__png_unfilter_up_sse2(cur, raw, prior, k, nk);
+}
+#endif
+
+static void stbi__png_unfilter_sub_sse2(stbi_uc *cur, const stbi_uc *raw, int nk, int filter_bytes)
+{
+   __m128i carry = _mm_setzero_si128(); // last decoded pixel, repeated in every pixel slot
+   int k = 0;
+   if (filter_bytes == 4) {
+      for (; k+16 <= nk; k += 16) {
+         __m128i x = _mm_loadu_si128((const __m128i *) (raw+k));
+         x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+         x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+         x = _mm_add_epi8(x, carry);
+         _mm_storeu_si128((__m128i *) (cur+k), x);
+         carry = _mm_shuffle_epi32(x, 0xff);
+      }
+   } else {
+      // 4 pixels in the low 12 bytes; the top 4 bytes are stored too, but
+      // overwritten by the next iteration or the tail
+      const __m128i pixel_mask = _mm_setr_epi8(-1,-1,-1, 0,0,0,0,0,0,0,0,0,0,0,0,0);
+      for (; k+16 <= nk; k += 12) {
+         __m128i x = _mm_loadu_si128((const __m128i *) (raw+k));
+         x = _mm_add_epi8(x, _mm_slli_si128(x, 3));
+         x = _mm_add_epi8(x, _mm_slli_si128(x, 6));
+         x = _mm_add_epi8(x, carry);
+         _mm_storeu_si128((__m128i *) (cur+k), x);
+         carry = _mm_and_si128(_mm_srli_si128(x, 9), pixel_mask);
+         carry = _mm_add_epi8(carry, _mm_slli_si128(carry, 3));
+         carry = _mm_add_epi8(carry, _mm_slli_si128(carry, 6));
+      }
+   }
+   for (; k < filter_bytes && k < nk; ++k)
+      cur[k] = raw[k];
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + cur[k-filter_bytes]);
+}
+
+static void stbi__png_unfilter_avg_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int filter_bytes)
+{
+   const __m128i one = _mm_set1_epi8(1);
+   __m128i a = _mm_setzero_si128();
+   int k;
+   // 4-byte loads and stores, so with 3 bytes per pixel the last pixel is left to the tail
+   for (k=0; k+4 <= nk; k += filter_bytes) {
+      __m128i b = stbi__png_load4(prior+k);
+      // floor((a+b)/2); _mm_avg_epu8 rounds up
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      a = _mm_add_epi8(stbi__png_load4(raw+k), avg);
+      stbi__png_store4(cur+k, a);
+   }
+   for (; k < filter_bytes && k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + (prior[k]>>1));
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + ((prior[k] + cur[k-filter_bytes])>>1));
+}
+
+static void stbi__png_unfilter_paeth_sse2(stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int filter_bytes)
+{
+   // same formulation as stbi__paeth, in 16-bit lanes; a (left) is the only input
+   // that depends on the previous pixel, so everything else is computed off that chain
+   const __m128i zero = _mm_setzero_si128();
+   const __m128i low_byte = _mm_set1_epi16(0xff);
+   __m128i a = zero, c = zero; // left, above left
+   int k;
+   for (k=0; k+4 <= nk; k += filter_bytes) {
+      __m128i b = _mm_unpacklo_epi8(stbi__png_load4(prior+k), zero);
+      __m128i r = _mm_unpacklo_epi8(stbi__png_load4(raw+k), zero);
+      __m128i c3b = _mm_sub_epi16(_mm_add_epi16(c, _mm_add_epi16(c, c)), b);
+      __m128i thresh = _mm_sub_epi16(c3b, a);
+      __m128i lo = _mm_min_epi16(a, b);
+      __m128i hi = _mm_max_epi16(a, b);
+      __m128i use_c = _mm_cmpgt_epi16(hi, thresh);  // !(hi <= thresh)
+      __m128i use_hi = _mm_cmpgt_epi16(thresh, lo); // !(thresh <= lo)
+      __m128i t0 = _mm_or_si128(_mm_and_si128(use_c, c), _mm_andnot_si128(use_c, lo));
+      __m128i t1 = _mm_or_si128(_mm_and_si128(use_hi, t0), _mm_andnot_si128(use_hi, hi));
+      a = _mm_and_si128(_mm_add_epi16(r, t1), low_byte);
+      stbi__png_store4(cur+k, _mm_packus_epi16(a, a));
+      c = b;
+   }
+   for (; k < filter_bytes && k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + prior[k]); // prior[k] == stbi__paeth(0,prior[k],0)
+   for (; k < nk; ++k)
+      cur[k] = STBI__BYTECAST(raw[k] + stbi__paeth(cur[k-filter_bytes], prior[k], prior[k-filter_bytes]));
+}
+
+// returns 0 for filters it leaves to the scalar code
+static int stbi__png_unfilter_simd(int filter, stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int filter_bytes, int avx2)
+{
+   STBI_NOTUSED(avx2);
+   switch (filter) {
+   case STBI__F_sub:
+      stbi__png_unfilter_sub_sse2(cur, raw, nk, filter_bytes);
+      return 1;
+   case STBI__F_up:
+#ifdef STBI_AVX2
+      if (avx2) {
+         stbi__png_unfilter_up_avx2(cur, raw, prior, nk);
+         return 1;
+      }
+#endif
+      stbi__png_unfilter_up_sse2(cur, raw, prior, 0, nk);
+      return 1;
+   case STBI__F_avg:
+      stbi__png_unfilter_avg_sse2(cur, raw, prior, nk, filter_bytes);
+      return 1;
+   case STBI__F_paeth:
+      stbi__png_unfilter_paeth_sse2(cur, raw, prior, nk, filter_bytes);
+      return 1;
+   }
+   return 0;
+}
+#endif // STBI_SSE2
+
 // create the png data from post-deflated data
+// writes the image to a->rows, which the caller sets up
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
    int bytes = (depth == 16 ? 2 : 1);
    stbi__context *s = a->s;
-   stbi__uint32 i,j,stride = x*out_n*bytes;
+   stbi__uint32 i,j;
    stbi__uint32 img_len, img_width_bytes;
    stbi_uc *filter_buf;
    int all_ok = 1;
    int k;
    int img_n = s->img_n; // copy it into a local for later
 
-   int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+#ifdef STBI_SSE2
+   int simd_level = stbi_simd_level();
+   int simd_filters = depth == 8 && (img_n == 3 || img_n == 4) && simd_level >= STBI_simd_sse2;
+   int avx2 = simd_level >= STBI_simd_avx2;
+#endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
-   a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
-   if (!a->out) return stbi__err("outofmem", "Out of memory");
 
    // note: error exits here don't need to clean up a->out individually,
    // stbi__do_png always does on error.
@@ -4738,9 +6296,10 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // cur/prior filter buffers alternate
       stbi_uc *cur = filter_buf + (j & 1)*img_width_bytes;
       stbi_uc *prior = filter_buf + (~j & 1)*img_width_bytes;
-      stbi_uc *dest = a->out + stride*j;
+      stbi_uc *dest = a->rows.first + a->rows.step*j;
       int nk = width * filter_bytes;
       int filter = *raw++;
+      int done = 0;
 
       // check filter type
       if (filter > 4) {
@@ -4751,8 +6310,13 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
 
+#ifdef STBI_SSE2
+      if (simd_filters)
+         done = stbi__png_unfilter_simd(filter, cur, raw, prior, nk, filter_bytes, avx2);
+#endif
+
       // perform actual filtering
-      switch (filter) {
+      if (!done) switch (filter) {
       case STBI__F_none:
          memcpy(cur, raw, nk);
          break;
@@ -4867,7 +6431,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
    if (!interlaced)
       return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
 
-   // de-interlacing
+   // de-interlacing; the passes decode into blocks of their own
    final = (stbi_uc *) stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
    if (!final) return stbi__err("outofmem", "Out of memory");
    for (p=0; p < 7; ++p) {
@@ -4881,6 +6445,13 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
       y = (a->s->img_y - yorig[p] + yspc[p]-1) / yspc[p];
       if (x && y) {
          stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
+         a->out = (stbi_uc *) stbi__malloc_mad3(x, y, out_bytes, 0);
+         if (!a->out) {
+            STBI_FREE(final);
+            return stbi__err("outofmem", "Out of memory");
+         }
+         a->rows.first = a->out;
+         a->rows.step = x * out_bytes;
          if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
             STBI_FREE(final);
             return 0;
@@ -4888,6 +6459,7 @@ static int stbi__create_png_image(stbi__png *a, stbi_uc *image_data, stbi__uint3
          for (j=0; j < y; ++j) {
             for (i=0; i < x; ++i) {
                int out_y = j*yspc[p]+yorig[p];
+               if (a->rows.flipped) out_y = a->s->img_y-1 - out_y;
                int out_x = i*xspc[p]+xorig[p];
                memcpy(final + out_y*a->s->img_x*out_bytes + out_x*out_bytes,
                       a->out + (j*x+i)*out_bytes, out_bytes);
@@ -5075,6 +6647,28 @@ static void stbi__de_iphone(stbi__png *z)
 
 #define STBI__PNG_TYPE(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
+// inflates only the first len bytes of a zlib stream, e.g. the first Adam7
+// pass of an interlaced PNG for a preview
+static stbi_uc *stbi__zlib_decode_prefix(stbi_uc *buffer, int buffer_len, stbi__uint32 len, int parse_header)
+{
+   stbi__zbuf a;
+   // the decoder stops with an "output buffer limit" error when the buffer is
+   // full; a match can run past len, so leave room for the longest one
+   char *p = (char *) stbi__malloc_mad2(len, 1, 258);
+   int ended;
+   if (p == NULL) return stbi__errpuc("outofmem", "Out of memory");
+   a.zbuffer = buffer;
+   a.zbuffer_end = buffer + buffer_len;
+   ended = stbi__do_zlib(&a, p, (int) len + 258, 0, parse_header);
+   // a full buffer is what stops a valid stream early, and it holds the prefix
+   if ((stbi__uint32) (a.zout - a.zout_start) < len) {
+      STBI_FREE(p);
+      // otherwise the decoder has said what went wrong
+      return ended ? stbi__errpuc("not enough pixels", "Corrupt PNG") : NULL;
+   }
+   return (stbi_uc *) p;
+}
+
 static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
 {
    stbi_uc palette[1024], pal_img_n=0;
@@ -5087,6 +6681,7 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
    z->expanded = NULL;
    z->idata = NULL;
    z->out = NULL;
+   z->rows.in_output = z->rows.flipped = 0;
 
    if (!stbi__check_png_header(s)) return 0;
 
@@ -5201,17 +6796,39 @@ static int stbi__parse_png_file(stbi__png *z, int scan, int req_comp)
             if (first) return stbi__err("first not IHDR", "Corrupt PNG");
             if (scan != STBI__SCAN_load) return 1;
             if (z->idata == NULL) return stbi__err("no IDAT","Corrupt PNG");
-            // initial guess for decoded data size to avoid unnecessary reallocs
-            bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
-            raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
-            z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
+            if (s->preview) {
+               // the first Adam7 pass is laid out exactly like a non-interlaced
+               // image of 1/8 the size, so from here on that is the image
+               if (!interlace) return stbi__err("no preview", "Only interlaced PNGs have a preview");
+               s->img_x = (s->img_x + 7) >> 3;
+               s->img_y = (s->img_y + 7) >> 3;
+               interlace = 0;
+               raw_len = (((s->img_n * s->img_x * z->depth) + 7) >> 3) * s->img_y + s->img_y;
+               z->expanded = stbi__zlib_decode_prefix(z->idata, ioff, raw_len, !is_iphone);
+            } else {
+               // initial guess for decoded data size to avoid unnecessary reallocs
+               bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
+               raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
+               z->expanded = (stbi_uc *) stbi_zlib_decode_malloc_guesssize_headerflag((char *) z->idata, ioff, raw_len, (int *) &raw_len, !is_iphone);
+            }
             if (z->expanded == NULL) return 0; // zlib should set error
             STBI_FREE(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n+1 && req_comp != 3 && !pal_img_n) || has_trans)
                s->img_out_n = s->img_n+1;
             else
                s->img_out_n = s->img_n;
+            if (!interlace) {
+               // rows that need no more work once unfiltered can go straight to stbi_load_into_*'s
+               // buffer. The steps below work pixel by pixel, so they don't mind flipped rows
+               int final = z->depth <= 8 && !has_trans && !pal_img_n && !is_iphone && (!req_comp || req_comp == s->img_out_n);
+               if (!stbi__start_rows(s, &z->rows, s->img_x, s->img_y, s->img_out_n * (z->depth == 16 ? 2 : 1), 0, final)) return 0;
+               if (!z->rows.in_output) z->out = z->rows.image;
+            } else {
+               z->rows.in_output = 0;
+               z->rows.flipped = stbi__vertically_flip_on_load && !s->output;
+            }
             if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+            if (z->rows.in_output) z->out = z->rows.image;
             if (has_trans) {
                if (z->depth == 16) {
                   if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
@@ -5273,6 +6890,8 @@ static void *stbi__do_png(stbi__png *p, int *x, int *y, int *n, int req_comp, st
          return stbi__errpuc("bad bits_per_channel", "PNG not supported: unsupported color depth");
       result = p->out;
       p->out = NULL;
+      ri->in_output = p->rows.in_output;
+      ri->flipped = p->rows.flipped;
       if (req_comp && req_comp != p->s->img_out_n) {
          if (ri->bits_per_channel == 8)
             result = stbi__convert_format((unsigned char *) result, p->s->img_out_n, req_comp, p->s->img_x, p->s->img_y);
@@ -5534,15 +7153,15 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    unsigned int mr=0,mg=0,mb=0,ma=0, all_a;
    stbi_uc pal[256][4];
    int psize=0,i,j,width;
-   int flip_vertically, pad, target;
+   int bottom_up, pad, target;
    stbi__bmp_data info;
-   STBI_NOTUSED(ri);
+   stbi__rows rows;
 
    info.all_a = 255;
    if (stbi__bmp_parse_header(s, &info) == NULL)
       return NULL; // error code already set
 
-   flip_vertically = ((int) s->img_y) > 0;
+   bottom_up = ((int) s->img_y) > 0;
    s->img_y = abs((int) s->img_y);
 
    if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__errpuc("too large","Very large image (corrupt?)");
@@ -5594,11 +7213,16 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
    if (!stbi__mad3sizes_valid(target, s->img_x, s->img_y, 0))
       return stbi__errpuc("too large", "Corrupt BMP");
 
-   out = (stbi_uc *) stbi__malloc_mad3(target, s->img_x, s->img_y, 0);
-   if (!out) return stbi__errpuc("outofmem", "Out of memory");
+   if (!stbi__start_rows(s, &rows, s->img_x, s->img_y, target, 0, !req_comp || req_comp == target)) return NULL;
+   // the rows of a bottom-up file are stored last to first; instead of swapping them afterwards,
+   // each one is written where it ends up, which also takes care of a requested flip
+   if (bottom_up && s->img_y > 0) {
+      rows.first += rows.step * (ptrdiff_t) (s->img_y - 1);
+      rows.step = -rows.step;
+   }
    if (info.bpp < 16) {
       int z=0;
-      if (psize == 0 || psize > 256) { STBI_FREE(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
+      if (psize == 0 || psize > 256) { stbi__free_rows(&rows); return stbi__errpuc("invalid", "Corrupt BMP"); }
       for (i=0; i < psize; ++i) {
          pal[i][2] = stbi__get8(s);
          pal[i][1] = stbi__get8(s);
@@ -5610,11 +7234,13 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
       if (info.bpp == 1) width = (s->img_x + 7) >> 3;
       else if (info.bpp == 4) width = (s->img_x + 1) >> 1;
       else if (info.bpp == 8) width = s->img_x;
-      else { STBI_FREE(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
+      else { stbi__free_rows(&rows); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
       pad = (-width)&3;
       if (info.bpp == 1) {
          for (j=0; j < (int) s->img_y; ++j) {
             int bit_offset = 7, v = stbi__get8(s);
+            out = rows.first + rows.step*j;
+            z = 0;
             for (i=0; i < (int) s->img_x; ++i) {
                int color = (v>>bit_offset)&0x1;
                out[z++] = pal[color][0];
@@ -5631,6 +7257,8 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
          }
       } else {
          for (j=0; j < (int) s->img_y; ++j) {
+            out = rows.first + rows.step*j;
+            z = 0;
             for (i=0; i < (int) s->img_x; i += 2) {
                int v=stbi__get8(s),v2=0;
                if (info.bpp == 4) {
@@ -5667,15 +7295,17 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
             easy = 2;
       }
       if (!easy) {
-         if (!mr || !mg || !mb) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+         if (!mr || !mg || !mb) { stbi__free_rows(&rows); return stbi__errpuc("bad masks", "Corrupt BMP"); }
          // right shift amt to put high bit in position #7
          rshift = stbi__high_bit(mr)-7; rcount = stbi__bitcount(mr);
          gshift = stbi__high_bit(mg)-7; gcount = stbi__bitcount(mg);
          bshift = stbi__high_bit(mb)-7; bcount = stbi__bitcount(mb);
          ashift = stbi__high_bit(ma)-7; acount = stbi__bitcount(ma);
-         if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+         if (rcount > 8 || gcount > 8 || bcount > 8 || acount > 8) { stbi__free_rows(&rows); return stbi__errpuc("bad masks", "Corrupt BMP"); }
       }
       for (j=0; j < (int) s->img_y; ++j) {
+         out = rows.first + rows.step*j;
+         z = 0;
          if (easy) {
             for (i=0; i < (int) s->img_x; ++i) {
                unsigned char a;
@@ -5706,20 +7336,13 @@ static void *stbi__bmp_load(stbi__context *s, int *x, int *y, int *comp, int req
 
    // if alpha channel is all 0s, replace with all 255s
    if (target == 4 && all_a == 0)
-      for (i=4*s->img_x*s->img_y-1; i >= 0; i -= 4)
-         out[i] = 255;
-
-   if (flip_vertically) {
-      stbi_uc t;
-      for (j=0; j < (int) s->img_y>>1; ++j) {
-         stbi_uc *p1 = out +      j     *s->img_x*target;
-         stbi_uc *p2 = out + (s->img_y-1-j)*s->img_x*target;
-         for (i=0; i < (int) s->img_x*target; ++i) {
-            t = p1[i]; p1[i] = p2[i]; p2[i] = t;
-         }
-      }
-   }
+      for (j=0; j < (int) s->img_y; ++j)
+         for (out = rows.first + rows.step*j, i=3; i < 4*(int) s->img_x; i += 4)
+            out[i] = 255;
 
+   out = rows.image;
+   ri->in_output = rows.in_output;
+   ri->flipped = rows.flipped;
    if (req_comp && req_comp != target) {
       out = stbi__convert_format(out, target, req_comp, s->img_x, s->img_y);
       if (out == NULL) return out; // stbi__convert_format frees input on failure
@@ -5889,12 +7512,15 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    //   image data
    unsigned char *tga_data;
    unsigned char *tga_palette = NULL;
+   unsigned char *tga_row = NULL;
+   stbi__rows rows;
+   int tga_column = 0, tga_line = 0;
    int i, j;
    unsigned char raw_data[4] = {0};
    int RLE_count = 0;
    int RLE_repeating = 0;
    int read_next_pixel = 1;
-   STBI_NOTUSED(ri);
+   int swap_rb;
    STBI_NOTUSED(tga_x_origin); // @TODO
    STBI_NOTUSED(tga_y_origin); // @TODO
 
@@ -5924,24 +7550,37 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
    if (!stbi__mad3sizes_valid(tga_width, tga_height, tga_comp, 0))
       return stbi__errpuc("too large", "Corrupt TGA");
 
-   tga_data = (unsigned char*)stbi__malloc_mad3(tga_width, tga_height, tga_comp, 0);
-   if (!tga_data) return stbi__errpuc("outofmem", "Out of memory");
+   if (!stbi__start_rows(s, &rows, tga_width, tga_height, tga_comp, 0, !req_comp || req_comp == tga_comp)) return NULL;
+   // rows stored bottom up are written where they end up rather than swapped afterwards,
+   // which also takes care of a requested flip
+   if (tga_inverted && tga_height > 0) {
+      rows.first += rows.step * (tga_height - 1);
+      rows.step = -rows.step;
+   }
+   // BGR is swapped to RGB as it is read; RGB16 data already is in the right order
+   swap_rb = tga_comp >= 3 && !tga_rgb16;
 
    // skip to the data's starting position (offset usually = 0)
    stbi__skip(s, tga_offset );
 
    if ( !tga_indexed && !tga_is_RLE && !tga_rgb16 ) {
       for (i=0; i < tga_height; ++i) {
-         int row = tga_inverted ? tga_height -i - 1 : i;
-         stbi_uc *tga_row = tga_data + row*tga_width*tga_comp;
+         tga_row = rows.first + rows.step*i;
          stbi__getn(s, tga_row, tga_width * tga_comp);
+         if (swap_rb) {
+            for (j=0; j < tga_width * tga_comp; j += tga_comp) {
+               unsigned char temp = tga_row[j];
+               tga_row[j] = tga_row[j+2];
+               tga_row[j+2] = temp;
+            }
+         }
       }
    } else  {
       //   do I need to load a palette?
       if ( tga_indexed)
       {
          if (tga_palette_len == 0) {  /* you have to have at least one entry! */
-            STBI_FREE(tga_data);
+            stbi__free_rows(&rows);
             return stbi__errpuc("bad palette", "Corrupt TGA");
          }
 
@@ -5950,7 +7589,7 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
          //   load the palette
          tga_palette = (unsigned char*)stbi__malloc_mad2(tga_palette_len, tga_comp, 0);
          if (!tga_palette) {
-            STBI_FREE(tga_data);
+            stbi__free_rows(&rows);
             return stbi__errpuc("outofmem", "Out of memory");
          }
          if (tga_rgb16) {
@@ -5961,14 +7600,23 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
                pal_entry += tga_comp;
             }
          } else if (!stbi__getn(s, tga_palette, tga_palette_len * tga_comp)) {
-               STBI_FREE(tga_data);
+               stbi__free_rows(&rows);
                STBI_FREE(tga_palette);
                return stbi__errpuc("bad palette", "Corrupt TGA");
          }
+         if (swap_rb) {
+            for (i=0; i < tga_palette_len * tga_comp; i += tga_comp) {
+               unsigned char temp = tga_palette[i];
+               tga_palette[i] = tga_palette[i+2];
+               tga_palette[i+2] = temp;
+            }
+         }
       }
       //   load the data
       for (i=0; i < tga_width * tga_height; ++i)
       {
+         if (tga_column == 0)
+            tga_row = rows.first + rows.step * tga_line;
          //   if I'm in RLE mode, do I need to get a RLE stbi__pngchunk?
          if ( tga_is_RLE )
          {
@@ -6011,6 +7659,11 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
                for (j = 0; j < tga_comp; ++j) {
                   raw_data[j] = stbi__get8(s);
                }
+               if (swap_rb) {
+                  unsigned char temp = raw_data[0];
+                  raw_data[0] = raw_data[2];
+                  raw_data[2] = temp;
+               }
             }
             //   clear the reading flag for the next pixel
             read_next_pixel = 0;
@@ -6018,28 +7671,15 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
 
          // copy data
          for (j = 0; j < tga_comp; ++j)
-           tga_data[i*tga_comp+j] = raw_data[j];
+           tga_row[tga_column*tga_comp+j] = raw_data[j];
+         if (++tga_column == tga_width) {
+            tga_column = 0;
+            ++tga_line;
+         }
 
          //   in case we're in RLE mode, keep counting down
          --RLE_count;
       }
-      //   do I need to invert the image?
-      if ( tga_inverted )
-      {
-         for (j = 0; j*2 < tga_height; ++j)
-         {
-            int index1 = j * tga_width * tga_comp;
-            int index2 = (tga_height - 1 - j) * tga_width * tga_comp;
-            for (i = tga_width * tga_comp; i > 0; --i)
-            {
-               unsigned char temp = tga_data[index1];
-               tga_data[index1] = tga_data[index2];
-               tga_data[index2] = temp;
-               ++index1;
-               ++index2;
-            }
-         }
-      }
       //   clear my palette, if I had one
       if ( tga_palette != NULL )
       {
@@ -6047,18 +7687,9 @@ static void *stbi__tga_load(stbi__context *s, int *x, int *y, int *comp, int req
       }
    }
 
-   // swap RGB - if the source data was RGB16, it already is in the right order
-   if (tga_comp >= 3 && !tga_rgb16)
-   {
-      unsigned char* tga_pixel = tga_data;
-      for (i=0; i < tga_width * tga_height; ++i)
-      {
-         unsigned char temp = tga_pixel[0];
-         tga_pixel[0] = tga_pixel[2];
-         tga_pixel[2] = temp;
-         tga_pixel += tga_comp;
-      }
-   }
+   tga_data = rows.image;
+   ri->in_output = rows.in_output;
+   ri->flipped = rows.flipped;
 
    // convert to target component count
    if (req_comp && req_comp != tga_comp)
@@ -0,0 +1,120 @@
+#include "stream_ring_buffer.h"
+
+#include <atomic>
+
+namespace
+{
+    std::atomic<std::uint64_t> next_serial{ 1 };
+}
+
+StreamRingBuffer::StreamRingBuffer(const GLenum target, const std::size_t regionSize)
+    : bufferTarget(target), regionSize(regionSize), serialNumber(next_serial++)
+{
+    const auto totalSize = static_cast<GLsizeiptr>(regionSize * REGION_COUNT);
+    glGenBuffers(1, &bufferObject);
+    glBindBuffer(bufferTarget, bufferObject);
+
+    // immutable storage and persistent mapping are core since 4.4
+    if (GLAD_GL_VERSION_4_4 && glBufferStorage != nullptr)
+    {
+        constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(bufferTarget, totalSize, nullptr, flags);
+        persistentData = static_cast<unsigned char*>(glMapBufferRange(bufferTarget, 0, totalSize, flags));
+        persistentlyMapped = persistentData != nullptr;
+        if (!persistentlyMapped)
+        {
+            // storage is immutable, start over with a fresh buffer for the fallback
+            glDeleteBuffers(1, &bufferObject);
+            glGenBuffers(1, &bufferObject);
+            glBindBuffer(bufferTarget, bufferObject);
+        }
+    }
+    if (!persistentlyMapped)
+        glBufferData(bufferTarget, totalSize, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(bufferTarget, 0);
+}
+
+StreamRingBuffer::~StreamRingBuffer()
+{
+    for (GLsync& fence : fences)
+    {
+        if (fence != nullptr)
+            glDeleteSync(fence);
+    }
+    if (persistentlyMapped || mappedData != nullptr)
+    {
+        glBindBuffer(bufferTarget, bufferObject);
+        glUnmapBuffer(bufferTarget);
+    }
+    glDeleteBuffers(1, &bufferObject);
+}
+
+void StreamRingBuffer::beginFrame()
+{
+    region = (region + 1) % REGION_COUNT;
+    cursor = 0;
+    mappedData = nullptr;
+
+    GLsync& fence = fences[region];
+    if (fence == nullptr)
+        return;
+    // a zero timeout just polls; only a region still in flight counts as a stall
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED)
+    {
+        ++stalls;
+        do
+        {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);  // 1 ms
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+StreamRingBuffer::Allocation StreamRingBuffer::allocate(const std::size_t size, const std::size_t alignment)
+{
+    const std::size_t start = (cursor + alignment - 1) & ~(alignment - 1);
+    if (start + size > regionSize)
+        return { nullptr, 0, 0 };
+    cursor = start + size;
+
+    const std::size_t offset = region * regionSize + start;
+    if (persistentlyMapped)
+        return { persistentData + offset, static_cast<GLintptr>(offset), size };
+
+    if (mappedData == nullptr)
+    {
+        mappedStart = start;
+        mapRemainder();
+        if (mappedData == nullptr)
+            return { nullptr, 0, 0 };
+    }
+    return { mappedData + (start - mappedStart), static_cast<GLintptr>(offset), size };
+}
+
+void StreamRingBuffer::mapRemainder()
+{
+    // the fence in beginFrame already guarantees the GPU is done with this region, so the driver
+    // need not synchronize, and the old contents can be thrown away
+    glBindBuffer(bufferTarget, bufferObject);
+    mappedData = static_cast<unsigned char*>(glMapBufferRange(bufferTarget,
+        static_cast<GLintptr>(region * regionSize + mappedStart), static_cast<GLsizeiptr>(regionSize - mappedStart),
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+}
+
+void StreamRingBuffer::flush()
+{
+    // coherent persistent mappings need nothing; the 3.3 path must unmap before GL reads
+    if (persistentlyMapped || mappedData == nullptr)
+        return;
+    glBindBuffer(bufferTarget, bufferObject);
+    glUnmapBuffer(bufferTarget);
+    mappedData = nullptr;
+}
+
+void StreamRingBuffer::endFrame()
+{
+    flush();
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
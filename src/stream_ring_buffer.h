@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+
+
+// triple-buffered ring for data rewritten every frame (dynamic vertices, instance data,
+// uniform blocks). On GL 4.4 the buffer is mapped once, persistently and coherently, and written
+// in place. On 3.3 each frame's region is mapped unsynchronized with an invalidated range. Either
+// way a fence per region keeps the CPU from overwriting data the GPU has not consumed yet.
+class StreamRingBuffer
+{
+public:
+    static constexpr unsigned int REGION_COUNT = 3;
+
+    struct Allocation
+    {
+        void* data;         // write-only destination, null when the region is full
+        GLintptr offset;    // byte offset into buffer(), for attribute pointers and binding ranges
+        std::size_t size;
+    };
+
+    // regionSize is the most data a single frame may allocate
+    StreamRingBuffer(GLenum target, std::size_t regionSize);
+    StreamRingBuffer(const StreamRingBuffer&) = delete;
+    StreamRingBuffer& operator=(const StreamRingBuffer&) = delete;
+    ~StreamRingBuffer();
+
+    // moves to the next region, waiting on its fence if the GPU still reads it
+    void beginFrame();
+    // carves size bytes out of the current region; alignment must be a power of two
+    Allocation allocate(std::size_t size, std::size_t alignment = 256);
+    // makes everything allocated so far visible to GL; call before drawing from it
+    void flush();
+    // fences the current region so it is not reused before the GPU is done with it
+    void endFrame();
+
+    unsigned int buffer() const { return bufferObject; }
+    // unique to this ring for the life of the process, unlike buffer(): GL may hand a deleted
+    // ring's buffer name out again to the next one
+    std::uint64_t serial() const { return serialNumber; }
+    GLenum target() const { return bufferTarget; }
+    bool persistent() const { return persistentlyMapped; }
+    std::size_t capacity() const { return regionSize; }
+    // number of beginFrame() calls that actually had to wait for the GPU
+    std::size_t stallCount() const { return stalls; }
+
+private:
+    GLenum bufferTarget;
+    std::size_t regionSize;
+    std::uint64_t serialNumber;
+    unsigned int bufferObject = 0;
+    bool persistentlyMapped = false;
+    unsigned char* persistentData = nullptr;
+
+    GLsync fences[REGION_COUNT] = {};
+    unsigned int region = REGION_COUNT - 1;
+    std::size_t cursor = 0;
+
+    // 3.3 path: the part of the region mapped since the last flush
+    unsigned char* mappedData = nullptr;
+    std::size_t mappedStart = 0;
+
+    std::size_t stalls = 0;
+
+    void mapRemainder();
+};
@@ -0,0 +1,279 @@
+#include "texture_atlas.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    // matches the AtlasRegions block in shaders/atlas.vs: a uvRect per region, then the layers
+    // four to an ivec4
+    constexpr std::size_t REGION_TABLE_SIZE = TextureAtlas::MAX_REGIONS * 4 * sizeof(float) + TextureAtlas::MAX_REGIONS * sizeof(std::int32_t);
+
+    int align_up(const int value, const int alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // one layer's skyline: the top edge of everything placed so far, as runs of equal height
+    class Skyline
+    {
+    public:
+        Skyline(const int width, const int height) : width(width), height(height), nodes{ { 0, 0, width } } {}
+
+        // bottom-left: the position whose top ends up lowest, leftmost on ties
+        bool insert(const int rectWidth, const int rectHeight, int& x, int& y)
+        {
+            std::size_t best = nodes.size();
+            int bestTop = height + 1;
+            for (std::size_t i = 0; i < nodes.size(); ++i)
+            {
+                int top = 0;
+                if (fits(i, rectWidth, rectHeight, top) && top < bestTop)
+                {
+                    best = i;
+                    bestTop = top;
+                }
+            }
+            if (best == nodes.size())
+                return false;
+            x = nodes[best].x;
+            y = bestTop - rectHeight;
+            place(best, rectWidth, bestTop);
+            return true;
+        }
+
+    private:
+        struct Node
+        {
+            int x;
+            int y;
+            int width;
+        };
+
+        int width;
+        int height;
+        std::vector<Node> nodes;
+
+        // a rect whose left edge sits on node i rests on the highest node it spans
+        bool fits(const std::size_t i, const int rectWidth, const int rectHeight, int& top) const
+        {
+            if (nodes[i].x + rectWidth > width)
+                return false;
+            int y = 0;
+            int remaining = rectWidth;
+            for (std::size_t j = i; remaining > 0; ++j)
+            {
+                y = std::max(y, nodes[j].y);
+                remaining -= nodes[j].width;
+            }
+            top = y + rectHeight;
+            return top <= height;
+        }
+
+        void place(const std::size_t i, const int rectWidth, const int top)
+        {
+            const int right = nodes[i].x + rectWidth;
+            nodes.insert(nodes.begin() + static_cast<std::ptrdiff_t>(i), { nodes[i].x, top, rectWidth });
+            // trim or drop the nodes the new one now covers
+            std::size_t j = i + 1;
+            while (j < nodes.size() && nodes[j].x < right)
+            {
+                const int end = nodes[j].x + nodes[j].width;
+                if (end <= right)
+                {
+                    nodes.erase(nodes.begin() + static_cast<std::ptrdiff_t>(j));
+                    continue;
+                }
+                nodes[j].width = end - right;
+                nodes[j].x = right;
+                break;
+            }
+            // neighbours at the same height become one run
+            for (std::size_t k = 0; k + 1 < nodes.size();)
+            {
+                if (nodes[k].y == nodes[k + 1].y)
+                {
+                    nodes[k].width += nodes[k + 1].width;
+                    nodes.erase(nodes.begin() + static_cast<std::ptrdiff_t>(k + 1));
+                }
+                else
+                {
+                    ++k;
+                }
+            }
+        }
+    };
+}
+
+TextureAtlas::TextureAtlas(const int layerWidth, const int layerHeight, const int padding)
+    : layerWidth(layerWidth), layerHeight(layerHeight), padding(padding)
+{
+}
+
+TextureAtlas::~TextureAtlas()
+{
+    glDeleteTextures(1, &arrayTexture);
+    glDeleteBuffers(1, &regionBuffer);
+}
+
+int TextureAtlas::add(const unsigned char* rgba, const int width, const int height)
+{
+    if (images.size() >= MAX_REGIONS || width <= 0 || height <= 0 || width > layerWidth || height > layerHeight)
+        return -1;
+    const unsigned char* end = rgba + static_cast<std::size_t>(width) * height * 4;
+    images.push_back({ width, height, std::vector<unsigned char>(rgba, end) });
+    return static_cast<int>(images.size() - 1);
+}
+
+bool TextureAtlas::pack()
+{
+    // positions and sizes in multiples of the padding keep the gutter intact in the mip levels
+    // the padding covers. The packers work on the layer grown by the padding on every side, so
+    // a gutter may hang over the layer's edge, where clamping takes its place
+    const int alignment = std::max(1, padding);
+    const int binWidth = layerWidth + 2 * padding;
+    const int binHeight = layerHeight + 2 * padding;
+
+    std::vector<std::size_t> order(images.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [this](const std::size_t a, const std::size_t b)
+    {
+        return images[a].height != images[b].height ? images[a].height > images[b].height : images[a].width > images[b].width;
+    });
+
+    std::vector<Skyline> skylines;
+    regions.assign(images.size(), AtlasRegion());
+    for (const std::size_t index : order)
+    {
+        const Image& image = images[index];
+        const int rectWidth = align_up(image.width + 2 * padding, alignment);
+        const int rectHeight = align_up(image.height + 2 * padding, alignment);
+        int x = 0, y = 0;
+        std::size_t layer = 0;
+        while (layer < skylines.size() && !skylines[layer].insert(rectWidth, rectHeight, x, y))
+            ++layer;
+        if (layer == skylines.size())
+        {
+            skylines.emplace_back(binWidth, binHeight);
+            if (!skylines.back().insert(rectWidth, rectHeight, x, y))
+                return false;
+        }
+
+        AtlasRegion& region = regions[index];
+        region.layer = static_cast<int>(layer);
+        // the image starts a padding into its rect, and the bin a padding before the layer
+        region.x = x;
+        region.y = y;
+        region.width = image.width;
+        region.height = image.height;
+        region.uvRect = glm::vec4(static_cast<float>(x) / layerWidth, static_cast<float>(y) / layerHeight,
+            static_cast<float>(image.width) / layerWidth, static_cast<float>(image.height) / layerHeight);
+    }
+    layers = static_cast<int>(skylines.size());
+    return true;
+}
+
+void TextureAtlas::upload() const
+{
+    // the texture loader may leave its unpack buffer bound
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, layerWidth, layerHeight, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+    // each layer is composed in memory and uploaded in one call
+    const std::size_t layerRow = static_cast<std::size_t>(layerWidth) * 4;
+    std::vector<unsigned char> pixels(layerRow * layerHeight);
+    for (int layer = 0; layer < layers; ++layer)
+    {
+        std::fill(pixels.begin(), pixels.end(), static_cast<unsigned char>(0));
+        for (std::size_t i = 0; i < images.size(); ++i)
+        {
+            const AtlasRegion& region = regions[i];
+            if (region.layer != layer)
+                continue;
+            const Image& image = images[i];
+            const std::size_t imageRow = static_cast<std::size_t>(image.width) * 4;
+            // the gutter repeats the edge texels outwards
+            const int left = std::max(0, region.x - padding);
+            const int right = std::min(layerWidth, region.x + region.width + padding);
+            const int bottom = std::max(0, region.y - padding);
+            const int top = std::min(layerHeight, region.y + region.height + padding);
+            for (int y = bottom; y < top; ++y)
+            {
+                const int sourceY = std::min(std::max(y - region.y, 0), image.height - 1);
+                const unsigned char* source = &image.pixels[sourceY * imageRow];
+                unsigned char* row = &pixels[y * layerRow];
+                for (int x = left; x < region.x; ++x)
+                    std::memcpy(row + x * 4, source, 4);
+                std::memcpy(row + region.x * 4, source, imageRow);
+                for (int x = region.x + region.width; x < right; ++x)
+                    std::memcpy(row + x * 4, source + imageRow - 4, 4);
+            }
+        }
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, layerWidth, layerHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    }
+
+    // past the levels the gutter covers, images would bleed into each other; a layer holding
+    // nothing but one whole image has no neighbours, so a plain array texture keeps every level
+    const bool wholeLayers = std::all_of(regions.begin(), regions.end(), [this](const AtlasRegion& region)
+    {
+        return region.width == layerWidth && region.height == layerHeight;
+    });
+    int maxLevel = 0;
+    while ((2 << maxLevel) <= padding)
+        ++maxLevel;
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, wholeLayers ? 1000 : maxLevel);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    // the region table, padded out to the block's full size
+    std::vector<unsigned char> table(REGION_TABLE_SIZE, 0);
+    for (std::size_t i = 0; i < regions.size(); ++i)
+    {
+        // copied as bytes, since the table promises no alignment to an aligned glm::vec4
+        std::memcpy(&table[i * 4 * sizeof(float)], &regions[i].uvRect[0], 4 * sizeof(float));
+        const std::int32_t layer = regions[i].layer;
+        std::memcpy(&table[MAX_REGIONS * 4 * sizeof(float) + i * sizeof(std::int32_t)], &layer, sizeof(layer));
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, regionBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, static_cast<GLsizeiptr>(table.size()), table.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+bool TextureAtlas::build()
+{
+    if (images.empty())
+        return false;
+    if (!pack())
+    {
+        std::cout << "Failed to pack the texture atlas" << '\n';
+        return false;
+    }
+    if (arrayTexture == 0)
+    {
+        glGenTextures(1, &arrayTexture);
+        glGenBuffers(1, &regionBuffer);
+    }
+    upload();
+    return true;
+}
+
+void TextureAtlas::bind(const unsigned int unit) const
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, arrayTexture);
+    glBindBufferBase(GL_UNIFORM_BUFFER, REGION_BINDING, regionBuffer);
+}
+
+void TextureAtlas::attach(const unsigned int program)
+{
+    const unsigned int block = glGetUniformBlockIndex(program, "AtlasRegions");
+    if (block != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, block, REGION_BINDING);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+
+// where an image ended up: a layer of the array texture and the part of it the image covers
+struct AtlasRegion
+{
+    int layer = 0;
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    // maps the quad's 0..1 texture coordinates into the layer: offset in xy, scale in zw
+    glm::vec4 uvRect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+};
+
+// packs many small images into the layers of one GL_TEXTURE_2D_ARRAY, so quads that show
+// different images can share a single bind and a single instanced draw. Images are placed with
+// a bottom-left skyline packer, tallest first, and a new layer is opened whenever one fills up;
+// images as big as a layer take a layer of their own, which makes this a plain array texture.
+// Every image is surrounded by copies of its edge texels so linear filtering and the first
+// mip levels never pick up a neighbour. The region table goes to the shader as a uniform
+// block (see shaders/atlas.vs), indexed by QuadInstance::image.
+// Everything except adding images must be used from the thread that owns the GL context.
+class TextureAtlas
+{
+public:
+    // the table must fit the 16 KB uniform block every GL 3.3 driver offers
+    static constexpr std::size_t MAX_REGIONS = 512;
+    // the uniform block binding point the region table is bound to
+    static constexpr unsigned int REGION_BINDING = 0;
+
+    // layer sizes must be multiples of the padding, which must be a power of two
+    TextureAtlas(int layerWidth = 1024, int layerHeight = 1024, int padding = 4);
+    TextureAtlas(const TextureAtlas&) = delete;
+    TextureAtlas& operator=(const TextureAtlas&) = delete;
+    ~TextureAtlas();
+
+    // copies an RGBA image with rows bottom-up (GL order) and returns its region index, or -1
+    // when the table is full or the image is bigger than a layer
+    int add(const unsigned char* rgba, int width, int height);
+
+    // packs everything added so far, uploads the layers and the region table; images added
+    // afterwards need another build
+    bool build();
+
+    // binds the array texture to unit and the region table to REGION_BINDING
+    void bind(unsigned int unit) const;
+    // points a program's AtlasRegions block at REGION_BINDING
+    static void attach(unsigned int program);
+
+    const AtlasRegion& region(const std::size_t index) const { return regions[index]; }
+    std::size_t size() const { return regions.size(); }
+    int layerCount() const { return layers; }
+    unsigned int texture() const { return arrayTexture; }
+
+private:
+    struct Image
+    {
+        int width;
+        int height;
+        std::vector<unsigned char> pixels;
+    };
+
+    int layerWidth;
+    int layerHeight;
+    int padding;
+    int layers = 0;
+    std::vector<Image> images;
+    std::vector<AtlasRegion> regions;
+    unsigned int arrayTexture = 0;
+    unsigned int regionBuffer = 0;
+
+    bool pack();
+    void upload() const;
+};
@@ -0,0 +1,493 @@
+#include "texture_compressor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#if !defined(TEXTURE_COMPRESSOR_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define TEXTURE_COMPRESSOR_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "stb_image/stb_image.h"
+
+namespace
+{
+    constexpr std::uint32_t DDS_MAGIC = 0x20534444;     // "DDS "
+    constexpr std::uint32_t DDS_HEADER_SIZE = 124;      // without the magic
+    constexpr std::uint32_t FOURCC_DXT1 = 0x31545844;
+    constexpr std::uint32_t FOURCC_DXT5 = 0x35545844;
+    // caps, height, width, pixel format, mipmap count, linear size
+    constexpr std::uint32_t DDSD_FLAGS = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+    constexpr std::uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+    constexpr std::uint32_t DDPF_FOURCC = 0x4;
+    // complex, texture, mipmap
+    constexpr std::uint32_t DDSCAPS = 0x8 | 0x1000 | 0x400000;
+
+    // a 4x4 block, one array per channel so that four pixels go through SSE at a time
+    struct BlockPixels
+    {
+        alignas(16) float r[16];
+        alignas(16) float g[16];
+        alignas(16) float b[16];
+        unsigned char a[16];
+    };
+
+    struct Color
+    {
+        float r, g, b;
+    };
+
+    std::uint16_t pack_565(const Color& color)
+    {
+        const auto quantize = [](const float value, const int maximum)
+        {
+            return std::min(maximum, std::max(0, static_cast<int>(value * static_cast<float>(maximum) / 255.0f + 0.5f)));
+        };
+        return static_cast<std::uint16_t>(quantize(color.r, 31) << 11 | quantize(color.g, 63) << 5 | quantize(color.b, 31));
+    }
+
+    // the color a decoder expands the endpoint to
+    Color unpack_565(const std::uint16_t packed)
+    {
+        const int r = packed >> 11 & 31;
+        const int g = packed >> 5 & 63;
+        const int b = packed & 31;
+        return { static_cast<float>(r << 3 | r >> 2), static_cast<float>(g << 2 | g >> 4), static_cast<float>(b << 3 | b >> 2) };
+    }
+
+#ifdef TEXTURE_COMPRESSOR_SSE2
+    float horizontal_sum(const __m128 value)
+    {
+        alignas(16) float lanes[4];
+        _mm_store_ps(lanes, value);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+
+    // picks the nearest of the four palette entries between first and last for every pixel by
+    // projecting it onto the line between them. Indices run 0 (first) to 3 (last); returns the
+    // squared error against the interpolated palette
+    float select_indices(const BlockPixels& block, const Color& first, const Color& last, int* indices)
+    {
+        const Color direction = { last.r - first.r, last.g - first.g, last.b - first.b };
+        const float lengthSquared = direction.r * direction.r + direction.g * direction.g + direction.b * direction.b;
+        const float scale = lengthSquared > 0.0f ? 3.0f / lengthSquared : 0.0f;
+#ifdef TEXTURE_COMPRESSOR_SSE2
+        const __m128 firstR = _mm_set1_ps(first.r), firstG = _mm_set1_ps(first.g), firstB = _mm_set1_ps(first.b);
+        const __m128 directionR = _mm_set1_ps(direction.r), directionG = _mm_set1_ps(direction.g), directionB = _mm_set1_ps(direction.b);
+        const __m128 scaleVector = _mm_set1_ps(scale);
+        const __m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f), three = _mm_set1_ps(3.0f), third = _mm_set1_ps(1.0f / 3.0f);
+        __m128 error = _mm_setzero_ps();
+        for (int i = 0; i < 16; i += 4)
+        {
+            const __m128 r = _mm_sub_ps(_mm_load_ps(block.r + i), firstR);
+            const __m128 g = _mm_sub_ps(_mm_load_ps(block.g + i), firstG);
+            const __m128 b = _mm_sub_ps(_mm_load_ps(block.b + i), firstB);
+            __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, directionR), _mm_mul_ps(g, directionG)), _mm_mul_ps(b, directionB));
+            t = _mm_min_ps(_mm_max_ps(_mm_mul_ps(t, scaleVector), zero), three);
+            // t is never negative here, so truncating rounds to nearest
+            const __m128i index = _mm_cvttps_epi32(_mm_add_ps(t, half));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), index);
+            const __m128 weight = _mm_mul_ps(_mm_cvtepi32_ps(index), third);
+            const __m128 errorR = _mm_sub_ps(r, _mm_mul_ps(weight, directionR));
+            const __m128 errorG = _mm_sub_ps(g, _mm_mul_ps(weight, directionG));
+            const __m128 errorB = _mm_sub_ps(b, _mm_mul_ps(weight, directionB));
+            error = _mm_add_ps(error, _mm_add_ps(_mm_add_ps(_mm_mul_ps(errorR, errorR), _mm_mul_ps(errorG, errorG)), _mm_mul_ps(errorB, errorB)));
+        }
+        return horizontal_sum(error);
+#else
+        float error = 0.0f;
+        for (int i = 0; i < 16; ++i)
+        {
+            const float r = block.r[i] - first.r;
+            const float g = block.g[i] - first.g;
+            const float b = block.b[i] - first.b;
+            const float t = std::min(std::max((r * direction.r + g * direction.g + b * direction.b) * scale, 0.0f), 3.0f);
+            indices[i] = static_cast<int>(t + 0.5f);
+            const float weight = static_cast<float>(indices[i]) * (1.0f / 3.0f);
+            const float errorR = r - weight * direction.r;
+            const float errorG = g - weight * direction.g;
+            const float errorB = b - weight * direction.b;
+            error += errorR * errorR + errorG * errorG + errorB * errorB;
+        }
+        return error;
+#endif
+    }
+
+    // mean and covariance of the block's colors, covariance as rr, gg, bb, rg, rb, gb
+    void color_statistics(const BlockPixels& block, Color& mean, float* covariance)
+    {
+#ifdef TEXTURE_COMPRESSOR_SSE2
+        __m128 sumR = _mm_setzero_ps(), sumG = _mm_setzero_ps(), sumB = _mm_setzero_ps();
+        for (int i = 0; i < 16; i += 4)
+        {
+            sumR = _mm_add_ps(sumR, _mm_load_ps(block.r + i));
+            sumG = _mm_add_ps(sumG, _mm_load_ps(block.g + i));
+            sumB = _mm_add_ps(sumB, _mm_load_ps(block.b + i));
+        }
+        mean = { horizontal_sum(sumR) / 16.0f, horizontal_sum(sumG) / 16.0f, horizontal_sum(sumB) / 16.0f };
+        const __m128 meanR = _mm_set1_ps(mean.r), meanG = _mm_set1_ps(mean.g), meanB = _mm_set1_ps(mean.b);
+        __m128 sums[6] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+        for (int i = 0; i < 16; i += 4)
+        {
+            const __m128 r = _mm_sub_ps(_mm_load_ps(block.r + i), meanR);
+            const __m128 g = _mm_sub_ps(_mm_load_ps(block.g + i), meanG);
+            const __m128 b = _mm_sub_ps(_mm_load_ps(block.b + i), meanB);
+            sums[0] = _mm_add_ps(sums[0], _mm_mul_ps(r, r));
+            sums[1] = _mm_add_ps(sums[1], _mm_mul_ps(g, g));
+            sums[2] = _mm_add_ps(sums[2], _mm_mul_ps(b, b));
+            sums[3] = _mm_add_ps(sums[3], _mm_mul_ps(r, g));
+            sums[4] = _mm_add_ps(sums[4], _mm_mul_ps(r, b));
+            sums[5] = _mm_add_ps(sums[5], _mm_mul_ps(g, b));
+        }
+        for (int i = 0; i < 6; ++i)
+            covariance[i] = horizontal_sum(sums[i]);
+#else
+        mean = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i)
+        {
+            mean.r += block.r[i];
+            mean.g += block.g[i];
+            mean.b += block.b[i];
+        }
+        mean = { mean.r / 16.0f, mean.g / 16.0f, mean.b / 16.0f };
+        std::fill(covariance, covariance + 6, 0.0f);
+        for (int i = 0; i < 16; ++i)
+        {
+            const float r = block.r[i] - mean.r;
+            const float g = block.g[i] - mean.g;
+            const float b = block.b[i] - mean.b;
+            covariance[0] += r * r;
+            covariance[1] += g * g;
+            covariance[2] += b * b;
+            covariance[3] += r * g;
+            covariance[4] += r * b;
+            covariance[5] += g * b;
+        }
+#endif
+    }
+
+    // solves for the endpoints that best reproduce the block with the given indices; false when
+    // every pixel uses the same index and the endpoints are not determined
+    bool least_squares_endpoints(const BlockPixels& block, const int* indices, Color& first, Color& last)
+    {
+        float firstWeights = 0.0f, crossWeights = 0.0f, lastWeights = 0.0f;
+        Color firstSum = { 0.0f, 0.0f, 0.0f }, lastSum = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i)
+        {
+            const float weight = static_cast<float>(indices[i]) * (1.0f / 3.0f);
+            const float inverse = 1.0f - weight;
+            firstWeights += inverse * inverse;
+            crossWeights += inverse * weight;
+            lastWeights += weight * weight;
+            firstSum = { firstSum.r + inverse * block.r[i], firstSum.g + inverse * block.g[i], firstSum.b + inverse * block.b[i] };
+            lastSum = { lastSum.r + weight * block.r[i], lastSum.g + weight * block.g[i], lastSum.b + weight * block.b[i] };
+        }
+        const float determinant = firstWeights * lastWeights - crossWeights * crossWeights;
+        if (std::fabs(determinant) < 1e-6f)
+            return false;
+        const float factor = 1.0f / determinant;
+        first = {
+            (lastWeights * firstSum.r - crossWeights * lastSum.r) * factor,
+            (lastWeights * firstSum.g - crossWeights * lastSum.g) * factor,
+            (lastWeights * firstSum.b - crossWeights * lastSum.b) * factor };
+        last = {
+            (firstWeights * lastSum.r - crossWeights * firstSum.r) * factor,
+            (firstWeights * lastSum.g - crossWeights * firstSum.g) * factor,
+            (firstWeights * lastSum.b - crossWeights * firstSum.b) * factor };
+        return true;
+    }
+
+    void write_color_block(const BlockPixels& block, unsigned char* out)
+    {
+        Color mean;
+        float covariance[6];
+        color_statistics(block, mean, covariance);
+
+        // principal axis by power iteration; a few rounds are plenty for 16 pixels
+        Color axis = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 4; ++iteration)
+        {
+            const Color next = {
+                covariance[0] * axis.r + covariance[3] * axis.g + covariance[4] * axis.b,
+                covariance[3] * axis.r + covariance[1] * axis.g + covariance[5] * axis.b,
+                covariance[4] * axis.r + covariance[5] * axis.g + covariance[2] * axis.b };
+            const float length = std::sqrt(next.r * next.r + next.g * next.g + next.b * next.b);
+            if (length < 1e-6f)
+            {
+                axis = { 0.0f, 0.0f, 0.0f };
+                break;
+            }
+            axis = { next.r / length, next.g / length, next.b / length };
+        }
+        float lowest = 0.0f, highest = 0.0f;
+        for (int i = 0; i < 16; ++i)
+        {
+            const float projection = (block.r[i] - mean.r) * axis.r + (block.g[i] - mean.g) * axis.g + (block.b[i] - mean.b) * axis.b;
+            lowest = std::min(lowest, projection);
+            highest = std::max(highest, projection);
+        }
+        std::uint16_t color0 = pack_565({ mean.r + axis.r * lowest, mean.g + axis.g * lowest, mean.b + axis.b * lowest });
+        std::uint16_t color1 = pack_565({ mean.r + axis.r * highest, mean.g + axis.g * highest, mean.b + axis.b * highest });
+        int indices[16];
+        float error = select_indices(block, unpack_565(color0), unpack_565(color1), indices);
+
+        // refit the endpoints to the pixels each index covers, while that helps
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            Color first, last;
+            if (!least_squares_endpoints(block, indices, first, last))
+                break;
+            const std::uint16_t refined0 = pack_565(first);
+            const std::uint16_t refined1 = pack_565(last);
+            if (refined0 == color0 && refined1 == color1)
+                break;
+            int refinedIndices[16];
+            const float refinedError = select_indices(block, unpack_565(refined0), unpack_565(refined1), refinedIndices);
+            if (refinedError >= error)
+                break;
+            color0 = refined0;
+            color1 = refined1;
+            error = refinedError;
+            std::copy(refinedIndices, refinedIndices + 16, indices);
+        }
+
+        // color0 > color1 selects four-color mode; equal endpoints only ever need index 0
+        const bool swap = color0 < color1;
+        if (swap)
+            std::swap(color0, color1);
+        // palette order in the block is color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1
+        static constexpr std::uint32_t CODES[4] = { 0, 2, 3, 1 };
+        std::uint32_t bits = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            const int index = color0 == color1 ? 0 : swap ? 3 - indices[i] : indices[i];
+            bits |= CODES[index] << (2 * i);
+        }
+        out[0] = static_cast<unsigned char>(color0);
+        out[1] = static_cast<unsigned char>(color0 >> 8);
+        out[2] = static_cast<unsigned char>(color1);
+        out[3] = static_cast<unsigned char>(color1 >> 8);
+        for (int i = 0; i < 4; ++i)
+            out[4 + i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+
+    // BC3 alpha: the block's alpha range split in eight even steps
+    void write_alpha_block(const BlockPixels& block, unsigned char* out)
+    {
+        const int highest = *std::max_element(block.a, block.a + 16);
+        const int lowest = *std::min_element(block.a, block.a + 16);
+        out[0] = static_cast<unsigned char>(highest);
+        out[1] = static_cast<unsigned char>(lowest);
+        std::uint64_t bits = 0;
+        if (highest > lowest)
+        {
+            const int range = highest - lowest;
+            for (int i = 0; i < 16; ++i)
+            {
+                // step 0 is alpha0 and step 7 alpha1, the steps between are codes 2 to 7
+                const int step = ((highest - block.a[i]) * 7 + range / 2) / range;
+                const std::uint64_t code = step == 0 ? 0 : step == 7 ? 1 : static_cast<std::uint64_t>(step + 1);
+                bits |= code << (3 * i);
+            }
+        }
+        for (int i = 0; i < 6; ++i)
+            out[2 + i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+
+    // expands decoded pixels to RGBA the way GL samples a GL_RED, GL_RG or GL_RGB texture, into
+    // the start of a buffer with room for the mip chain
+    std::vector<unsigned char> expand_to_rgba(const unsigned char* pixels, const int width, const int height, const int channels)
+    {
+        const std::size_t count = static_cast<std::size_t>(width) * height;
+        std::vector<unsigned char> rgba(MipmapGenerator::chainSize(width, height, 4));
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            for (int c = 0; c < 4; ++c)
+                rgba[4 * i + c] = c < channels ? pixels[channels * i + c] : c == 3 ? 255 : 0;
+        }
+        return rgba;
+    }
+
+    // encodes one row of blocks; blocks hanging over the edge repeat the last row or column
+    void encode_block_row(const unsigned char* pixels, const int width, const int height, const int blockRow,
+        const bool alpha, unsigned char* out)
+    {
+        BlockPixels block;
+        for (int blockX = 0; blockX < (width + 3) / 4; ++blockX)
+        {
+            for (int i = 0; i < 16; ++i)
+            {
+                const int x = std::min(4 * blockX + i % 4, width - 1);
+                const int y = std::min(4 * blockRow + i / 4, height - 1);
+                const unsigned char* pixel = &pixels[(static_cast<std::size_t>(y) * width + x) * 4];
+                block.r[i] = pixel[0];
+                block.g[i] = pixel[1];
+                block.b[i] = pixel[2];
+                block.a[i] = pixel[3];
+            }
+            if (alpha)
+            {
+                write_alpha_block(block, out);
+                out += 8;
+            }
+            write_color_block(block, out);
+            out += 8;
+        }
+    }
+}
+
+int CompressedTextureInfo::levelWidth(const int level) const
+{
+    return std::max(1, width >> level);
+}
+
+int CompressedTextureInfo::levelHeight(const int level) const
+{
+    return std::max(1, height >> level);
+}
+
+std::size_t CompressedTextureInfo::levelSize(const int level) const
+{
+    const std::size_t blockSize = format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+    return static_cast<std::size_t>((levelWidth(level) + 3) / 4) * ((levelHeight(level) + 3) / 4) * blockSize;
+}
+
+std::size_t CompressedTextureInfo::dataSize() const
+{
+    std::size_t size = 0;
+    for (int level = 0; level < levels; ++level)
+        size += levelSize(level);
+    return size;
+}
+
+bool CompressedTextureInfo::parse(const unsigned char* header, CompressedTextureInfo& info)
+{
+    // the header is 32 little-endian words, magic included
+    std::uint32_t words[HEADER_SIZE / 4];
+    std::memcpy(words, header, sizeof(words));
+    if (words[0] != DDS_MAGIC || words[1] != DDS_HEADER_SIZE || (words[20] & DDPF_FOURCC) == 0)
+        return false;
+    if (words[21] == FOURCC_DXT1)
+        info.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    else if (words[21] == FOURCC_DXT5)
+        info.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    else
+        return false;
+    if (words[3] == 0 || words[4] == 0 || words[3] > 1u << 16 || words[4] > 1u << 16)
+        return false;
+    info.height = static_cast<int>(words[3]);
+    info.width = static_cast<int>(words[4]);
+    int maximumLevels = 1;
+    while ((std::max(info.width, info.height) >> maximumLevels) != 0)
+        ++maximumLevels;
+    info.levels = (words[2] & DDSD_MIPMAPCOUNT) != 0 && words[7] != 0 ? static_cast<int>(words[7]) : 1;
+    return info.levels <= maximumLevels;
+}
+
+std::vector<unsigned char> TextureCompressor::compress(const unsigned char* pixels, const int width, const int height,
+    const int channels, const MipmapFilter mipmapFilter, unsigned int threadCount)
+{
+    std::vector<unsigned char> chain = expand_to_rgba(pixels, width, height, channels);
+    const std::size_t baseSize = static_cast<std::size_t>(width) * height * 4;
+
+    // images with an alpha channel that is opaque everywhere still fit BC1
+    bool alpha = false;
+    for (std::size_t i = 3; channels == 4 && !alpha && i < baseSize; i += 4)
+        alpha = chain[i] != 255;
+
+    CompressedTextureInfo info;
+    info.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    info.width = width;
+    info.height = height;
+    info.levels = MipmapGenerator::levelCount(width, height);
+    MipmapGenerator::generate(chain.data(), width, height, 4, mipmapFilter == MipmapFilter::Driver ? MipmapFilter::Box : mipmapFilter,
+        true, chain.data() + baseSize);
+
+    // every row of blocks in every level is one task, so the small levels at the end of the
+    // chain don't leave the other threads waiting on one
+    std::vector<unsigned char> file(CompressedTextureInfo::HEADER_SIZE + info.dataSize());
+    unsigned char* const data = file.data() + CompressedTextureInfo::HEADER_SIZE;
+    std::vector<std::size_t> levelOffsets;
+    std::vector<const unsigned char*> levelPixels;
+    std::vector<int> firstTasks;
+    std::size_t offset = 0;
+    const unsigned char* levelStart = chain.data();
+    int taskCount = 0;
+    for (int level = 0; level < info.levels; ++level)
+    {
+        levelOffsets.push_back(offset);
+        levelPixels.push_back(levelStart);
+        firstTasks.push_back(taskCount);
+        offset += info.levelSize(level);
+        levelStart += static_cast<std::size_t>(info.levelWidth(level)) * info.levelHeight(level) * 4;
+        taskCount += (info.levelHeight(level) + 3) / 4;
+    }
+    std::atomic<int> nextTask(0);
+    const auto work = [&]
+    {
+        for (int task = nextTask++; task < taskCount; task = nextTask++)
+        {
+            const int level = static_cast<int>(std::upper_bound(firstTasks.begin(), firstTasks.end(), task) - firstTasks.begin()) - 1;
+            const int blockRow = task - firstTasks[level];
+            const int levelWidth = info.levelWidth(level);
+            const std::size_t rowSize = static_cast<std::size_t>((levelWidth + 3) / 4) * (alpha ? 16 : 8);
+            encode_block_row(levelPixels[level], levelWidth, info.levelHeight(level), blockRow, alpha,
+                &data[levelOffsets[level] + blockRow * rowSize]);
+        }
+    };
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    threadCount = std::min(threadCount, static_cast<unsigned int>(taskCount));
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadCount; ++i)
+        threads.emplace_back(work);
+    work();
+    for (std::thread& thread : threads)
+        thread.join();
+
+    std::uint32_t header[CompressedTextureInfo::HEADER_SIZE / 4] = {};
+    header[0] = DDS_MAGIC;
+    header[1] = DDS_HEADER_SIZE;
+    header[2] = DDSD_FLAGS;
+    header[3] = static_cast<std::uint32_t>(height);
+    header[4] = static_cast<std::uint32_t>(width);
+    header[5] = static_cast<std::uint32_t>(info.levelSize(0));
+    header[7] = static_cast<std::uint32_t>(info.levels);
+    header[19] = 32;    // pixel format size
+    header[20] = DDPF_FOURCC;
+    header[21] = alpha ? FOURCC_DXT5 : FOURCC_DXT1;
+    header[27] = DDSCAPS;
+    std::memcpy(file.data(), header, sizeof(header));
+    return file;
+}
+
+bool TextureCompressor::compressFile(const std::string& source, const std::string& destination, const bool flipVertically,
+    const MipmapFilter mipmapFilter, const unsigned int threadCount)
+{
+    int width, height, channels;
+    stbi_set_flip_vertically_on_load_thread(flipVertically ? 1 : 0);
+    unsigned char* decoded = stbi_load(source.c_str(), &width, &height, &channels, 0);
+    if (decoded == nullptr)
+    {
+        std::cout << "Failed to decode " << source << ": " << stbi_failure_reason() << '\n';
+        return false;
+    }
+    const std::vector<unsigned char> compressed = compress(decoded, width, height, channels, mipmapFilter, threadCount);
+    stbi_image_free(decoded);
+    std::ofstream file(destination, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(compressed.data()), static_cast<std::streamsize>(compressed.size()));
+    if (!file)
+    {
+        std::cout << "Failed to write " << destination << '\n';
+        return false;
+    }
+    return true;
+}
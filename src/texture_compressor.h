@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "mipmap_generator.h"
+
+// S3TC is an extension rather than core GL, so the core profile glad header leaves these out
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+
+// layout of a block-compressed texture file: a 128-byte DDS header followed by every mip
+// level, largest first, each a tightly packed run of 4x4 blocks
+struct CompressedTextureInfo
+{
+    static constexpr std::size_t HEADER_SIZE = 128;
+
+    GLenum format = 0;  // GL_COMPRESSED_RGB_S3TC_DXT1_EXT or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+    int width = 0;
+    int height = 0;
+    int levels = 0;
+
+    int levelWidth(int level) const;
+    int levelHeight(int level) const;
+    std::size_t levelSize(int level) const;
+    // all levels, without the header
+    std::size_t dataSize() const;
+
+    // false for anything but a DXT1 or DXT5 DDS header
+    static bool parse(const unsigned char* header, CompressedTextureInfo& info);
+};
+
+// offline encoder for the texture loader's compressed path. Opaque images become BC1 (DXT1,
+// 4 bits per pixel) and images with alpha BC3 (DXT5, 8 bits per pixel), with the whole mip
+// chain baked in, so loading one is a file read into the unpack buffer and a
+// glCompressedTexImage2D per level. Blocks are fitted along the principal axis of their colors
+// and refined by least squares, four pixels at a time with SSE2 where available
+// (TEXTURE_COMPRESSOR_NO_SIMD turns that off).
+class TextureCompressor
+{
+public:
+    // encodes width x height pixels of 1 to 4 channels, stored in upload order, and returns the
+    // whole DDS file, header included. The mip chain is filtered in linear light with
+    // mipmapFilter (Driver means Box here). 0 threads picks one per hardware thread
+    static std::vector<unsigned char> compress(const unsigned char* pixels, int width, int height, int channels,
+        MipmapFilter mipmapFilter = MipmapFilter::Box, unsigned int threadCount = 0);
+    // decodes source with stb_image and writes the DDS file to destination. The rows are
+    // stored in upload order, so flipVertically should match what the image would be loaded
+    // with (which also means DDS viewers show it upside down). The other parameters are
+    // compress's
+    static bool compressFile(const std::string& source, const std::string& destination,
+        bool flipVertically = true, MipmapFilter mipmapFilter = MipmapFilter::Box, unsigned int threadCount = 0);
+};
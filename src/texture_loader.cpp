@@ -0,0 +1,479 @@
+#include "texture_loader.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "image_arena.h"
+#include "stb_image/stb_image.h"
+
+namespace
+{
+    GLenum format_for_channels(const int channels)
+    {
+        switch (channels)
+        {
+        case 1: return GL_RED;
+        case 2: return GL_RG;
+        case 3: return GL_RGB;
+        default: return GL_RGBA;
+        }
+    }
+
+    bool is_compressed_path(const std::string& path)
+    {
+        return path.size() >= 4 && path.compare(path.size() - 4, 4, ".dds") == 0;
+    }
+
+    bool cpu_mipmaps(const TextureParameters& parameters)
+    {
+        return parameters.generateMipmaps && parameters.mipmapFilter != MipmapFilter::Driver;
+    }
+
+    // expects the texture to be bound
+    void set_sampling(const TextureParameters& parameters)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, parameters.wrapS);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, parameters.wrapT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, parameters.minFilter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, parameters.magFilter);
+    }
+
+    // room for a handful of decoded textures in flight; bigger images go through the heap
+    constexpr std::size_t STAGING_SIZE = std::size_t(32) << 20;
+    constexpr std::size_t STAGING_ALIGNMENT = 256;
+
+    // stb_image previews are 1/8 scale, which is where they sit in the mip chain
+    constexpr int PREVIEW_LEVEL = 3;
+}
+
+TextureLoader::TextureLoader(unsigned int workerCount, const bool useArena)
+    : useArena(useArena)
+{
+    glGenBuffers(1, &unpackBuffer);
+    // immutable storage and persistent mapping are core since 4.4
+    if (GLAD_GL_VERSION_4_4 && glBufferStorage != nullptr)
+    {
+        constexpr GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(STAGING_SIZE), nullptr, flags);
+        staging = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(STAGING_SIZE), flags));
+        if (staging == nullptr)
+        {
+            // storage is immutable, start over with a fresh buffer for the fallback
+            glDeleteBuffers(1, &unpackBuffer);
+            glGenBuffers(1, &unpackBuffer);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    // the workers start last, they may write to the staging buffer right away
+    if (workerCount == 0)
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    workers.reserve(workerCount);
+    for (unsigned int i = 0; i < workerCount; ++i)
+        workers.emplace_back(&TextureLoader::workerMain, this);
+}
+
+TextureLoader::~TextureLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobAvailable.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    for (DecodedImage& image : decoded)
+    {
+        if (!image.staged)
+            std::free(image.pixels);
+    }
+    for (RetiringRange& range : retiring)
+        glDeleteSync(range.fence);
+    if (staging != nullptr)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &unpackBuffer);
+}
+
+unsigned int TextureLoader::load(const std::string& path, const TextureParameters& parameters)
+{
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    pending.push_back(texture);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // compressed files load about as fast as a preview would
+        jobs.push_back({ texture, path, parameters, parameters.progressive && !is_compressed_path(path) });
+    }
+    jobAvailable.notify_one();
+    return texture;
+}
+
+bool TextureLoader::supportsCompressedTextures()
+{
+    // S3TC never made it into core GL, but every desktop driver exposes it
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const auto* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+        if (name != nullptr && std::strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+            return true;
+    }
+    return false;
+}
+
+void TextureLoader::workerMain()
+{
+    for (;;)
+    {
+        DecodeJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        if (is_compressed_path(job.path))
+        {
+            readCompressed(job);
+            continue;
+        }
+
+        // the flip flag is per thread, so concurrent loads cannot race on it
+        stbi_set_flip_vertically_on_load_thread(job.parameters.flipVertically);
+        if (job.preview)
+        {
+            decodePreview(job);
+            // the full image waits behind the previews queued so far
+            job.preview = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push_back(std::move(job));
+            }
+            jobAvailable.notify_one();
+            continue;
+        }
+
+        DecodedImage image = { std::move(job), nullptr, 0, 0, 0, false, false, {} };
+        OutputRequest request = { this, &image };
+        int width, height, channels;
+        bool loaded;
+        {
+            // the image itself goes wherever provideOutput says, only decoder scratch is in the arena
+            const ImageArena::Scope arena(useArena);
+            loaded = stbi_load_into_mapped(image.job.path.c_str(), &width, &height, &channels, 0, &TextureLoader::provideOutput, &request) != 0;
+        }
+        // provideOutput left room for the rest of the chain behind the image
+        if (loaded && cpu_mipmaps(image.job.parameters))
+        {
+            MipmapGenerator::generate(image.pixels, width, height, channels, image.job.parameters.mipmapFilter, image.job.parameters.srgb,
+                image.pixels + static_cast<std::size_t>(width) * height * channels);
+        }
+        if (!loaded && image.pixels != nullptr)
+        {
+            // the decoder failed after it had asked for its output
+            if (image.staged)
+                releaseStaging(static_cast<std::size_t>(image.pixels - staging));
+            else
+                std::free(image.pixels);
+            image.pixels = nullptr;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.push_back(std::move(image));
+        }
+        imageDecoded.notify_all();
+    }
+}
+
+void TextureLoader::decodePreview(const DecodeJob& job)
+{
+    DecodedImage image = { job, nullptr, 0, 0, 0, false, true, {} };
+    {
+        // previews are small, they come back in a heap block instead of the staging buffer
+        const ImageArena::Scope arena(useArena);
+        image.pixels = static_cast<unsigned char*>(arena.keep(
+            stbi_load_preview_mapped(job.path.c_str(), &image.width, &image.height, &image.channels, 0)));
+    }
+    // images without a cheap preview just wait for their full decode
+    if (image.pixels == nullptr)
+    {
+        const char* reason = stbi_failure_reason();
+        if (reason == nullptr || std::strcmp(reason, "no preview") != 0)
+            std::cout << "Failed to load the preview of " << job.path << (reason ? std::string(": ") + reason : std::string()) << '\n';
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        decoded.push_back(std::move(image));
+    }
+    imageDecoded.notify_all();
+}
+
+void TextureLoader::readCompressed(const DecodeJob& job)
+{
+    DecodedImage image = { job, nullptr, 0, 0, 0, false, false, {} };
+    std::ifstream file(job.path, std::ios::binary);
+    unsigned char header[CompressedTextureInfo::HEADER_SIZE];
+    CompressedTextureInfo& info = image.compressed;
+    if (file.read(reinterpret_cast<char*>(header), sizeof(header)) && CompressedTextureInfo::parse(header, info))
+    {
+        // the blocks are already in upload order, so they go straight into the unpack buffer
+        const std::size_t size = info.dataSize();
+        image.pixels = allocateStaging(size);
+        image.staged = image.pixels != nullptr;
+        if (!image.staged)
+            image.pixels = static_cast<unsigned char*>(std::malloc(size));
+        if (image.pixels != nullptr && file.read(reinterpret_cast<char*>(image.pixels), static_cast<std::streamsize>(size)))
+        {
+            image.width = info.width;
+            image.height = info.height;
+        }
+        else if (image.staged)
+        {
+            releaseStaging(static_cast<std::size_t>(image.pixels - staging));
+            image.pixels = nullptr;
+        }
+        else
+        {
+            std::free(image.pixels);
+            image.pixels = nullptr;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        decoded.push_back(std::move(image));
+    }
+    imageDecoded.notify_all();
+}
+
+unsigned char* TextureLoader::provideOutput(void* request, const int width, const int height, const int channels, int* stride)
+{
+    const OutputRequest& output = *static_cast<OutputRequest*>(request);
+    DecodedImage& image = *output.image;
+    const std::size_t size = cpu_mipmaps(image.job.parameters) ? MipmapGenerator::chainSize(width, height, channels)
+        : static_cast<std::size_t>(width) * height * channels;
+    image.width = width;
+    image.height = height;
+    image.channels = channels;
+    image.pixels = output.loader->allocateStaging(size);
+    image.staged = image.pixels != nullptr;
+    if (!image.staged)
+        image.pixels = static_cast<unsigned char*>(std::malloc(size));
+    *stride = width * channels;
+    return image.pixels;
+}
+
+unsigned char* TextureLoader::allocateStaging(const std::size_t size)
+{
+    if (staging == nullptr || size > STAGING_SIZE)
+        return nullptr;
+    std::lock_guard<std::mutex> lock(mutex);
+    // first fit between the ranges in use
+    std::size_t offset = 0;
+    auto next = stagingInUse.begin();
+    for (; next != stagingInUse.end() && next->offset - offset < size; ++next)
+        offset = (next->offset + next->size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+    if (next == stagingInUse.end() && STAGING_SIZE - offset < size)
+        return nullptr;
+    stagingInUse.insert(next, { offset, size });
+    return staging + offset;
+}
+
+void TextureLoader::releaseStaging(const std::size_t offset)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stagingInUse.erase(std::find_if(stagingInUse.begin(), stagingInUse.end(),
+        [offset](const StagingRange& range) { return range.offset == offset; }));
+}
+
+void TextureLoader::reclaimStaging()
+{
+    auto range = retiring.begin();
+    while (range != retiring.end())
+    {
+        // a zero timeout just polls
+        const GLenum status = glClientWaitSync(range->fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+        {
+            glDeleteSync(range->fence);
+            releaseStaging(range->offset);
+            range = retiring.erase(range);
+        }
+        else
+        {
+            ++range;
+        }
+    }
+}
+
+std::size_t TextureLoader::uploadReady()
+{
+    reclaimStaging();
+    std::deque<DecodedImage> batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(decoded);
+    }
+    for (DecodedImage& image : batch)
+    {
+        if (image.preview)
+            uploadPreview(image);
+        else
+            upload(image);
+    }
+    return batch.size();
+}
+
+void TextureLoader::uploadAll()
+{
+    while (!pending.empty())
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            imageDecoded.wait(lock, [this] { return !decoded.empty(); });
+        }
+        // upload whatever has arrived while the rest are still decoding
+        uploadReady();
+    }
+}
+
+bool TextureLoader::isReady(const unsigned int texture) const
+{
+    return std::find(ready.begin(), ready.end(), texture) != ready.end();
+}
+
+void TextureLoader::upload(DecodedImage& image)
+{
+    pending.erase(std::remove(pending.begin(), pending.end(), image.job.texture), pending.end());
+    if (image.pixels == nullptr)
+    {
+        std::cout << "Failed to load texture " << image.job.path << '\n';
+        return;
+    }
+
+    const TextureParameters& parameters = image.job.parameters;
+    glBindTexture(GL_TEXTURE_2D, image.job.texture);
+    set_sampling(parameters);
+    // drop the preview's base level; the mipmaps generated below replace its levels
+    if (parameters.progressive)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+
+    const CompressedTextureInfo& compressed = image.compressed;
+    const auto size = static_cast<GLsizeiptr>(compressed.format != 0 ? compressed.dataSize()
+        : cpu_mipmaps(parameters) ? MipmapGenerator::chainSize(image.width, image.height, image.channels)
+        : static_cast<std::size_t>(image.width) * image.height * image.channels);
+    const void* source = nullptr;   // offset into the bound unpack buffer
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer);
+    if (image.staged)
+    {
+        // the worker decoded straight into the unpack buffer
+        source = reinterpret_cast<const void*>(image.pixels - staging);
+    }
+    else if (staging != nullptr)
+    {
+        // the staging buffer was full; it is immutable, so upload from client memory
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        source = image.pixels;
+    }
+    else
+    {
+        // stage through the unpack buffer: orphaning it with glBufferData lets the driver hand
+        // us fresh storage while a previous upload may still be reading the old one
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped != nullptr)
+        {
+            std::memcpy(mapped, image.pixels, static_cast<std::size_t>(size));
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        else
+        {
+            // mapping failed, upload straight from client memory instead
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            source = image.pixels;
+        }
+    }
+
+    if (compressed.format != 0)
+    {
+        // the file carries its own mip chain, compressed formats can't be glGenerateMipmap'ed anyway
+        const int levels = parameters.generateMipmaps ? compressed.levels : 1;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        std::size_t offset = 0;
+        for (int level = 0; level < levels; ++level)
+        {
+            const std::size_t levelSize = compressed.levelSize(level);
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, compressed.format, compressed.levelWidth(level), compressed.levelHeight(level), 0,
+                static_cast<GLsizei>(levelSize), static_cast<const unsigned char*>(source) + offset);
+            offset += levelSize;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    else
+    {
+        const GLenum format = format_for_channels(image.channels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);  // rows of 1- and 3-channel images are not 4-byte aligned
+        glTexImage2D(GL_TEXTURE_2D, 0, static_cast<int>(format), image.width, image.height, 0, format, GL_UNSIGNED_BYTE, source);
+        if (cpu_mipmaps(parameters))
+        {
+            // the levels follow the image in the same buffer
+            int width = image.width, height = image.height;
+            std::size_t offset = static_cast<std::size_t>(width) * height * image.channels;
+            for (int level = 1; level < MipmapGenerator::levelCount(image.width, image.height); ++level)
+            {
+                width = std::max(1, width / 2);
+                height = std::max(1, height / 2);
+                glTexImage2D(GL_TEXTURE_2D, level, static_cast<int>(format), width, height, 0, format, GL_UNSIGNED_BYTE,
+                    static_cast<const unsigned char*>(source) + offset);
+                offset += static_cast<std::size_t>(width) * height * image.channels;
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (parameters.generateMipmaps && !cpu_mipmaps(parameters))
+            glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    if (image.staged)
+        retiring.push_back({ static_cast<std::size_t>(image.pixels - staging), glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+    else
+        std::free(image.pixels);
+    image.pixels = nullptr;
+    ready.push_back(image.job.texture);
+}
+
+void TextureLoader::uploadPreview(DecodedImage& image)
+{
+    const TextureParameters& parameters = image.job.parameters;
+    glBindTexture(GL_TEXTURE_2D, image.job.texture);
+    set_sampling(parameters);
+    // levels below the preview stay undefined until the full image arrives; starting the
+    // chain at the preview keeps the texture complete in the meantime
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, PREVIEW_LEVEL);
+
+    const GLenum format = format_for_channels(image.channels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, PREVIEW_LEVEL, static_cast<int>(format), image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (parameters.generateMipmaps)
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+    std::free(image.pixels);
+    image.pixels = nullptr;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mipmap_generator.h"
+#include "texture_compressor.h"
+
+
+struct TextureParameters
+{
+    int wrapS = GL_REPEAT;
+    int wrapT = GL_REPEAT;
+    int minFilter = GL_NEAREST;
+    int magFilter = GL_NEAREST;
+    bool flipVertically = true;
+    bool generateMipmaps = true;
+    // where the mip levels come from; the CPU filters run on the loader threads and the whole
+    // chain is uploaded with the image
+    MipmapFilter mipmapFilter = MipmapFilter::Driver;
+    // CPU filters only: the pixels are sRGB-encoded, so filter their colors in linear light
+    bool srgb = true;
+    // show a 1/8-scale preview as mip level 3 while the full image decodes, for images that
+    // have a cheap one (JPEGs, interlaced PNGs; see stbi_load_preview_mapped). Other images,
+    // non-interlaced PNGs like assets/awesomeface.png among them, stay black until they are
+    // fully decoded
+    bool progressive = false;
+};
+
+// decodes images on a pool of worker threads and uploads them on the GL thread through a
+// pixel unpack buffer. Startup cost is bounded by the slowest image rather than the sum of all.
+// With GL 4.4 the unpack buffer is persistently mapped and the workers decode straight into it,
+// so an image is never copied between the decoder and the driver.
+// Paths ending in .dds are block-compressed files written by TextureCompressor: they skip
+// the decoder, are read as they are into the unpack buffer and uploaded with their own mip chain.
+// Progressive textures are decoded twice: every queued preview is decoded before any full
+// image, so something can be drawn almost right away however big the images are. There are
+// only those two steps, the 1/8-scale preview and then the full image with its mip chain; no
+// levels in between are refined in the background.
+// Everything except the worker threads must be used from the thread that owns the GL context.
+class TextureLoader
+{
+public:
+    // 0 picks one worker per hardware thread (at least one); with useArena the workers decode
+    // out of a per-thread ImageArena, so only the finished images touch the heap
+    explicit TextureLoader(unsigned int workerCount = 0, bool useArena = true);
+    TextureLoader(const TextureLoader&) = delete;
+    TextureLoader& operator=(const TextureLoader&) = delete;
+    ~TextureLoader();
+
+    // queues a decode and returns the texture name right away; the texture is incomplete
+    // (samples as black) until its preview or the full image is uploaded
+    unsigned int load(const std::string& path, const TextureParameters& parameters = TextureParameters());
+    // whether the context can sample the DDS files load accepts
+    static bool supportsCompressedTextures();
+
+    // uploads every image and preview that finished decoding; never blocks on the workers
+    std::size_t uploadReady();
+    // blocks until every queued image is decoded and uploaded
+    void uploadAll();
+
+    // true once the full image is uploaded, previews don't count
+    bool isReady(unsigned int texture) const;
+    std::size_t pendingCount() const { return pending.size(); }
+
+private:
+    struct DecodeJob
+    {
+        unsigned int texture;
+        std::string path;
+        TextureParameters parameters;
+        bool preview;   // the job is requeued for the full image once its preview is done
+    };
+    struct DecodedImage
+    {
+        DecodeJob job;
+        unsigned char* pixels;     // in the staging buffer, or an owned heap block (std::free)
+        int width;
+        int height;
+        int channels;
+        bool staged;
+        bool preview;
+        CompressedTextureInfo compressed;   // format 0 for decoded pixels
+    };
+    // a byte range of the staging buffer; it stays in use until the GPU has read it
+    struct StagingRange
+    {
+        std::size_t offset;
+        std::size_t size;
+    };
+    struct RetiringRange
+    {
+        std::size_t offset;
+        GLsync fence;
+    };
+    struct OutputRequest
+    {
+        TextureLoader* loader;
+        DecodedImage* image;
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable imageDecoded;
+    std::deque<DecodeJob> jobs;
+    std::deque<DecodedImage> decoded;
+    bool stopping = false;
+    bool useArena;
+    // persistently mapped (never remapped, so the workers may write to it) and the ranges
+    // taken out of it, sorted by offset and guarded by mutex; null without GL 4.4
+    unsigned char* staging = nullptr;
+    std::vector<StagingRange> stagingInUse;
+
+    // GL-thread state
+    std::vector<unsigned int> pending;
+    std::vector<unsigned int> ready;
+    unsigned int unpackBuffer = 0;
+    std::vector<RetiringRange> retiring;
+
+    void workerMain();
+    void decodePreview(const DecodeJob& job);
+    void readCompressed(const DecodeJob& job);
+    void upload(DecodedImage& image);
+    void uploadPreview(DecodedImage& image);
+
+    // stb_image output callback: a staging range when one is free, else a heap block
+    static unsigned char* provideOutput(void* request, int width, int height, int channels, int* stride);
+    unsigned char* allocateStaging(std::size_t size);
+    void releaseStaging(std::size_t offset);
+    // hands back the ranges the GPU is done reading
+    void reclaimStaging();
+};
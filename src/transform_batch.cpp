@@ -0,0 +1,702 @@
+#include "transform_batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if !defined(TRANSFORM_BATCH_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define TRANSFORM_BATCH_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// every kernel is compiled for its own instruction set whatever the build targets, and only
+// called once the CPU has been checked; MSVC hands out the intrinsics without being asked
+#if defined(TRANSFORM_BATCH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TRANSFORM_BATCH_TARGET(isa) __attribute__((target(isa)))
+#else
+#define TRANSFORM_BATCH_TARGET(isa)
+#endif
+
+namespace
+{
+    // glm matrices are 16 floats, column after column: element (column c, row r) is at 4c + r
+    const float* elements(const glm::mat4& m)
+    {
+        return &m[0][0];
+    }
+
+    // the same sums in the same order as glm's operator*
+    void transform_scalar(const float* m, const Vec4Stream& in, const Vec4Stream& out, std::size_t begin, const std::size_t end)
+    {
+        for (; begin < end; ++begin)
+        {
+            const float x = in.x[begin], y = in.y[begin], z = in.z[begin];
+            const float w = in.w != nullptr ? in.w[begin] : 1.0f;
+            float result[4];
+            for (int r = 0; r < 4; ++r)
+                result[r] = (m[r] * x + m[4 + r] * y) + (m[8 + r] * z + m[12 + r] * w);
+            out.x[begin] = result[0];
+            out.y[begin] = result[1];
+            out.z[begin] = result[2];
+            if (out.w != nullptr)
+                out.w[begin] = result[3];
+        }
+    }
+
+    void multiply_scalar(const float* lhs, const std::size_t lhsStride, const float* rhs, float* out, const std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i, lhs += lhsStride, rhs += 16, out += 16)
+        {
+            // the whole product is formed before any of it is stored, so out may alias
+            float result[16];
+            for (int c = 0; c < 4; ++c)
+            {
+                for (int r = 0; r < 4; ++r)
+                    result[4 * c + r] = lhs[r] * rhs[4 * c] + lhs[4 + r] * rhs[4 * c + 1] + lhs[8 + r] * rhs[4 * c + 2] + lhs[12 + r] * rhs[4 * c + 3];
+            }
+            std::copy(result, result + 16, out);
+        }
+    }
+
+    // glm's own cofactor expansion, kept scalar by the packed qualifier
+    void inverse_general_scalar(const float* in, float* out, const std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i, in += 16, out += 16)
+        {
+            glm::mat<4, 4, float, glm::packed_highp> m;
+            std::copy(in, in + 16, &m[0][0]);
+            const glm::mat<4, 4, float, glm::packed_highp> result = glm::inverse(m);
+            std::copy(&result[0][0], &result[0][0] + 16, out);
+        }
+    }
+
+    // the rows of the upper 3x3's inverse are the cross products of its other two columns over
+    // the determinant, or for a rotation the columns themselves; the translation is then the
+    // inverse applied to the old one, negated. The sums run in the same order as the SSE2 kernel
+    void inverse_affine_scalar(const float* in, float* out, const std::size_t count, const bool rigid)
+    {
+        for (std::size_t i = 0; i < count; ++i, in += 16, out += 16)
+        {
+            const glm::vec3 a0(in[0], in[1], in[2]), a1(in[4], in[5], in[6]), a2(in[8], in[9], in[10]);
+            const glm::vec3 t(in[12], in[13], in[14]);
+            glm::vec3 r0 = a0, r1 = a1, r2 = a2;
+            if (!rigid)
+            {
+                r0 = glm::cross(a1, a2);
+                r1 = glm::cross(a2, a0);
+                r2 = glm::cross(a0, a1);
+                const float inverseDeterminant = 1.0f / ((a0.x * r0.x + a0.y * r0.y) + a0.z * r0.z);
+                r0 *= inverseDeterminant;
+                r1 *= inverseDeterminant;
+                r2 *= inverseDeterminant;
+            }
+            const float result[16] = {
+                r0.x, r1.x, r2.x, 0.0f,
+                r0.y, r1.y, r2.y, 0.0f,
+                r0.z, r1.z, r2.z, 0.0f,
+                -((r0.x * t.x + r0.y * t.y) + r0.z * t.z), -((r1.x * t.x + r1.y * t.y) + r1.z * t.z), -((r2.x * t.x + r2.y * t.y) + r2.z * t.z), 1.0f,
+            };
+            std::copy(result, result + 16, out);
+        }
+    }
+
+#ifdef TRANSFORM_BATCH_X86
+    // The kernels below keep the matrix in named registers and the stream pointers in locals:
+    // compilers leave arrays of vectors in memory, and reload pointers the vector stores might
+    // have overwritten. Element (column c, row r) of the matrix becomes m<c><r>.
+
+    // one output component of four points, in glm's order: (m0 x + m1 y) + (m2 z + m3 w)
+    TRANSFORM_BATCH_TARGET("sse2")
+    inline __m128 combine_sse2(const __m128 m0, const __m128 m1, const __m128 m2, const __m128 m3,
+        const __m128 x, const __m128 y, const __m128 z, const __m128 w)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(m0, x), _mm_mul_ps(m1, y)), _mm_add_ps(_mm_mul_ps(m2, z), _mm_mul_ps(m3, w)));
+    }
+
+    TRANSFORM_BATCH_TARGET("sse2")
+    void transform_sse2(const float* m, const Vec4Stream& in, const Vec4Stream& out, const std::size_t count)
+    {
+        const __m128 m00 = _mm_set1_ps(m[0]), m01 = _mm_set1_ps(m[1]), m02 = _mm_set1_ps(m[2]), m03 = _mm_set1_ps(m[3]);
+        const __m128 m10 = _mm_set1_ps(m[4]), m11 = _mm_set1_ps(m[5]), m12 = _mm_set1_ps(m[6]), m13 = _mm_set1_ps(m[7]);
+        const __m128 m20 = _mm_set1_ps(m[8]), m21 = _mm_set1_ps(m[9]), m22 = _mm_set1_ps(m[10]), m23 = _mm_set1_ps(m[11]);
+        const __m128 m30 = _mm_set1_ps(m[12]), m31 = _mm_set1_ps(m[13]), m32 = _mm_set1_ps(m[14]), m33 = _mm_set1_ps(m[15]);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const float* const inX = in.x;
+        const float* const inY = in.y;
+        const float* const inZ = in.z;
+        const float* const inW = in.w;
+        float* const outX = out.x;
+        float* const outY = out.y;
+        float* const outZ = out.z;
+        float* const outW = out.w;
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(inX + i);
+            const __m128 y = _mm_loadu_ps(inY + i);
+            const __m128 z = _mm_loadu_ps(inZ + i);
+            const __m128 w = inW != nullptr ? _mm_loadu_ps(inW + i) : one;
+            _mm_storeu_ps(outX + i, combine_sse2(m00, m10, m20, m30, x, y, z, w));
+            _mm_storeu_ps(outY + i, combine_sse2(m01, m11, m21, m31, x, y, z, w));
+            _mm_storeu_ps(outZ + i, combine_sse2(m02, m12, m22, m32, x, y, z, w));
+            if (outW != nullptr)
+                _mm_storeu_ps(outW + i, combine_sse2(m03, m13, m23, m33, x, y, z, w));
+        }
+        transform_scalar(m, in, out, i, count);
+    }
+
+    // one column of a product: the lhs columns weighted by the elements of b, in glm's order
+    TRANSFORM_BATCH_TARGET("sse2")
+    inline __m128 product_column_sse2(const __m128 a0, const __m128 a1, const __m128 a2, const __m128 a3, const __m128 b)
+    {
+        __m128 sum = _mm_add_ps(_mm_mul_ps(a0, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(a1, _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1))));
+        sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2))));
+        return _mm_add_ps(sum, _mm_mul_ps(a3, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3))));
+    }
+
+    // a matrix per iteration, a column per register
+    TRANSFORM_BATCH_TARGET("sse2")
+    void multiply_sse2(const float* lhs, const std::size_t lhsStride, const float* rhs, float* out, const std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i, lhs += lhsStride, rhs += 16, out += 16)
+        {
+            const __m128 a0 = _mm_loadu_ps(lhs), a1 = _mm_loadu_ps(lhs + 4), a2 = _mm_loadu_ps(lhs + 8), a3 = _mm_loadu_ps(lhs + 12);
+            const __m128 b0 = _mm_loadu_ps(rhs), b1 = _mm_loadu_ps(rhs + 4), b2 = _mm_loadu_ps(rhs + 8), b3 = _mm_loadu_ps(rhs + 12);
+            const __m128 c0 = product_column_sse2(a0, a1, a2, a3, b0);
+            const __m128 c1 = product_column_sse2(a0, a1, a2, a3, b1);
+            const __m128 c2 = product_column_sse2(a0, a1, a2, a3, b2);
+            const __m128 c3 = product_column_sse2(a0, a1, a2, a3, b3);
+            _mm_storeu_ps(out, c0);
+            _mm_storeu_ps(out + 4, c1);
+            _mm_storeu_ps(out + 8, c2);
+            _mm_storeu_ps(out + 12, c3);
+        }
+    }
+
+    TRANSFORM_BATCH_TARGET("sse2")
+    inline __m128 cross_sse2(const __m128 u, const __m128 v)
+    {
+        const __m128 uYZX = _mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 0, 2, 1)), uZXY = _mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 1, 0, 2));
+        const __m128 vYZX = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)), vZXY = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 1, 0, 2));
+        return _mm_sub_ps(_mm_mul_ps(uYZX, vZXY), _mm_mul_ps(uZXY, vYZX));
+    }
+
+    // as inverse_affine_scalar, a matrix per iteration; the w lanes of the input's first three
+    // columns are never read
+    TRANSFORM_BATCH_TARGET("sse2")
+    void inverse_affine_sse2(const float* in, float* out, const std::size_t count, const bool rigid)
+    {
+        const __m128 one = _mm_set_ss(1.0f);
+        const __m128 unitW = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+        for (std::size_t i = 0; i < count; ++i, in += 16, out += 16)
+        {
+            const __m128 a0 = _mm_loadu_ps(in), a1 = _mm_loadu_ps(in + 4), a2 = _mm_loadu_ps(in + 8), t = _mm_loadu_ps(in + 12);
+            __m128 r0 = a0, r1 = a1, r2 = a2, r3 = _mm_setzero_ps();
+            if (!rigid)
+            {
+                r0 = cross_sse2(a1, a2);
+                r1 = cross_sse2(a2, a0);
+                r2 = cross_sse2(a0, a1);
+                const __m128 products = _mm_mul_ps(a0, r0);
+                __m128 determinant = _mm_add_ss(products, _mm_shuffle_ps(products, products, _MM_SHUFFLE(1, 1, 1, 1)));
+                determinant = _mm_add_ss(determinant, _mm_shuffle_ps(products, products, _MM_SHUFFLE(2, 2, 2, 2)));
+                const __m128 inverseDeterminant = _mm_div_ss(one, determinant);
+                const __m128 scale = _mm_shuffle_ps(inverseDeterminant, inverseDeterminant, _MM_SHUFFLE(0, 0, 0, 0));
+                r0 = _mm_mul_ps(r0, scale);
+                r1 = _mm_mul_ps(r1, scale);
+                r2 = _mm_mul_ps(r2, scale);
+            }
+            // rows to columns; the fourth row of zeros clears the w lanes, and the fourth column
+            // it produces is replaced by the translation
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            __m128 translation = _mm_add_ps(_mm_mul_ps(r0, _mm_shuffle_ps(t, t, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(r1, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 1, 1, 1))));
+            translation = _mm_add_ps(translation, _mm_mul_ps(r2, _mm_shuffle_ps(t, t, _MM_SHUFFLE(2, 2, 2, 2))));
+            _mm_storeu_ps(out, r0);
+            _mm_storeu_ps(out + 4, r1);
+            _mm_storeu_ps(out + 8, r2);
+            _mm_storeu_ps(out + 12, _mm_sub_ps(unitW, translation));
+        }
+    }
+
+    // The general inverse splits the matrix into 2x2 blocks, each held in one register as
+    // (m00, m01, m10, m11), and builds the inverse's blocks from their adjugates:
+    //     | A B |^-1     1   | |D|A - B(D#C)     |B|C - D(A#B)# |#
+    //     | C D |     = --- *|                                  |
+    //                   |M|  | |C|B - A(D#C)#    |A|D - C(A#B)  |
+    // with X# the adjugate and |M| = |A||D| + |B||C| - tr((A#B)(D#C)). The columns of a glm
+    // matrix go in as rows: the inverse of the transpose is the transpose of the inverse, so
+    // the rows that come out are the inverse's columns.
+
+    // a * b, for 2x2 blocks
+    TRANSFORM_BATCH_TARGET("sse2")
+    inline __m128 block_multiply_sse2(const __m128 a, const __m128 b)
+    {
+        return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 3, 0))),
+            _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+    }
+
+    // a# * b
+    TRANSFORM_BATCH_TARGET("sse2")
+    inline __m128 block_adjugate_multiply_sse2(const __m128 a, const __m128 b)
+    {
+        return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+            _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 1, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+
+    // a * b#
+    TRANSFORM_BATCH_TARGET("sse2")
+    inline __m128 block_multiply_adjugate_sse2(const __m128 a, const __m128 b)
+    {
+        return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 3, 0, 3))),
+            _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 2, 1, 2))));
+    }
+
+    TRANSFORM_BATCH_TARGET("sse2")
+    void inverse_general_sse2(const float* in, float* out, const std::size_t count)
+    {
+        const __m128 signs = _mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f);
+        for (std::size_t i = 0; i < count; ++i, in += 16, out += 16)
+        {
+            const __m128 m0 = _mm_loadu_ps(in), m1 = _mm_loadu_ps(in + 4), m2 = _mm_loadu_ps(in + 8), m3 = _mm_loadu_ps(in + 12);
+            const __m128 a = _mm_movelh_ps(m0, m1), b = _mm_movehl_ps(m1, m0);
+            const __m128 c = _mm_movelh_ps(m2, m3), d = _mm_movehl_ps(m3, m2);
+            // |A| |B| |C| |D|
+            const __m128 determinants = _mm_sub_ps(
+                _mm_mul_ps(_mm_shuffle_ps(m0, m2, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(m1, m3, _MM_SHUFFLE(3, 1, 3, 1))),
+                _mm_mul_ps(_mm_shuffle_ps(m0, m2, _MM_SHUFFLE(3, 1, 3, 1)), _mm_shuffle_ps(m1, m3, _MM_SHUFFLE(2, 0, 2, 0))));
+            const __m128 detA = _mm_shuffle_ps(determinants, determinants, _MM_SHUFFLE(0, 0, 0, 0));
+            const __m128 detB = _mm_shuffle_ps(determinants, determinants, _MM_SHUFFLE(1, 1, 1, 1));
+            const __m128 detC = _mm_shuffle_ps(determinants, determinants, _MM_SHUFFLE(2, 2, 2, 2));
+            const __m128 detD = _mm_shuffle_ps(determinants, determinants, _MM_SHUFFLE(3, 3, 3, 3));
+
+            const __m128 dc = block_adjugate_multiply_sse2(d, c);
+            const __m128 ab = block_adjugate_multiply_sse2(a, b);
+            __m128 x = _mm_sub_ps(_mm_mul_ps(detD, a), block_multiply_sse2(b, dc));
+            __m128 w = _mm_sub_ps(_mm_mul_ps(detA, d), block_multiply_sse2(c, ab));
+            __m128 y = _mm_sub_ps(_mm_mul_ps(detB, c), block_multiply_adjugate_sse2(d, ab));
+            __m128 z = _mm_sub_ps(_mm_mul_ps(detC, b), block_multiply_adjugate_sse2(a, dc));
+
+            __m128 trace = _mm_mul_ps(ab, _mm_shuffle_ps(dc, dc, _MM_SHUFFLE(3, 1, 2, 0)));
+            trace = _mm_add_ps(trace, _mm_shuffle_ps(trace, trace, _MM_SHUFFLE(1, 0, 3, 2)));
+            trace = _mm_add_ps(trace, _mm_shuffle_ps(trace, trace, _MM_SHUFFLE(2, 3, 0, 1)));
+            const __m128 determinant = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+            // the adjugates' signs come with the reciprocal
+            const __m128 scale = _mm_div_ps(signs, determinant);
+            x = _mm_mul_ps(x, scale);
+            y = _mm_mul_ps(y, scale);
+            z = _mm_mul_ps(z, scale);
+            w = _mm_mul_ps(w, scale);
+            // the last adjugate swap and the reassembly from blocks in one shuffle each
+            _mm_storeu_ps(out, _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+            _mm_storeu_ps(out + 4, _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+            _mm_storeu_ps(out + 8, _mm_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+            _mm_storeu_ps(out + 12, _mm_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+        }
+    }
+
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    inline __m256 combine_avx2(const __m256 m0, const __m256 m1, const __m256 m2, const __m256 m3,
+        const __m256 x, const __m256 y, const __m256 z, const __m256 w)
+    {
+        return _mm256_add_ps(_mm256_fmadd_ps(m1, y, _mm256_mul_ps(m0, x)), _mm256_fmadd_ps(m3, w, _mm256_mul_ps(m2, z)));
+    }
+
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    inline void store_avx2(float* destination, const bool partial, const __m256i mask, const __m256 value)
+    {
+        if (partial)
+            _mm256_maskstore_ps(destination, mask, value);
+        else
+            _mm256_storeu_ps(destination, value);
+    }
+
+    // the last partial block goes through masked loads and stores, so every element of a call
+    // is rounded the same way
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    void transform_avx2(const float* m, const Vec4Stream& in, const Vec4Stream& out, const std::size_t count)
+    {
+        const __m256 m00 = _mm256_set1_ps(m[0]), m01 = _mm256_set1_ps(m[1]), m02 = _mm256_set1_ps(m[2]), m03 = _mm256_set1_ps(m[3]);
+        const __m256 m10 = _mm256_set1_ps(m[4]), m11 = _mm256_set1_ps(m[5]), m12 = _mm256_set1_ps(m[6]), m13 = _mm256_set1_ps(m[7]);
+        const __m256 m20 = _mm256_set1_ps(m[8]), m21 = _mm256_set1_ps(m[9]), m22 = _mm256_set1_ps(m[10]), m23 = _mm256_set1_ps(m[11]);
+        const __m256 m30 = _mm256_set1_ps(m[12]), m31 = _mm256_set1_ps(m[13]), m32 = _mm256_set1_ps(m[14]), m33 = _mm256_set1_ps(m[15]);
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const float* const inX = in.x;
+        const float* const inY = in.y;
+        const float* const inZ = in.z;
+        const float* const inW = in.w;
+        float* const outX = out.x;
+        float* const outY = out.y;
+        float* const outZ = out.z;
+        float* const outW = out.w;
+        for (std::size_t i = 0; i < count; i += 8)
+        {
+            const bool partial = count - i < 8;
+            const __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(std::min<std::size_t>(count - i, 8))), lanes);
+            const __m256 x = partial ? _mm256_maskload_ps(inX + i, mask) : _mm256_loadu_ps(inX + i);
+            const __m256 y = partial ? _mm256_maskload_ps(inY + i, mask) : _mm256_loadu_ps(inY + i);
+            const __m256 z = partial ? _mm256_maskload_ps(inZ + i, mask) : _mm256_loadu_ps(inZ + i);
+            const __m256 w = inW == nullptr ? one : partial ? _mm256_maskload_ps(inW + i, mask) : _mm256_loadu_ps(inW + i);
+            store_avx2(outX + i, partial, mask, combine_avx2(m00, m10, m20, m30, x, y, z, w));
+            store_avx2(outY + i, partial, mask, combine_avx2(m01, m11, m21, m31, x, y, z, w));
+            store_avx2(outZ + i, partial, mask, combine_avx2(m02, m12, m22, m32, x, y, z, w));
+            if (outW != nullptr)
+                store_avx2(outW + i, partial, mask, combine_avx2(m03, m13, m23, m33, x, y, z, w));
+        }
+    }
+
+    // two columns of a product: each 128-bit half of b holds a column of rhs, and the in-lane
+    // shuffles spread that column's elements over its half
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    inline __m256 product_columns_avx2(const __m256 a0, const __m256 a1, const __m256 a2, const __m256 a3, const __m256 b)
+    {
+        __m256 sum = _mm256_mul_ps(a0, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0)));
+        sum = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1)), sum);
+        sum = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2)), sum);
+        return _mm256_fmadd_ps(a3, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3)), sum);
+    }
+
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    void multiply_avx2(const float* lhs, const std::size_t lhsStride, const float* rhs, float* out, const std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i, lhs += lhsStride, rhs += 16, out += 16)
+        {
+            const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(lhs));
+            const __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(lhs + 4));
+            const __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(lhs + 8));
+            const __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(lhs + 12));
+            const __m256 b01 = _mm256_loadu_ps(rhs);
+            const __m256 b23 = _mm256_loadu_ps(rhs + 8);
+            const __m256 c01 = product_columns_avx2(a0, a1, a2, a3, b01);
+            const __m256 c23 = product_columns_avx2(a0, a1, a2, a3, b23);
+            _mm256_storeu_ps(out, c01);
+            _mm256_storeu_ps(out + 8, c23);
+        }
+    }
+
+    // the block inverse of inverse_general_sse2 on two matrices at once, one per 128-bit half;
+    // every shuffle stays within its half and nothing is fused, so the results are the same
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    inline __m256 block_multiply_avx2(const __m256 a, const __m256 b)
+    {
+        return _mm256_add_ps(_mm256_mul_ps(a, _mm256_permute_ps(b, _MM_SHUFFLE(3, 0, 3, 0))),
+            _mm256_mul_ps(_mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1)), _mm256_permute_ps(b, _MM_SHUFFLE(1, 2, 1, 2))));
+    }
+
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    inline __m256 block_adjugate_multiply_avx2(const __m256 a, const __m256 b)
+    {
+        return _mm256_sub_ps(_mm256_mul_ps(_mm256_permute_ps(a, _MM_SHUFFLE(0, 0, 3, 3)), b),
+            _mm256_mul_ps(_mm256_permute_ps(a, _MM_SHUFFLE(2, 2, 1, 1)), _mm256_permute_ps(b, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    inline __m256 block_multiply_adjugate_avx2(const __m256 a, const __m256 b)
+    {
+        return _mm256_sub_ps(_mm256_mul_ps(a, _mm256_permute_ps(b, _MM_SHUFFLE(0, 3, 0, 3))),
+            _mm256_mul_ps(_mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1)), _mm256_permute_ps(b, _MM_SHUFFLE(1, 2, 1, 2))));
+    }
+
+    // column c of matrices i and i + 1
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    inline __m256 load_columns_avx2(const float* in, const int c)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(in + 4 * c)), _mm_loadu_ps(in + 16 + 4 * c), 1);
+    }
+
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    inline void store_columns_avx2(float* out, const int c, const __m256 columns)
+    {
+        _mm_storeu_ps(out + 4 * c, _mm256_castps256_ps128(columns));
+        _mm_storeu_ps(out + 16 + 4 * c, _mm256_extractf128_ps(columns, 1));
+    }
+
+    TRANSFORM_BATCH_TARGET("avx2,fma")
+    void inverse_general_avx2(const float* in, float* out, const std::size_t count)
+    {
+        const __m256 signs = _mm256_setr_ps(1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f);
+        std::size_t i = 0;
+        for (; i + 2 <= count; i += 2, in += 32, out += 32)
+        {
+            const __m256 m0 = load_columns_avx2(in, 0), m1 = load_columns_avx2(in, 1);
+            const __m256 m2 = load_columns_avx2(in, 2), m3 = load_columns_avx2(in, 3);
+            const __m256 a = _mm256_shuffle_ps(m0, m1, _MM_SHUFFLE(1, 0, 1, 0)), b = _mm256_shuffle_ps(m0, m1, _MM_SHUFFLE(3, 2, 3, 2));
+            const __m256 c = _mm256_shuffle_ps(m2, m3, _MM_SHUFFLE(1, 0, 1, 0)), d = _mm256_shuffle_ps(m2, m3, _MM_SHUFFLE(3, 2, 3, 2));
+            const __m256 determinants = _mm256_sub_ps(
+                _mm256_mul_ps(_mm256_shuffle_ps(m0, m2, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(m1, m3, _MM_SHUFFLE(3, 1, 3, 1))),
+                _mm256_mul_ps(_mm256_shuffle_ps(m0, m2, _MM_SHUFFLE(3, 1, 3, 1)), _mm256_shuffle_ps(m1, m3, _MM_SHUFFLE(2, 0, 2, 0))));
+            const __m256 detA = _mm256_permute_ps(determinants, _MM_SHUFFLE(0, 0, 0, 0));
+            const __m256 detB = _mm256_permute_ps(determinants, _MM_SHUFFLE(1, 1, 1, 1));
+            const __m256 detC = _mm256_permute_ps(determinants, _MM_SHUFFLE(2, 2, 2, 2));
+            const __m256 detD = _mm256_permute_ps(determinants, _MM_SHUFFLE(3, 3, 3, 3));
+
+            const __m256 dc = block_adjugate_multiply_avx2(d, c);
+            const __m256 ab = block_adjugate_multiply_avx2(a, b);
+            __m256 x = _mm256_sub_ps(_mm256_mul_ps(detD, a), block_multiply_avx2(b, dc));
+            __m256 w = _mm256_sub_ps(_mm256_mul_ps(detA, d), block_multiply_avx2(c, ab));
+            __m256 y = _mm256_sub_ps(_mm256_mul_ps(detB, c), block_multiply_adjugate_avx2(d, ab));
+            __m256 z = _mm256_sub_ps(_mm256_mul_ps(detC, b), block_multiply_adjugate_avx2(a, dc));
+
+            __m256 trace = _mm256_mul_ps(ab, _mm256_permute_ps(dc, _MM_SHUFFLE(3, 1, 2, 0)));
+            trace = _mm256_add_ps(trace, _mm256_permute_ps(trace, _MM_SHUFFLE(1, 0, 3, 2)));
+            trace = _mm256_add_ps(trace, _mm256_permute_ps(trace, _MM_SHUFFLE(2, 3, 0, 1)));
+            const __m256 determinant = _mm256_sub_ps(_mm256_add_ps(_mm256_mul_ps(detA, detD), _mm256_mul_ps(detB, detC)), trace);
+            const __m256 scale = _mm256_div_ps(signs, determinant);
+            x = _mm256_mul_ps(x, scale);
+            y = _mm256_mul_ps(y, scale);
+            z = _mm256_mul_ps(z, scale);
+            w = _mm256_mul_ps(w, scale);
+            store_columns_avx2(out, 0, _mm256_shuffle_ps(x, y, _MM_SHUFFLE(1, 3, 1, 3)));
+            store_columns_avx2(out, 1, _mm256_shuffle_ps(x, y, _MM_SHUFFLE(0, 2, 0, 2)));
+            store_columns_avx2(out, 2, _mm256_shuffle_ps(z, w, _MM_SHUFFLE(1, 3, 1, 3)));
+            store_columns_avx2(out, 3, _mm256_shuffle_ps(z, w, _MM_SHUFFLE(0, 2, 0, 2)));
+        }
+        if (i < count)
+            inverse_general_sse2(in, out, 1);
+    }
+
+    // GCC's own AVX-512 headers trip -Wmaybe-uninitialized (_mm512_undefined_ps)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+    TRANSFORM_BATCH_TARGET("avx512f")
+    inline __m512 combine_avx512(const __m512 m0, const __m512 m1, const __m512 m2, const __m512 m3,
+        const __m512 x, const __m512 y, const __m512 z, const __m512 w)
+    {
+        return _mm512_add_ps(_mm512_fmadd_ps(m1, y, _mm512_mul_ps(m0, x)), _mm512_fmadd_ps(m3, w, _mm512_mul_ps(m2, z)));
+    }
+
+    // the last partial block is masked, as with AVX2
+    TRANSFORM_BATCH_TARGET("avx512f")
+    void transform_avx512(const float* m, const Vec4Stream& in, const Vec4Stream& out, const std::size_t count)
+    {
+        const __m512 m00 = _mm512_set1_ps(m[0]), m01 = _mm512_set1_ps(m[1]), m02 = _mm512_set1_ps(m[2]), m03 = _mm512_set1_ps(m[3]);
+        const __m512 m10 = _mm512_set1_ps(m[4]), m11 = _mm512_set1_ps(m[5]), m12 = _mm512_set1_ps(m[6]), m13 = _mm512_set1_ps(m[7]);
+        const __m512 m20 = _mm512_set1_ps(m[8]), m21 = _mm512_set1_ps(m[9]), m22 = _mm512_set1_ps(m[10]), m23 = _mm512_set1_ps(m[11]);
+        const __m512 m30 = _mm512_set1_ps(m[12]), m31 = _mm512_set1_ps(m[13]), m32 = _mm512_set1_ps(m[14]), m33 = _mm512_set1_ps(m[15]);
+        const __m512 one = _mm512_set1_ps(1.0f);
+        const float* const inX = in.x;
+        const float* const inY = in.y;
+        const float* const inZ = in.z;
+        const float* const inW = in.w;
+        float* const outX = out.x;
+        float* const outY = out.y;
+        float* const outZ = out.z;
+        float* const outW = out.w;
+        for (std::size_t i = 0; i < count; i += 16)
+        {
+            const std::size_t remaining = count - i;
+            const __mmask16 mask = remaining >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << remaining) - 1);
+            const __m512 x = _mm512_maskz_loadu_ps(mask, inX + i);
+            const __m512 y = _mm512_maskz_loadu_ps(mask, inY + i);
+            const __m512 z = _mm512_maskz_loadu_ps(mask, inZ + i);
+            const __m512 w = inW != nullptr ? _mm512_maskz_loadu_ps(mask, inW + i) : one;
+            _mm512_mask_storeu_ps(outX + i, mask, combine_avx512(m00, m10, m20, m30, x, y, z, w));
+            _mm512_mask_storeu_ps(outY + i, mask, combine_avx512(m01, m11, m21, m31, x, y, z, w));
+            _mm512_mask_storeu_ps(outZ + i, mask, combine_avx512(m02, m12, m22, m32, x, y, z, w));
+            if (outW != nullptr)
+                _mm512_mask_storeu_ps(outW + i, mask, combine_avx512(m03, m13, m23, m33, x, y, z, w));
+        }
+    }
+
+    // a whole matrix per register, one column of rhs per 128-bit lane
+    TRANSFORM_BATCH_TARGET("avx512f")
+    void multiply_avx512(const float* lhs, const std::size_t lhsStride, const float* rhs, float* out, const std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i, lhs += lhsStride, rhs += 16, out += 16)
+        {
+            const __m512 a0 = _mm512_broadcast_f32x4(_mm_loadu_ps(lhs));
+            const __m512 a1 = _mm512_broadcast_f32x4(_mm_loadu_ps(lhs + 4));
+            const __m512 a2 = _mm512_broadcast_f32x4(_mm_loadu_ps(lhs + 8));
+            const __m512 a3 = _mm512_broadcast_f32x4(_mm_loadu_ps(lhs + 12));
+            const __m512 b = _mm512_loadu_ps(rhs);
+            __m512 sum = _mm512_mul_ps(a0, _mm512_permute_ps(b, _MM_SHUFFLE(0, 0, 0, 0)));
+            sum = _mm512_fmadd_ps(a1, _mm512_permute_ps(b, _MM_SHUFFLE(1, 1, 1, 1)), sum);
+            sum = _mm512_fmadd_ps(a2, _mm512_permute_ps(b, _MM_SHUFFLE(2, 2, 2, 2)), sum);
+            _mm512_storeu_ps(out, _mm512_fmadd_ps(a3, _mm512_permute_ps(b, _MM_SHUFFLE(3, 3, 3, 3)), sum));
+        }
+    }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+    SimdLevel detect_level()
+    {
+#ifdef TRANSFORM_BATCH_X86
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        const int leaves = info[0];
+        __cpuid(info, 1);
+        const bool sse2 = (info[3] & (1 << 26)) != 0;
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        // the OS has to save the wider registers on a context switch as well
+        const unsigned long long enabled = (info[2] & (1 << 27)) != 0 ? _xgetbv(0) : 0;
+        bool avx2 = false, avx512 = false;
+        if (leaves >= 7)
+        {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0 && fma && (enabled & 0x6) == 0x6;
+            avx512 = (info[1] & (1 << 16)) != 0 && (enabled & 0xE6) == 0xE6;
+        }
+#else
+        __builtin_cpu_init();
+        const bool sse2 = __builtin_cpu_supports("sse2");
+        const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        const bool avx512 = __builtin_cpu_supports("avx512f");
+#endif
+        return avx512 ? SimdLevel::AVX512 : avx2 ? SimdLevel::AVX2 : sse2 ? SimdLevel::SSE2 : SimdLevel::Scalar;
+#else
+        return SimdLevel::Scalar;
+#endif
+    }
+
+    std::atomic<int> level_limit{ static_cast<int>(SimdLevel::AVX512) };
+
+    void multiply_batch(const float* lhs, const std::size_t lhsStride, const float* rhs, float* out, const std::size_t count)
+    {
+        if (count == 0)
+            return;
+        switch (TransformBatch::activeLevel())
+        {
+#ifdef TRANSFORM_BATCH_X86
+        case SimdLevel::AVX512:
+            multiply_avx512(lhs, lhsStride, rhs, out, count);
+            return;
+        case SimdLevel::AVX2:
+            multiply_avx2(lhs, lhsStride, rhs, out, count);
+            return;
+        case SimdLevel::SSE2:
+            multiply_sse2(lhs, lhsStride, rhs, out, count);
+            return;
+#endif
+        default:
+            multiply_scalar(lhs, lhsStride, rhs, out, count);
+        }
+    }
+
+    void inverse_batch(const float* in, float* out, const std::size_t count, const MatrixKind kind)
+    {
+        if (count == 0)
+            return;
+        switch (TransformBatch::activeLevel())
+        {
+#ifdef TRANSFORM_BATCH_X86
+        // the affine inverse is short enough that SSE2 keeps up at every level, and the general
+        // one gains nothing from a third matrix per register
+        case SimdLevel::AVX512:
+        case SimdLevel::AVX2:
+            if (kind == MatrixKind::General)
+                inverse_general_avx2(in, out, count);
+            else
+                inverse_affine_sse2(in, out, count, kind == MatrixKind::Rigid);
+            return;
+        case SimdLevel::SSE2:
+            if (kind == MatrixKind::General)
+                inverse_general_sse2(in, out, count);
+            else
+                inverse_affine_sse2(in, out, count, kind == MatrixKind::Rigid);
+            return;
+#endif
+        default:
+            if (kind == MatrixKind::General)
+                inverse_general_scalar(in, out, count);
+            else
+                inverse_affine_scalar(in, out, count, kind == MatrixKind::Rigid);
+        }
+    }
+}
+
+SimdLevel TransformBatch::supportedLevel()
+{
+    static const SimdLevel level = detect_level();
+    return level;
+}
+
+void TransformBatch::limitLevel(const SimdLevel level)
+{
+    level_limit = static_cast<int>(level);
+}
+
+SimdLevel TransformBatch::activeLevel()
+{
+    return static_cast<SimdLevel>(std::min(static_cast<int>(supportedLevel()), level_limit.load()));
+}
+
+const char* TransformBatch::levelName(const SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::SSE2:
+        return "SSE2";
+    case SimdLevel::AVX2:
+        return "AVX2";
+    case SimdLevel::AVX512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
+
+void TransformBatch::transform(const glm::mat4& m, const Vec4Stream& in, const Vec4Stream& out, const std::size_t count)
+{
+    switch (activeLevel())
+    {
+#ifdef TRANSFORM_BATCH_X86
+    case SimdLevel::AVX512:
+        transform_avx512(elements(m), in, out, count);
+        return;
+    case SimdLevel::AVX2:
+        transform_avx2(elements(m), in, out, count);
+        return;
+    case SimdLevel::SSE2:
+        transform_sse2(elements(m), in, out, count);
+        return;
+#endif
+    default:
+        transform_scalar(elements(m), in, out, 0, count);
+    }
+}
+
+void TransformBatch::multiply(const glm::mat4& lhs, const glm::mat4* rhs, glm::mat4* out, const std::size_t count)
+{
+    multiply_batch(elements(lhs), 0, &rhs[0][0][0], &out[0][0][0], count);
+}
+
+void TransformBatch::multiply(const glm::mat4* lhs, const glm::mat4* rhs, glm::mat4* out, const std::size_t count)
+{
+    multiply_batch(&lhs[0][0][0], 16, &rhs[0][0][0], &out[0][0][0], count);
+}
+
+MatrixKind TransformBatch::classify(const glm::mat4& m, const float tolerance)
+{
+    if (m[0][3] != 0.0f || m[1][3] != 0.0f || m[2][3] != 0.0f || m[3][3] != 1.0f)
+        return MatrixKind::General;
+    for (int a = 0; a < 3; ++a)
+    {
+        for (int b = a; b < 3; ++b)
+        {
+            const float dot = m[a][0] * m[b][0] + m[a][1] * m[b][1] + m[a][2] * m[b][2];
+            if (std::fabs(dot - (a == b ? 1.0f : 0.0f)) > tolerance)
+                return MatrixKind::Affine;
+        }
+    }
+    return MatrixKind::Rigid;
+}
+
+void TransformBatch::inverse(const glm::mat4* in, glm::mat4* out, const std::size_t count, const MatrixKind kind)
+{
+    inverse_batch(&in[0][0][0], &out[0][0][0], count, kind);
+}
+
+glm::mat4 TransformBatch::inverse(const glm::mat4& m, const MatrixKind kind)
+{
+    glm::mat4 result;
+    inverse_batch(elements(m), &result[0][0], 1, kind);
+    return result;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+
+// a run of vec4s stored structure-of-arrays, one array per component, so that a vector register
+// holds the same component of several points
+struct Vec4Stream
+{
+    float* x = nullptr;
+    float* y = nullptr;
+    float* z = nullptr;
+    // positions may leave w out: an input without w reads it as 1, an output without w skips it
+    float* w = nullptr;
+};
+
+// the instruction sets the batch kernels come in, narrowest first
+enum class SimdLevel
+{
+    Scalar,
+    SSE2,
+    AVX2,       // with FMA
+    AVX512,     // AVX-512F
+};
+
+// what a caller knows about the matrices it inverts; the narrower the kind, the cheaper the inverse
+enum class MatrixKind
+{
+    General,    // anything invertible
+    Affine,     // last row 0 0 0 1: only the upper 3x3 needs inverting, the translation follows
+    Rigid,      // rotation and translation: the inverse is the transposed rotation and a translation
+};
+
+// transforms many vectors or matrices per call instead of one glm operator* at a time. Points
+// go through 4, 8 or 16 at a time from structure-of-arrays streams, matrices one per vector
+// operation, with the widest kernels the CPU supports, picked at run time, so the build
+// needs no /arch flags (TRANSFORM_BATCH_NO_SIMD leaves only the scalar kernels).
+// The scalar and SSE2 kernels add in glm's order and match operator* bit for bit; the AVX2
+// and AVX-512 ones fuse the multiply-adds, which may change the last bit.
+class TransformBatch
+{
+public:
+    // the widest level this CPU and OS support
+    static SimdLevel supportedLevel();
+    // keeps the kernels at or below level, for comparing them; starts at supportedLevel()
+    static void limitLevel(SimdLevel level);
+    static SimdLevel activeLevel();
+    static const char* levelName(SimdLevel level);
+
+    // out[i] = m * in[i]; out may be the same streams as in
+    static void transform(const glm::mat4& m, const Vec4Stream& in, const Vec4Stream& out, std::size_t count);
+    // out[i] = lhs * rhs[i], e.g. a view-projection matrix times every model matrix
+    static void multiply(const glm::mat4& lhs, const glm::mat4* rhs, glm::mat4* out, std::size_t count);
+    // out[i] = lhs[i] * rhs[i]; out may be the same array as either input
+    static void multiply(const glm::mat4* lhs, const glm::mat4* rhs, glm::mat4* out, std::size_t count);
+
+    // the narrowest kind m is: Affine when its last row is exactly 0 0 0 1, Rigid when the
+    // columns of its upper 3x3 are also orthonormal to within tolerance
+    static MatrixKind classify(const glm::mat4& m, float tolerance = 1.0e-5f);
+    // out[i] = inverse(in[i]), trusting every in[i] to be of the given kind; out may be in.
+    // General matrices go through a 2x2 block inverse, two at a time with AVX, affine ones
+    // through three cross products and rigid ones through a transpose
+    static void inverse(const glm::mat4* in, glm::mat4* out, std::size_t count, MatrixKind kind);
+    static glm::mat4 inverse(const glm::mat4& m, MatrixKind kind);
+};
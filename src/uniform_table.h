@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+// flat open-addressing hash table mapping uniform names to locations.
+// filled once after a program links, so lookups never reach the driver.
+class UniformTable
+{
+public:
+    // returned for names the program does not use (same as glGetUniformLocation)
+    static constexpr int INVALID_LOCATION = -1;
+
+    void clear()
+    {
+        names.clear();
+        slots.clear();
+        count = 0;
+    }
+
+    void insert(const std::string& name, const int location)
+    {
+        // keep the load factor at or below 1/2 so probe chains stay short
+        if ((count + 1) * 2 > slots.size())
+            grow();
+        insertSlot(name, location, hash(name.c_str(), name.size()));
+    }
+
+    int find(const char* name, const std::size_t length) const
+    {
+        if (slots.empty())
+            return INVALID_LOCATION;
+        const std::uint32_t h = hash(name, length);
+        const std::size_t mask = slots.size() - 1;
+        for (std::size_t i = h & mask;; i = (i + 1) & mask)
+        {
+            const Slot& slot = slots[i];
+            if (slot.name < 0)
+                return INVALID_LOCATION;
+            if (slot.hash == h && names[slot.name].size() == length && std::memcmp(names[slot.name].data(), name, length) == 0)
+                return slot.location;
+        }
+    }
+    int find(const std::string& name) const { return find(name.c_str(), name.size()); }
+    int find(const char* name) const { return find(name, std::strlen(name)); }
+
+    std::size_t size() const { return count; }
+
+private:
+    struct Slot
+    {
+        std::uint32_t hash;
+        int name;       // index into names, -1 when the slot is empty
+        int location;
+    };
+
+    std::vector<std::string> names;
+    std::vector<Slot> slots;
+    std::size_t count = 0;
+
+    // 32-bit FNV-1a
+    static std::uint32_t hash(const char* data, const std::size_t length)
+    {
+        std::uint32_t h = 2166136261u;
+        for (std::size_t i = 0; i < length; ++i)
+        {
+            h ^= static_cast<unsigned char>(data[i]);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    void insertSlot(const std::string& name, const int location, const std::uint32_t h)
+    {
+        const std::size_t mask = slots.size() - 1;
+        for (std::size_t i = h & mask;; i = (i + 1) & mask)
+        {
+            Slot& slot = slots[i];
+            if (slot.name < 0)
+            {
+                names.push_back(name);
+                slot = { h, static_cast<int>(names.size() - 1), location };
+                ++count;
+                return;
+            }
+            if (slot.hash == h && names[slot.name] == name)
+            {
+                slot.location = location;
+                return;
+            }
+        }
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(slots);
+        std::vector<std::string> oldNames;
+        oldNames.swap(names);
+        slots.assign(old.empty() ? 16 : old.size() * 2, Slot{ 0, -1, INVALID_LOCATION });
+        count = 0;
+        for (const Slot& slot : old)
+        {
+            if (slot.name >= 0)
+                insertSlot(oldNames[slot.name], slot.location, slot.hash);
+        }
+    }
+};